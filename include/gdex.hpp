@@ -28,6 +28,7 @@
 #include <gd.h>
 #include <string>
 #include <map>
+#include <atomic>
 #include <stdint.h>
 #include <vector>
 
@@ -48,55 +49,342 @@
 #define BGDEX_DECLARE(rt) extern "C" BGDEX_DECLARE_CC(rt)
 
 #include <gdex_io.hpp>
+#include <gdex_view.hpp>
+#include <gdex_algorithm.hpp>
+#include <gdex_pool.hpp>
+#include <gdex_cancel.hpp>
+#include <gdex_memory.hpp>
 
 namespace gd
 {
+	enum class SimdLevel
+	{
+		Scalar,
+		SSE2,
+		AVX2
+	};
+
+	// Instruction set the pixel kernels are bound to: the best one the
+	// CPU and OS support, lowered by GDEX_SIMD=scalar|sse2. Both are
+	// looked at once, on first use; later changes to GDEX_SIMD do not
+	// count.
+	BGDEX_DECLARE_CC(SimdLevel) simdLevel();
+
+	enum class Opacity
+	{
+		Unknown,     // not looked at yet
+		Opaque,      // every pixel fully opaque
+		BinaryAlpha, // fully opaque or fully transparent, nothing between
+		FullAlpha
+	};
+
+	// Classifies the view; the first translucent pixel ends the scan
+	BGDEX_DECLARE_CC(Opacity) opacity(const ImageView& view);
+
+	// Stores the color into every pixel of the view, ignoring blending mode
+	BGDEX_DECLARE_CC(void) fill(const MutableImageView& view, int color);
+	// Same result as gdImageFilledRectangle on each rectangle, but spans
+	// which would be stored unblended are written a row at a time
+	BGDEX_DECLARE_CC(void) fillRectangles(gdImagePtr img, const Rect* rects, size_t count, int color);
+	// Same result as gdImageCopy; copies onto truecolor images from
+	// within the source are clipped once and then stored or blended a
+	// row at a time, palette sources expanded on the way. Rectangles
+	// running past the source are left to gdImageCopy.
+	BGDEX_DECLARE_CC(void) copy(gdImagePtr dst, const gdImage* src, int dstX, int dstY, int srcX, int srcY, int w, int h);
+	// As above; an opaque src turns blending copies into plain stores
+	BGDEX_DECLARE_CC(void) copy(gdImagePtr dst, const gdImage* src, int dstX, int dstY, int srcX, int srcY, int w, int h, Opacity srcOpacity);
+
+	enum class CompositeOp
+	{
+		Clear,
+		Source,
+		Over,
+		In,
+		Out,
+		Atop,
+		DestinationOver,
+		DestinationIn,
+		DestinationOut,
+		Xor
+	};
+
+	// Porter-Duff compositing of src, scaled by opacity (0..1), onto the
+	// truecolor dst at (x, y). Only pixels under the source rectangle
+	// are touched; a source overlapping dst is read as it was before the
+	// call. Returns false for palette destinations, unknown operators and
+	// non-finite opacities, and when cancelled, which leaves dst partly
+	// composited.
+	BGDEX_DECLARE_CC(bool) composite(gdImagePtr dst, const ImageView& src, CompositeOp op, int x, int y, float opacity);
+
+	struct FillSegment
+	{
+		int y;
+		int left;
+		int right;
+		int dy;
+	};
+
+	// Scratch memory of floodFill; keeping one around between calls
+	// saves reallocating the segment stack on every fill
+	struct FillStack
+	{
+		std::vector<FillSegment> segments;
+		std::vector<uint32_t> visited;
+	};
+
+	// Scanline fill of the 4-connected region around (x, y), within the
+	// clip rectangle rather than the whole image. Pixels whose channels
+	// are all within tolerance of the seed pixel's belong to the region,
+	// palette entries being compared for palette images; tolerance 0
+	// takes exactly the seed color. Negative colors (tiles, brushes,
+	// styles) are handed to gdImageFill.
+	BGDEX_DECLARE_CC(void) floodFill(gdImagePtr img, int x, int y, int color, int tolerance, FillStack& stack);
+
+	enum class Rotation
+	{
+		Rotate90, // clockwise
+		Rotate180,
+		Rotate270
+	};
+
+	// In place; vertical flip only reorders the row table
+	BGDEX_DECLARE_CC(void) flipVertical(gdImagePtr img);
+	BGDEX_DECLARE_CC(void) flipHorizontal(gdImagePtr img);
+	// New images of the same pixel format, palette and alpha flags
+	BGDEX_DECLARE_CC(gdImagePtr) rotate(const gdImage* img, Rotation rotation);
+	BGDEX_DECLARE_CC(gdImagePtr) transpose(const gdImage* img);
+
+	// Gaussian blur approximated with three sliding box filters, so the
+	// cost per pixel does not grow with sigma. Truecolor images and
+	// finite, positive sigmas only; false for anything else.
+	BGDEX_DECLARE_CC(bool) blur(gdImagePtr img, float sigma);
+	// How far, in pixels, the blur of a given sigma spreads; 0 for
+	// sigmas blur rejects
+	BGDEX_DECLARE_CC(int) blurExtent(float sigma);
+	// Blurred silhouette of img in the given color, padded on every
+	// side by blurExtent(sigma), so nothing of the shadow is cut off.
+	// Sigmas of 0 or less give a sharp one, NaN and infinities nullptr,
+	// as do shadows too large for a gdImage or for memory.
+	BGDEX_DECLARE_CC(gdImagePtr) dropShadow(const gdImage* img, float sigma, int color);
+
+	struct ResampleOptions
+	{
+		// Strength of the unsharp mask run over output rows as they
+		// are produced; 0 leaves the area average as it is
+		float sharpen;
+		// Average in linear light rather than on sRGB values, which
+		// keeps thin bright and dark details from shifting in tone
+		bool linear;
+		// Of the source, when known. Opaque sources skip the alpha
+		// arithmetic and produce images which do not save alpha.
+		Opacity opacity;
+
+		ResampleOptions() : sharpen(0.0f), linear(false), opacity(Opacity::Unknown) {}
+	};
+
+	// Area-averaging scale of src into a new truecolor image, with
+	// alpha saved unless the source is known to be opaque; nullptr
+	// when cancelled
+	BGDEX_DECLARE_CC(gdImagePtr) resample(const gdImage* src, int w, int h, const ResampleOptions& options);
+
+	struct QuantizeOptions
+	{
+		// Palette size, 2 to 256, including the transparent entry
+		int colors;
+		// k-means passes refining the median cut palette
+		int iterations;
+		// Floyd-Steinberg error diffusion; runs on a single thread
+		bool dither;
+
+		QuantizeOptions() : colors(gdMaxColors), iterations(3), dither(false) {}
+	};
+
+	// Palette image approximating src. Fully transparent pixels share
+	// one entry, which becomes the transparent color. nullptr when
+	// cancelled.
+	BGDEX_DECLARE_CC(gdImagePtr) quantize(const gdImage* src, const QuantizeOptions& options);
+
+	// Truecolor copy of src; the transparent palette index becomes
+	// fully transparent black pixels and alpha gets saved
+	BGDEX_DECLARE_CC(gdImagePtr) toTrueColor(const gdImage* src);
+
+	// Smallest rectangle, in image coordinates, holding every pixel of
+	// the view that is not fully transparent or the transparent color;
+	// empty when there are none
+	BGDEX_DECLARE_CC(Rect) contentBounds(const ImageView& view);
+	// New image of the same kind holding just the pixels of the view
+	BGDEX_DECLARE_CC(gdImagePtr) crop(const ImageView& view);
+
+	struct ColorBucket
+	{
+		int color;   // opaque mean color of the bucket
+		float share; // of all visible pixels, weighted by opacity
+	};
+
+	struct ImageStatistics
+	{
+		// Color channels only count pixels that are not fully transparent
+		uint32_t red[256];
+		uint32_t green[256];
+		uint32_t blue[256];
+		uint32_t alpha[gdAlphaMax + 1];
+		uint32_t pixels;
+		// Opaque mean color weighted by opacity; black when nothing shows
+		int mean;
+		// Most common 4-4-4 bit color buckets, most common first
+		std::vector<ColorBucket> dominant;
+
+		ImageStatistics() : red(), green(), blue(), alpha(), pixels(0), mean(0) {}
+
+		bool opaque() const { return alpha[gdAlphaOpaque] == pixels; }
+		bool empty() const { return alpha[gdAlphaTransparent] == pixels; }
+		// anything between fully opaque and fully transparent
+		bool translucent() const { return alpha[gdAlphaOpaque] + alpha[gdAlphaTransparent] != pixels; }
+	};
+
+	struct StatisticsOptions
+	{
+		// How many color buckets to report
+		int dominant;
+		// Bands of rows on separate threads, when the image is big enough
+		bool parallel;
+		// Of the view, when known; opaque views skip the alpha tests
+		Opacity opacity;
+
+		StatisticsOptions() : dominant(5), parallel(true), opacity(Opacity::Unknown) {}
+	};
+
+	// Histograms, mean and dominant colors in one pass over the view;
+	// nothing counted, pixels included, when cancelled
+	BGDEX_DECLARE_CC(ImageStatistics) statistics(const ImageView& view, const StatisticsOptions& options);
+
+	struct ImageDifference
+	{
+		// Largest absolute channel difference, alpha doubled to 0..254
+		int maxChannel;
+		// Mean squared channel difference and the PSNR it gives, in dB;
+		// PSNR is infinite for identical images
+		double mse;
+		double psnr;
+
+		// what views of different sizes compare as, and cancelled
+		// comparisons return
+		ImageDifference() : maxChannel(255), mse(255.0 * 255.0), psnr(0.0) {}
+	};
+
+	// Views compare pixel for pixel, palette ones through their palettes;
+	// views of different sizes are never equal, nor are any once the
+	// comparison is cancelled
+	BGDEX_DECLARE_CC(bool) equal(const ImageView& lhs, const ImageView& rhs);
+	BGDEX_DECLARE_CC(ImageDifference) difference(const ImageView& lhs, const ImageView& rhs);
+	// Mean SSIM of the luma over black, on 8x8 windows 4 pixels apart;
+	// NaN when cancelled
+	BGDEX_DECLARE_CC(double) ssim(const ImageView& lhs, const ImageView& rhs);
+
+	enum class HashKind
+	{
+		Difference, // dHash of a 9x8 thumbnail
+		Perceptual  // pHash, low DCT frequencies of a 32x32 thumbnail
+	};
+
+	// 64-bit hash of the luma over black; images which look alike hash
+	// a small Hamming distance apart
+	BGDEX_DECLARE_CC(uint64_t) perceptualHash(const ImageView& view, HashKind kind);
+	// hashes[i] = perceptualHash(images[i]), with images spread over
+	// threads; false when cancelled, with only some of them filled in
+	BGDEX_DECLARE_CC(bool) perceptualHashes(const gdImage* const* images, size_t count, HashKind kind, uint64_t* hashes);
+
+	inline int hammingDistance(uint64_t lhs, uint64_t rhs)
+	{
+		auto bits = lhs ^ rhs;
+		bits = bits - ((bits >> 1) & 0x5555555555555555ull);
+		bits = (bits & 0x3333333333333333ull) + ((bits >> 2) & 0x3333333333333333ull);
+		bits = (bits + (bits >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+		return (int)((bits * 0x0101010101010101ull) >> 56);
+	}
+
+	// Indices of the hashes within maxDistance of hash
+	BGDEX_DECLARE_CC(std::vector<size_t>) findSimilar(const uint64_t* hashes, size_t count, uint64_t hash, int maxDistance);
+
 	class GdImage
 	{
 		gdImagePtr img;
+		// Cached classification; anything that may change pixels
+		// behind our back resets it to Unknown. Atomic, as opacity()
+		// fills it in from const methods other threads may be calling
+		// too; a stale read only costs a fresh scan.
+		mutable std::atomic<Opacity> known;
+
+		Opacity cached() const { return known.load(std::memory_order_relaxed); }
+		void cache(Opacity value) const { known.store(value, std::memory_order_relaxed); }
 
 	public:
-		explicit GdImage(gdImagePtr img) : img(img) {}
+		explicit GdImage(gdImagePtr img, Opacity known = Opacity::Unknown) : img(img), known(known) {}
 		GdImage() = delete;
 		GdImage(const GdImage&) = delete;
 		GdImage& operator=(const GdImage&) = delete;
 		GdImage(GdImage&& oth)
-			: img(oth.release())
+			: img(nullptr)
+			, known(Opacity::Unknown)
 		{
+			swap(oth);
 		}
 		GdImage& operator=(GdImage&& oth)
 		{
-			std::swap(img, oth.img);
+			swap(oth);
 			return *this;
 		}
 
-		~GdImage() { if (img) gdImageDestroy(img); }
+		~GdImage() { if (img) destroyImage(img); }
 		explicit operator bool() const { return img != nullptr; }
-		gdImagePtr get() { return img; }
+		// Raw access may be used to draw, so it forgets the opacity
+		gdImagePtr get() { cache(Opacity::Unknown); return img; }
 
 		void reset(gdImagePtr newImg)
 		{
 			if (img)
-				gdImageDestroy(img);
+				destroyImage(img);
 			img = newImg;
+			cache(Opacity::Unknown);
 		}
 
 		gdImagePtr release()
 		{
 			auto tmp = img;
 			img = nullptr;
+			cache(Opacity::Unknown);
 			return tmp;
 		}
 
 		void swap(GdImage& oth)
 		{
 			std::swap(img, oth.img);
+			auto mine = cached();
+			cache(oth.cached());
+			oth.cache(mine);
+		}
+
+		// Computed on first use, then cached
+		Opacity opacity() const
+		{
+			auto value = cached();
+			if (value == Opacity::Unknown)
+			{
+				value = gd::opacity(view());
+				cache(value);
+			}
+			return value;
 		}
 
 		// GD2
 		size_t width() const { return img->sx; }
 		size_t height() const { return img->sy; }
 
+		ImageView view() const { return ImageView{ img }; }
+		ImageView view(const Rect& crop) const { return ImageView{ img, crop }; }
+		MutableImageView mutableView() { cache(Opacity::Unknown); return MutableImageView{ img }; }
+		MutableImageView mutableView(const Rect& crop) { cache(Opacity::Unknown); return MutableImageView{ img, crop }; }
+
 		void alphaBlending(bool alpha) { gdImageAlphaBlending(img, alpha ? 1 : 0); }
 		void saveAlpha(bool alpha) { gdImageSaveAlpha(img, alpha ? 1 : 0); }
 
@@ -113,47 +401,300 @@ namespace gd
 		void copy(const GdImage& src, int dstX = 0, int dstY = 0, int srcX = 0, int srcY = 0, int w = -1, int h = -1)
 		{
 			if (w < 0) w = src.width();
-			if (h < 0) h = src.width();
-			gdImageCopy(img, src.img, dstX, dstY, srcX, srcY, w, h);
+			if (h < 0) h = src.height();
+			auto srcOpacity = src.opacity();
+			gd::copy(img, src.img, dstX, dstY, srcX, srcY, w, h, srcOpacity);
+			// opaque over opaque, or anything blended onto it, stays opaque
+			if (cached() != Opacity::Opaque || (srcOpacity != Opacity::Opaque && (!img->trueColor || !img->alphaBlendingFlag)))
+				cache(Opacity::Unknown);
+		}
+
+		void copy(const ImageView& src, int dstX = 0, int dstY = 0)
+		{
+			auto& crop = src.crop();
+			gd::copy(img, src.image(), dstX, dstY, crop.x, crop.y, crop.width, crop.height);
+			cache(Opacity::Unknown);
+		}
+
+		bool composite(const ImageView& src, CompositeOp op = CompositeOp::Over, int x = 0, int y = 0, float opacity = 1.0f)
+		{
+			cache(Opacity::Unknown);
+			return gd::composite(img, src, op, x, y, opacity);
+		}
+
+		bool composite(const GdImage& src, CompositeOp op = CompositeOp::Over, int x = 0, int y = 0, float opacity = 1.0f)
+		{
+			cache(Opacity::Unknown);
+			return gd::composite(img, src.view(), op, x, y, opacity);
 		}
 
 		void rectangle(int color, int x = 0, int y = 0, int w = -1, int h = -1)
 		{
 			if (w < 0) w = width();
-			if (h < 0) h = width();
-			gdImageRectangle(img, x, y, x + w, y + h, color);
+			if (h < 0) h = height();
+			if (!w || !h)
+				return;
+
+			if (img->thick != 1)
+			{
+				gdImageRectangle(img, x, y, x + w - 1, y + h - 1, color);
+				return;
+			}
+
+			Rect edges[] = {
+				{ x, y, w, 1 },
+				{ x, y + h - 1, w, h > 1 ? 1 : 0 },
+				{ x, y + 1, 1, h - 2 },
+				{ x + w - 1, y + 1, w > 1 ? 1 : 0, h - 2 }
+			};
+			gd::fillRectangles(img, edges, sizeof(edges) / sizeof(edges[0]), color);
+			painted(color);
 		}
 
 		void fillRectangle(int color, int x = 0, int y = 0, int w = -1, int h = -1)
 		{
 			if (w < 0) w = width();
-			if (h < 0) h = width();
-			gdImageFilledRectangle(img, x, y, x + w, x + h, color);
+			if (h < 0) h = height();
+			Rect rect{ x, y, w, h };
+			gd::fillRectangles(img, &rect, 1, color);
+			painted(color);
 		}
 
-		void fill(int color, int x, int y)
+		void fillRectangles(int color, const std::vector<Rect>& rects)
 		{
-			gdImageFill(img, x, y, color);
+			gd::fillRectangles(img, rects.data(), rects.size(), color);
+			painted(color);
 		}
 
-		void resample(int w, int h)
+		void fill(int color, int x, int y, int tolerance = 0)
 		{
-			if (width() == w && height() == h)
-				return;
+			FillStack stack;
+			floodFill(img, x, y, color, tolerance, stack);
+			painted(color);
+		}
+
+		void fill(int color, int x, int y, int tolerance, FillStack& stack)
+		{
+			floodFill(img, x, y, color, tolerance, stack);
+			painted(color);
+		}
+
+		// Moving pixels around does not change the opacity
+		void flipVertical() { gd::flipVertical(img); }
+		void flipHorizontal() { gd::flipHorizontal(img); }
+
+		// false, leaving the image as it was, when the new image could
+		// not be made or the call was cancelled; so are the ones below
+		bool rotate(Rotation rotation)
+		{
+			GdImage tmp{ gd::rotate(img, rotation), cached() };
+			if (!tmp)
+				return false;
+			swap(tmp);
+			return true;
+		}
+
+		bool transpose()
+		{
+			GdImage tmp{ gd::transpose(img), cached() };
+			if (!tmp)
+				return false;
+			swap(tmp);
+			return true;
+		}
+
+		bool blur(float sigma)
+		{
+			cache(Opacity::Unknown);
+			return gd::blur(img, sigma);
+		}
+
+		GdImage dropShadow(float sigma, int color) const
+		{
+			return GdImage{ gd::dropShadow(img, sigma, color) };
+		}
+
+		// Same as rotate
+		bool resample(int w, int h, const ResampleOptions& options = ResampleOptions())
+		{
+			if (width() == w && height() == h && options.sharpen <= 0.0f)
+				return true;
+
+			auto hinted = options;
+			if (hinted.opacity == Opacity::Unknown)
+				hinted.opacity = opacity();
+
+			// averages of opaque pixels are opaque, nothing else carries over
+			GdImage tmp{ gd::resample(img, w, h, hinted), hinted.opacity == Opacity::Opaque ? Opacity::Opaque : Opacity::Unknown };
+			if (!tmp)
+				return false;
+			swap(tmp);
+			return true;
+		}
+
+		// Same as rotate
+		bool quantize(const QuantizeOptions& options = QuantizeOptions())
+		{
+			GdImage tmp{ gd::quantize(img, options), cached() == Opacity::Opaque ? Opacity::Opaque : Opacity::Unknown };
+			if (!tmp)
+				return false;
+			swap(tmp);
+			return true;
+		}
+
+		// Empty for palette images; see gdex_algorithm.hpp
+		Rows<ImageView> rows() const { return Rows<ImageView>{ view() }; }
+		Rows<MutableImageView> mutableRows() { return Rows<MutableImageView>{ mutableView() }; }
+		Tiles<ImageView> tiles(int w, int h) const { return Tiles<ImageView>{ view(), w, h }; }
+		Tiles<MutableImageView> mutableTiles(int w, int h) { return Tiles<MutableImageView>{ mutableView(), w, h }; }
+
+		template <typename Fn>
+		void forEachPixel(Execution policy, Fn fn) const { gd::forEachPixel(view(), policy, fn); }
+
+		template <typename Fn>
+		void transform(Execution policy, Fn fn) { gd::transform(mutableView(), policy, fn); }
 
-			GdImage tmp{ gdImageCreateTrueColor(w, h) };
-			int bck = tmp.colorAllocate(255, 255, 255, gdAlphaTransparent);
-			tmp.alphaBlending(false);
-			tmp.fillRectangle(bck);
-			tmp.alphaBlending(true);
-			tmp.saveAlpha(true);
-			gdImageCopyResampled(tmp.img, img, 0, 0, 0, 0, w, h, width(), height());
+		template <typename T, typename Map, typename Combine>
+		T reduce(Execution policy, T init, Map map, Combine combine) const
+		{
+			return gd::reduce(view(), policy, init, map, combine);
+		}
+
+		// Uses the cached opacity, but does not scan for it
+		ImageStatistics statistics(const StatisticsOptions& options = StatisticsOptions()) const
+		{
+			auto hinted = options;
+			if (hinted.opacity == Opacity::Unknown)
+				hinted.opacity = cached();
+			return gd::statistics(view(), hinted);
+		}
+
+		bool equals(const GdImage& oth) const { return gd::equal(view(), oth.view()); }
+		ImageDifference difference(const GdImage& oth) const { return gd::difference(view(), oth.view()); }
+		double ssim(const GdImage& oth) const { return gd::ssim(view(), oth.view()); }
+		uint64_t perceptualHash(HashKind kind = HashKind::Difference) const { return gd::perceptualHash(view(), kind); }
+
+		Rect contentBounds() const { return gd::contentBounds(view()); }
+		ImageView trimmed() const { return view(contentBounds()); }
+
+		// Crops the transparent margins away; an image with no content
+		// at all is left as it is, which counts as success. Otherwise
+		// same as rotate.
+		bool trim()
+		{
+			auto bounds = contentBounds();
+			if (bounds.empty() || (bounds.width == img->sx && bounds.height == img->sy))
+				return true;
+
+			GdImage tmp{ gd::crop(view(bounds)) };
+			if (!tmp)
+				return false;
 			swap(tmp);
+			return true;
+		}
+
+		// Same as rotate
+		bool toTrueColor()
+		{
+			if (img->trueColor)
+				return true;
+
+			GdImage tmp{ gd::toTrueColor(img), cached() };
+			if (!tmp)
+				return false;
+			swap(tmp);
+			return true;
+		}
+
+	private:
+		// Drawing keeps an opaque image opaque when the color is opaque
+		// or is blended onto it
+		void painted(int color)
+		{
+			if (cached() != Opacity::Opaque)
+				return;
+
+			if (img->trueColor && color >= 0)
+			{
+				if (img->alphaBlendingFlag || gdTrueColorGetAlpha(color) == gdAlphaOpaque)
+					return;
+			}
+			else if (color >= 0 && color < gdMaxColors && color != img->transparent && img->alpha[color] == gdAlphaOpaque)
+				return;
+
+			cache(Opacity::Unknown);
 		}
 	};
 
+	struct LoadOptions
+	{
+		// Expand GIFs and palette PNGs to truecolor while loading
+		bool trueColor;
+
+		LoadOptions() : trueColor(false) {}
+	};
+
+	// With a memory budget configured, the decoded size, plus the file
+	// buffer when reading from path, is reserved before decoding, and
+	// nullptr returned if the budget rejects it; see gdex_memory.hpp.
+	// The image then stays charged until freed with destroyImage, not
+	// gdImageDestroy; wrapping it in a GdImage takes care of that.
 	BGDEX_DECLARE_CC(gdImagePtr) loadImage(int size, void* data);
 	BGDEX_DECLARE_CC(gdImagePtr) loadImage(const std::string& path);
+	BGDEX_DECLARE_CC(gdImagePtr) loadImage(int size, void* data, const LoadOptions& options);
+	BGDEX_DECLARE_CC(gdImagePtr) loadImage(const std::string& path, const LoadOptions& options);
+	// As above, also telling what the decoder learnt about opacity,
+	// ready to seed GdImage's cache; Unknown when it could not tell
+	BGDEX_DECLARE_CC(gdImagePtr) loadImage(int size, void* data, const LoadOptions& options, Opacity& opacity);
+	BGDEX_DECLARE_CC(gdImagePtr) loadImage(const std::string& path, const LoadOptions& options, Opacity& opacity);
+	// Decodes data for which reserved already holds the memory, as the
+	// readFile below leaves it, and charges it to the image
+	BGDEX_DECLARE_CC(gdImagePtr) loadImage(int size, void* data, const LoadOptions& options, Opacity& opacity, MemoryReservation& reserved);
+	// The whole file, as loadImage reads it before decoding
+	BGDEX_DECLARE_CC(bool) readFile(const std::string& path, std::vector<unsigned char>& out);
+	// Same, reserving the file size and the decodedSize() of its header
+	// the way loadImage(path) does, before reading past the header.
+	// False, with nothing held, if the budget rejects the file.
+	BGDEX_DECLARE_CC(bool) readFile(const std::string& path, std::vector<unsigned char>& out, const LoadOptions& options, MemoryReservation& reserved);
+
+	enum class ImageFormat
+	{
+		Png,
+		Jpeg,
+		Gif
+	};
+
+	struct EncodeOptions
+	{
+		ImageFormat format;
+		// JPEG only; negative picks libjpeg's default
+		int quality;
+
+		EncodeOptions() : format(ImageFormat::Png), quality(-1) {}
+		explicit EncodeOptions(ImageFormat format, int quality = -1) : format(format), quality(quality) {}
+	};
+
+	// Replaces out with the encoded file; false, and out empty, if the
+	// encoder failed
+	BGDEX_DECLARE_CC(bool) encodeImage(const gdImage* img, const EncodeOptions& options, std::vector<unsigned char>& out);
+
+	struct ImageHeader
+	{
+		ImageFormat format;
+		int width;
+		int height;
+		// whether libgd decodes it to a truecolor image
+		bool trueColor;
+	};
+
+	// Reads the size from a PNG, JPEG or GIF header without decoding;
+	// JPEG needs the bytes up to its frame header
+	BGDEX_DECLARE_CC(bool) probeImage(const void* data, size_t size, ImageHeader& header);
+	// imageFootprint of what loadImage makes of it, counting both images
+	// while a palette one is expanded
+	BGDEX_DECLARE_CC(size_t) decodedSize(const ImageHeader& header, const LoadOptions& options);
+	// Same, for the header at the start of data; 0 if there is none
+	BGDEX_DECLARE_CC(size_t) decodedSize(const void* data, size_t size, const LoadOptions& options);
 
 	namespace ico
 	{
@@ -0,0 +1,324 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __GDEX_ALGORITHM_HPP__
+#define __GDEX_ALGORITHM_HPP__
+
+#include <gdex_view.hpp>
+#include <gdex_cancel.hpp>
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(_MSC_VER)
+#define GDEX_IVDEP __pragma(loop(ivdep))
+#elif defined(__clang__)
+#define GDEX_IVDEP _Pragma("clang loop vectorize(enable)")
+#elif defined(__GNUC__)
+#define GDEX_IVDEP _Pragma("GCC ivdep")
+#else
+#define GDEX_IVDEP
+#endif
+
+namespace gd
+{
+	enum class Execution
+	{
+		Sequential, // raster order on the calling thread; fn may keep state
+		Vectorized, // calling thread, pixels of a row in no particular order
+		Parallel    // bands of rows on the shared pool, vectorized within a row
+	};
+
+	// Calls fn(begin, end) over bands of [0, rows); Parallel splits the
+	// rows between threads once rows * rowCost is worth it, the other
+	// policies make a single call on the calling thread
+	BGDEX_DECLARE_CC(void) forEachBand(int rows, size_t rowCost, Execution policy, const std::function<void(int, int)>& fn);
+
+	// Truecolor value of every palette index, gdMaxColors of them, as
+	// the library's own kernels see it: the transparent index is fully
+	// transparent
+	BGDEX_DECLARE_CC(void) paletteColors(const gdImage* img, int* colors);
+	// out[x] = colors[indices[x]]
+	BGDEX_DECLARE_CC(void) expandIndices(int* out, const unsigned char* indices, int count, const int* colors);
+
+	// Truecolor rows of any view; palette rows are expanded into a
+	// buffer owned by the reader, so each thread needs its own
+	class PixelRows
+	{
+		ImageView view;
+		std::vector<int> colors;
+		std::vector<int> expanded;
+
+	public:
+		explicit PixelRows(const ImageView& view)
+			: view(view)
+		{
+			if (view.trueColor())
+				return;
+			colors.resize(gdMaxColors);
+			expanded.resize(view.width());
+			paletteColors(view.image(), colors.data());
+		}
+
+		const int* row(int y)
+		{
+			if (view.trueColor())
+				return view.row(y);
+			expandIndices(expanded.data(), view.indexRow(y), view.width(), colors.data());
+			return expanded.data();
+		}
+	};
+
+	// One row of a truecolor view, usable in range-for
+	template <typename Pixel>
+	struct RowSpan
+	{
+		int y;
+		Pixel* pixels;
+		int width;
+
+		Pixel* begin() const { return pixels; }
+		Pixel* end() const { return pixels + width; }
+		Pixel& operator[](int x) const { return pixels[x]; }
+	};
+
+	// Rows of a truecolor view, top to bottom. View is ImageView or
+	// MutableImageView; only the latter hands out writable pixels.
+	// Palette views have no int rows to hand out and give an empty
+	// range; PixelRows reads them.
+	template <typename View>
+	class Rows
+	{
+		View view;
+		int count;
+
+	public:
+		typedef typename std::remove_pointer<decltype(std::declval<View>().row(0))>::type Pixel;
+
+		class iterator
+		{
+			const View* view;
+			int y;
+
+		public:
+			iterator(const View* view, int y) : view(view), y(y) {}
+
+			RowSpan<Pixel> operator*() const { return{ y, view->row(y), view->width() }; }
+			iterator& operator++() { ++y; return *this; }
+			bool operator==(const iterator& oth) const { return y == oth.y; }
+			bool operator!=(const iterator& oth) const { return y != oth.y; }
+		};
+
+		explicit Rows(const View& view)
+			: view(view)
+			, count(view && view.trueColor() ? view.height() : 0)
+		{
+		}
+
+		iterator begin() const { return{ &view, 0 }; }
+		iterator end() const { return{ &view, count }; }
+	};
+
+	template <typename View>
+	Rows<View> rows(const View& view) { return Rows<View>{ view }; }
+
+	// tileWidth x tileHeight sub-views in raster order; the ones along
+	// the right and bottom edges are clipped to the view
+	template <typename View>
+	class Tiles
+	{
+		View view;
+		int tileWidth;
+		int tileHeight;
+
+	public:
+		class iterator
+		{
+			const Tiles* tiles;
+			int index;
+
+		public:
+			iterator(const Tiles* tiles, int index) : tiles(tiles), index(index) {}
+
+			View operator*() const { return tiles->at(index); }
+			iterator& operator++() { ++index; return *this; }
+			bool operator==(const iterator& oth) const { return index == oth.index; }
+			bool operator!=(const iterator& oth) const { return index != oth.index; }
+		};
+
+		Tiles(const View& view, int tileWidth, int tileHeight)
+			: view(view)
+			, tileWidth(tileWidth > 0 ? tileWidth : 1)
+			, tileHeight(tileHeight > 0 ? tileHeight : 1)
+		{
+		}
+
+		int columns() const { return (view.width() + tileWidth - 1) / tileWidth; }
+		int tileRows() const { return (view.height() + tileHeight - 1) / tileHeight; }
+		int size() const { return view ? columns() * tileRows() : 0; }
+
+		View at(int index) const
+		{
+			auto column = index % columns();
+			auto row = index / columns();
+			return view.sub({ column * tileWidth, row * tileHeight, tileWidth, tileHeight });
+		}
+
+		iterator begin() const { return{ this, 0 }; }
+		iterator end() const { return{ this, size() }; }
+	};
+
+	template <typename View>
+	Tiles<View> tiles(const View& view, int tileWidth, int tileHeight) { return Tiles<View>{ view, tileWidth, tileHeight }; }
+
+	// fn(x, y, pixel) for every pixel of the view, in view coordinates.
+	// Under Parallel fn is called from several threads at once.
+	template <typename Fn>
+	void forEachPixel(const ImageView& view, Execution policy, Fn fn)
+	{
+		if (!view)
+			return;
+
+		auto width = view.width();
+		forEachBand(view.height(), width, policy, [&](int begin, int end)
+		{
+			PixelRows pixels{ view };
+			for (int y = begin; y < end; ++y)
+			{
+				auto row = pixels.row(y);
+				for (int x = 0; x < width; ++x)
+					fn(x, y, row[x]);
+			}
+		});
+	}
+
+	// pixel = fn(pixel) over the view. fn should be a plain color
+	// mapping: palette images have their palette entries mapped
+	// instead, leaving the transparent index alone.
+	template <typename Fn>
+	void transform(const MutableImageView& view, Execution policy, Fn fn)
+	{
+		if (!view)
+			return;
+
+		if (!view.trueColor())
+		{
+			auto img = view.image();
+			for (int c = 0; c < img->colorsTotal; ++c)
+			{
+				if (c == img->transparent)
+					continue;
+				int px = fn(gdTrueColorAlpha(img->red[c], img->green[c], img->blue[c], img->alpha[c]));
+				img->red[c] = gdTrueColorGetRed(px);
+				img->green[c] = gdTrueColorGetGreen(px);
+				img->blue[c] = gdTrueColorGetBlue(px);
+				img->alpha[c] = gdTrueColorGetAlpha(px);
+			}
+			return;
+		}
+
+		auto width = view.width();
+		forEachBand(view.height(), width, policy, [&](int begin, int end)
+		{
+			for (int y = begin; y < end; ++y)
+			{
+				auto row = view.row(y);
+				if (policy == Execution::Sequential)
+				{
+					for (int x = 0; x < width; ++x)
+						row[x] = fn(row[x]);
+					continue;
+				}
+
+				GDEX_IVDEP
+				for (int x = 0; x < width; ++x)
+					row[x] = fn(row[x]);
+			}
+		});
+	}
+
+	// combine(...combine(combine(init, map(p0)), map(p1))..., map(pn)).
+	// Parallel bands each start from init and are combined in band
+	// order, so init must be neutral and combine associative. Cancelled,
+	// it returns init, rather than what the bands that ran add up to.
+	template <typename T, typename Map, typename Combine>
+	T reduce(const ImageView& view, Execution policy, T init, Map map, Combine combine)
+	{
+		if (!view)
+			return init;
+
+		std::mutex lock;
+		std::vector<std::pair<int, T>> partials;
+		auto width = view.width();
+		forEachBand(view.height(), width, policy, [&](int begin, int end)
+		{
+			T acc = init;
+			PixelRows pixels{ view };
+			for (int y = begin; y < end; ++y)
+			{
+				auto row = pixels.row(y);
+				for (int x = 0; x < width; ++x)
+					acc = combine(acc, map(row[x]));
+			}
+
+			std::lock_guard<std::mutex> guard{ lock };
+			partials.push_back(std::make_pair(begin, acc));
+		});
+
+		if (cancelled())
+			return init;
+		if (partials.size() == 1)
+			return partials[0].second;
+
+		std::sort(partials.begin(), partials.end(), [](const std::pair<int, T>& lhs, const std::pair<int, T>& rhs) {
+			return lhs.first < rhs.first;
+		});
+		T result = init;
+		for (auto& partial : partials)
+			result = combine(result, partial.second);
+		return result;
+	}
+
+	// fn(tile) over tiles(view, tileWidth, tileHeight); Parallel hands
+	// whole rows of tiles to the threads
+	template <typename View, typename Fn>
+	void forEachTile(const View& view, int tileWidth, int tileHeight, Execution policy, Fn fn)
+	{
+		Tiles<View> grid{ view, tileWidth, tileHeight };
+		if (!grid.size())
+			return;
+
+		auto columns = grid.columns();
+		forEachBand(grid.tileRows(), (size_t)view.width() * std::max(tileHeight, 1), policy, [&](int begin, int end)
+		{
+			for (int index = begin * columns; index < end * columns; ++index)
+				fn(grid.at(index));
+		});
+	}
+}
+
+#endif // __GDEX_ALGORITHM_HPP__
@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __GDEX_ASYNC_HPP__
+#define __GDEX_ASYNC_HPP__
+
+#include <gdex.hpp>
+#include <functional>
+#include <future>
+#include <memory>
+
+// Awaitables need C++20 coroutines; define GDEX_COROUTINES to 0 to
+// leave them out anyway
+#if !defined(GDEX_COROUTINES) && defined(__cpp_impl_coroutine)
+#define GDEX_COROUTINES 1
+#endif
+
+#if GDEX_COROUTINES
+#include <coroutine>
+#include <optional>
+#endif
+
+namespace gd
+{
+	// Empty image when the file could not be read or decoded, where
+	// loadImage would return nullptr
+	typedef std::function<void(GdImage)> ImageCallback;
+	// Empty buffer when the encoder failed
+	typedef std::function<void(std::vector<unsigned char>)> BytesCallback;
+
+	// File reads run on the pool's I/O threads, decoding, resampling and
+	// encoding on its workers, in the caller's workPriority() lane. done
+	// is called on whichever thread finished the last stage. With no
+	// workers configured the CPU stages borrow an I/O thread, so none of
+	// these ever runs on the caller. Loads and decodes reserve their
+	// memory on the I/O threads, before any worker takes them on.
+	BGDEX_DECLARE_CC(void) loadImageAsync(const std::string& path, const LoadOptions& options, const ImageCallback& done);
+	BGDEX_DECLARE_CC(void) decodeImageAsync(std::vector<unsigned char> data, const LoadOptions& options, const ImageCallback& done);
+	// Takes src over; done gets it back resampled, or an empty image
+	// when the resample failed or was cancelled
+	BGDEX_DECLARE_CC(void) resampleAsync(GdImage&& src, int w, int h, const ResampleOptions& options, const ImageCallback& done);
+	// Takes img over and frees it before done is called
+	BGDEX_DECLARE_CC(void) encodeImageAsync(GdImage&& img, const EncodeOptions& options, const BytesCallback& done);
+
+	template <typename T>
+	std::function<void(T)> fulfil(const std::shared_ptr<std::promise<T>>& promise)
+	{
+		return [promise](T value) { promise->set_value(std::move(value)); };
+	}
+
+	inline std::future<GdImage> loadImageAsync(const std::string& path, const LoadOptions& options = LoadOptions())
+	{
+		auto promise = std::make_shared<std::promise<GdImage>>();
+		auto result = promise->get_future();
+		loadImageAsync(path, options, fulfil(promise));
+		return result;
+	}
+
+	inline std::future<GdImage> decodeImageAsync(std::vector<unsigned char> data, const LoadOptions& options = LoadOptions())
+	{
+		auto promise = std::make_shared<std::promise<GdImage>>();
+		auto result = promise->get_future();
+		decodeImageAsync(std::move(data), options, fulfil(promise));
+		return result;
+	}
+
+	inline std::future<GdImage> resampleAsync(GdImage&& src, int w, int h, const ResampleOptions& options = ResampleOptions())
+	{
+		auto promise = std::make_shared<std::promise<GdImage>>();
+		auto result = promise->get_future();
+		resampleAsync(std::move(src), w, h, options, fulfil(promise));
+		return result;
+	}
+
+	inline std::future<std::vector<unsigned char>> encodeImageAsync(GdImage&& img, const EncodeOptions& options = EncodeOptions())
+	{
+		auto promise = std::make_shared<std::promise<std::vector<unsigned char>>>();
+		auto result = promise->get_future();
+		encodeImageAsync(std::move(img), options, fulfil(promise));
+		return result;
+	}
+
+#if GDEX_COROUTINES
+	// co_await gd::coro::loadImage(path) and friends; the coroutine
+	// resumes on the thread that finished the work, as done would run
+	namespace coro
+	{
+		template <typename T>
+		class Awaitable
+		{
+		public:
+			typedef std::function<void(const std::function<void(T)>&)> Start;
+
+			explicit Awaitable(Start start) : start(std::move(start)) {}
+
+			bool await_ready() const noexcept { return false; }
+
+			void await_suspend(std::coroutine_handle<> handle)
+			{
+				// the coroutine may be resumed, and this awaiter gone,
+				// before begin returns
+				auto begin = std::move(start);
+				begin([this, handle](T value) {
+					result.emplace(std::move(value));
+					handle.resume();
+				});
+			}
+
+			T await_resume() { return std::move(*result); }
+
+		private:
+			Start start;
+			std::optional<T> result;
+		};
+
+		inline Awaitable<GdImage> loadImage(std::string path, LoadOptions options = LoadOptions())
+		{
+			return Awaitable<GdImage>{ [=](const ImageCallback& done) { loadImageAsync(path, options, done); } };
+		}
+
+		inline Awaitable<GdImage> decodeImage(std::vector<unsigned char> data, LoadOptions options = LoadOptions())
+		{
+			auto bytes = std::make_shared<std::vector<unsigned char>>(std::move(data));
+			return Awaitable<GdImage>{ [=](const ImageCallback& done) { decodeImageAsync(std::move(*bytes), options, done); } };
+		}
+
+		inline Awaitable<GdImage> resample(GdImage&& src, int w, int h, ResampleOptions options = ResampleOptions())
+		{
+			auto image = std::make_shared<GdImage>(std::move(src));
+			return Awaitable<GdImage>{ [=](const ImageCallback& done) { resampleAsync(std::move(*image), w, h, options, done); } };
+		}
+
+		inline Awaitable<std::vector<unsigned char>> encodeImage(GdImage&& img, EncodeOptions options = EncodeOptions())
+		{
+			auto image = std::make_shared<GdImage>(std::move(img));
+			return Awaitable<std::vector<unsigned char>>{ [=](const BytesCallback& done) { encodeImageAsync(std::move(*image), options, done); } };
+		}
+	}
+#endif
+}
+
+#endif // __GDEX_ASYNC_HPP__
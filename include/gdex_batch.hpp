@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __GDEX_BATCH_HPP__
+#define __GDEX_BATCH_HPP__
+
+#include <gdex.hpp>
+#include <functional>
+
+namespace gd
+{
+	// One image to process: the file at path, or data itself when path
+	// is empty
+	struct BatchInput
+	{
+		std::string path;
+		std::vector<unsigned char> data;
+
+		BatchInput() {}
+		explicit BatchInput(const std::string& path) : path(path) {}
+		explicit BatchInput(std::vector<unsigned char> data) : data(std::move(data)) {}
+	};
+
+	struct BatchResult
+	{
+		// position of the input, counting from 0
+		size_t index;
+		// false, with data empty, if reading, decoding, transforming or
+		// encoding failed
+		bool ok;
+		std::vector<unsigned char> data;
+	};
+
+	struct BatchOptions
+	{
+		// Threads per stage; negative means one per core. Readers only
+		// wait on the disk, the rest only on the CPU.
+		int readers;
+		int decoders;
+		int transformers;
+		int encoders;
+		// capacity of each queue between two stages
+		int queueDepth;
+		// Hand results over in input order, holding back the ones that
+		// overtook an earlier input; otherwise as they complete
+		bool ordered;
+		// lane of the parallel kernels the stages call into
+		Priority priority;
+		LoadOptions load;
+		EncodeOptions encode;
+
+		BatchOptions()
+			: readers(2)
+			, decoders(-1)
+			, transformers(-1)
+			, encoders(-1)
+			, queueDepth(16)
+			, ordered(false)
+			, priority(Priority::Bulk)
+		{
+		}
+	};
+
+	// Fills in the next input, false once there are none left
+	typedef std::function<bool(BatchInput&)> BatchSource;
+	typedef std::function<void(GdImage&)> BatchTransform;
+	typedef std::function<void(BatchResult)> BatchSink;
+
+	// Reads, decodes, transforms and encodes every input source gives,
+	// each stage on threads of its own, handing images to the next one
+	// through a bounded lock-free queue, so a stage that falls behind
+	// holds up the ones feeding it rather than piling up images. source
+	// and sink are called from one thread at a time; transform may be
+	// empty. Returns the number of inputs, once sink has seen them all.
+	// Under a memory budget, readers reserve the file and its pixels
+	// before reading it, and an input the budget rejects fails.
+	// Under a cancelToken(), no input is taken once it is cancelled and
+	// the ones in flight are reported as failed. An exception, from
+	// transform or out of memory, fails the one input it came up on;
+	// one from source ends the input there, and sink's are swallowed.
+	BGDEX_DECLARE_CC(size_t) processBatch(const BatchSource& source, const BatchTransform& transform, const BatchSink& sink, const BatchOptions& options = BatchOptions());
+
+	inline size_t processBatch(const std::vector<std::string>& paths, const BatchTransform& transform, const BatchSink& sink, const BatchOptions& options = BatchOptions())
+	{
+		size_t next = 0;
+		return processBatch([&](BatchInput& input) {
+			if (next == paths.size())
+				return false;
+			input.path = paths[next++];
+			return true;
+		}, transform, sink, options);
+	}
+}
+
+#endif // __GDEX_BATCH_HPP__
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __GDEX_CANCEL_HPP__
+#define __GDEX_CANCEL_HPP__
+
+#include <gd.h>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <memory>
+
+namespace gd
+{
+	// Lets a caller give up on gdex work it started. Copies share one
+	// flag; raising it, or letting the deadline pass, cancels the work
+	// running under any of them.
+	class CancelToken
+	{
+	public:
+		typedef std::chrono::steady_clock Clock;
+
+		CancelToken() : state(std::make_shared<State>()) {}
+
+		static CancelToken after(Clock::duration timeout)
+		{
+			CancelToken token;
+			token.setDeadline(Clock::now() + timeout);
+			return token;
+		}
+
+		void cancel() const { state->raised = true; }
+		void setDeadline(Clock::time_point when) const { state->deadline = when.time_since_epoch().count(); }
+
+		bool cancelled() const
+		{
+			if (state->raised)
+				return true;
+
+			auto deadline = state->deadline.load();
+			if (deadline == (std::numeric_limits<Clock::rep>::max)() || Clock::now().time_since_epoch().count() < deadline)
+				return false;
+
+			// later checks skip the clock
+			state->raised = true;
+			return true;
+		}
+
+	private:
+		struct State
+		{
+			std::atomic<bool> raised;
+			// Clock ticks; max() for none
+			std::atomic<Clock::rep> deadline;
+
+			State() : raised(false), deadline((std::numeric_limits<Clock::rep>::max)()) {}
+		};
+
+		std::shared_ptr<State> state;
+	};
+
+	// Token of the work running on this thread, nullptr if none. Like
+	// the priority, it travels with everything the work hands to the
+	// pool. Kernels check it between bands of rows and stop early,
+	// leaving in-place edits half done and returning nullptr instead of
+	// new images; decoders see reads fail.
+	BGDEX_DECLARE_CC(const CancelToken*) cancelToken();
+	// token has to outlive its use; CancelScope takes care of that
+	BGDEX_DECLARE_CC(void) setCancelToken(const CancelToken* token);
+
+	// Whether this thread's work was cancelled
+	inline bool cancelled()
+	{
+		auto token = cancelToken();
+		return token && token->cancelled();
+	}
+
+	class CancelScope
+	{
+		CancelToken token;
+		const CancelToken* saved;
+
+	public:
+		explicit CancelScope(const CancelToken& token) : token(token), saved(cancelToken()) { setCancelToken(&this->token); }
+		~CancelScope() { setCancelToken(saved); }
+		CancelScope(const CancelScope&) = delete;
+		CancelScope& operator=(const CancelScope&) = delete;
+	};
+
+	// Reads and writes through inner until token is cancelled, failing
+	// from then on, which makes libgd's decoders and encoders give up.
+	// inner is not freed with the returned context.
+	BGDEX_DECLARE_CC(gdIOCtx*) newCancellableCtx(gdIOCtx* inner, const CancelToken& token);
+}
+
+#endif // __GDEX_CANCEL_HPP__
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __GDEX_MEMORY_HPP__
+#define __GDEX_MEMORY_HPP__
+
+#include <gd.h>
+#include <stddef.h>
+
+namespace gd
+{
+	// What reserveMemory does when the budget has no room
+	enum class Admission
+	{
+		Wait,  // block until enough is released
+		Reject // fail right away
+	};
+
+	struct MemoryBudget
+	{
+		// Bytes loadImage may have reserved at any time, for file
+		// buffers and decoded pixels; 0 leaves memory unaccounted
+		size_t bytes;
+		Admission whenFull;
+
+		MemoryBudget() : bytes(0), whenFull(Admission::Wait) {}
+		explicit MemoryBudget(size_t bytes, Admission whenFull = Admission::Wait) : bytes(bytes), whenFull(whenFull) {}
+	};
+
+	// Takes effect for the next reservation; what is reserved already
+	// stays counted, waiters look again
+	BGDEX_DECLARE_CC(void) configureMemoryBudget(const MemoryBudget& budget);
+	BGDEX_DECLARE_CC(size_t) memoryInUse();
+
+	// Counts bytes against the budget, waiting for room if configured
+	// to. False if rejected, which a request larger than the whole
+	// budget always is. counted tells whether release or charge must
+	// follow; nothing is counted without a budget. Workers of the
+	// shared pool never wait, as the memory they would wait for may be
+	// freed by tasks queued behind them: there Wait acts as Reject.
+	// The asynchronous loaders reserve on their I/O threads instead.
+	BGDEX_DECLARE_CC(bool) reserveMemory(size_t bytes, bool& counted);
+	BGDEX_DECLARE_CC(void) releaseMemory(size_t bytes);
+	// Turns a reservation into a charge on img, adjusted to what img
+	// really takes, until destroyImage(img). Charges are looked up by
+	// address: one still there for img belonged to an image freed with
+	// gdImageDestroy, and is dropped, asserting in debug builds.
+	BGDEX_DECLARE_CC(void) chargeImage(const gdImage* img, size_t reserved);
+	// gdImageDestroy, after releasing what was charged to img.
+	//
+	// MIGRATING: once a budget is configured, every image loadImage
+	// returns must be freed with this, or owned by a GdImage. One freed
+	// with plain gdImageDestroy keeps its bytes counted for good, and
+	// the budget shrinks by that much.
+	BGDEX_DECLARE_CC(void) destroyImage(gdImagePtr img);
+	// Bytes of img's pixels and row table
+	BGDEX_DECLARE_CC(size_t) imageFootprint(const gdImage* img);
+
+	class MemoryReservation
+	{
+		size_t bytes;
+		bool granted;
+		bool counted;
+
+	public:
+		// nothing held yet, for reserve to fill in
+		MemoryReservation()
+			: bytes(0)
+			, granted(true)
+			, counted(false)
+		{
+		}
+
+		explicit MemoryReservation(size_t bytes)
+			: bytes(bytes)
+			, granted(false)
+			, counted(false)
+		{
+			granted = reserveMemory(bytes, counted);
+		}
+		~MemoryReservation() { reset(); }
+		MemoryReservation(const MemoryReservation&) = delete;
+		MemoryReservation& operator=(const MemoryReservation&) = delete;
+
+		explicit operator bool() const { return granted; }
+
+		// Gives back what is held and reserves bytes instead
+		bool reserve(size_t bytes)
+		{
+			reset();
+			this->bytes = bytes;
+			granted = reserveMemory(bytes, counted);
+			return granted;
+		}
+
+		// Hands what is reserved over to img
+		void charge(const gdImage* img)
+		{
+			if (counted && img)
+				chargeImage(img, bytes);
+			else
+				reset();
+			counted = false;
+			bytes = 0;
+		}
+
+		void reset()
+		{
+			if (counted)
+				releaseMemory(bytes);
+			counted = false;
+			bytes = 0;
+		}
+	};
+}
+
+#endif // __GDEX_MEMORY_HPP__
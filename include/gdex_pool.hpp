@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __GDEX_POOL_HPP__
+#define __GDEX_POOL_HPP__
+
+#include <functional>
+
+namespace gd
+{
+	// Lanes of the shared worker pool. Workers take every queued
+	// interactive task before any bulk one; a running task is never
+	// interrupted.
+	enum class Priority
+	{
+		Interactive,
+		Bulk
+	};
+
+	struct PoolOptions
+	{
+		// Worker threads; threads calling into parallel kernels work
+		// alongside them. Negative means one per core the process may
+		// run on, less the caller.
+		int threads;
+		// Ties worker i to the i-th core of the process affinity mask,
+		// modulo the number of them
+		bool pinned;
+		// Threads blocking on file reads for the asynchronous API, so
+		// the workers above only ever wait for the CPU; at least one
+		int ioThreads;
+
+		PoolOptions() : threads(-1), pinned(false), ioThreads(2) {}
+	};
+
+	// Resizes the pool every parallel kernel runs on, and the I/O
+	// threads next to it. Queued work is finished by the old threads
+	// first; the new ones start on demand. Returns false, changing
+	// nothing, when called from a pool or I/O thread, as it would have
+	// to wait for that thread to leave.
+	BGDEX_DECLARE_CC(bool) configurePool(const PoolOptions& options);
+	BGDEX_DECLARE_CC(int) poolThreads();
+
+	// Runs task on a pool worker, or right away on this thread when the
+	// pool has no workers. Kernels the task calls inherit its priority.
+	BGDEX_DECLARE_CC(void) post(Priority priority, const std::function<void()>& task);
+
+	// Priority for the parallel work started from this thread;
+	// Interactive unless set, pool workers use their task's
+	BGDEX_DECLARE_CC(Priority) workPriority();
+	BGDEX_DECLARE_CC(void) setWorkPriority(Priority priority);
+
+	class PriorityScope
+	{
+		Priority saved;
+
+	public:
+		explicit PriorityScope(Priority priority) : saved(workPriority()) { setWorkPriority(priority); }
+		~PriorityScope() { setWorkPriority(saved); }
+		PriorityScope(const PriorityScope&) = delete;
+		PriorityScope& operator=(const PriorityScope&) = delete;
+	};
+}
+
+#endif // __GDEX_POOL_HPP__
@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __GDEX_VIEW_HPP__
+#define __GDEX_VIEW_HPP__
+
+#include <gd.h>
+#include <algorithm> // std::max, std::min
+
+namespace gd
+{
+	enum class PixelFormat
+	{
+		Palette,  // one byte per pixel, index into the image palette
+		TrueColor // one int per pixel, gd's 7-bit alpha ARGB
+	};
+
+	struct Rect
+	{
+		int x;
+		int y;
+		int width;
+		int height;
+
+		bool empty() const { return width <= 0 || height <= 0; }
+		int right() const { return x + width; }
+		int bottom() const { return y + height; }
+
+		Rect intersect(const Rect& oth) const
+		{
+			auto left = std::max(x, oth.x);
+			auto top = std::max(y, oth.y);
+			auto w = std::min(right(), oth.right()) - left;
+			auto h = std::min(bottom(), oth.bottom()) - top;
+			if (w <= 0 || h <= 0)
+				return{ left, top, 0, 0 };
+			return{ left, top, w, h };
+		}
+	};
+
+	// Non-owning window into gdImage rows. Kernels read through row()
+	// or indexRow(), which already apply the crop offset; the view is
+	// only valid for as long as the image it was taken from.
+	class ImageView
+	{
+	protected:
+		gdImagePtr img;
+		void* const* rows;
+		Rect area;
+
+		ImageView(gdImagePtr img, const Rect& crop, bool)
+			: img(img)
+			, rows(nullptr)
+			, area{ 0, 0, 0, 0 }
+		{
+			if (!img)
+				return;
+
+			rows = img->trueColor
+				? reinterpret_cast<void* const*>(img->tpixels)
+				: reinterpret_cast<void* const*>(img->pixels);
+			area = crop.intersect({ 0, 0, img->sx, img->sy });
+		}
+
+	public:
+		ImageView() : img(nullptr), rows(nullptr), area{ 0, 0, 0, 0 } {}
+		explicit ImageView(const gdImage* img)
+			: ImageView(const_cast<gdImagePtr>(img), { 0, 0, img ? img->sx : 0, img ? img->sy : 0 }, true)
+		{
+		}
+		ImageView(const gdImage* img, const Rect& crop)
+			: ImageView(const_cast<gdImagePtr>(img), crop, true)
+		{
+		}
+
+		explicit operator bool() const { return img != nullptr && !area.empty(); }
+		const gdImage* image() const { return img; }
+
+		int width() const { return area.width; }
+		int height() const { return area.height; }
+		const Rect& crop() const { return area; }
+		PixelFormat format() const { return img->trueColor ? PixelFormat::TrueColor : PixelFormat::Palette; }
+		bool trueColor() const { return img->trueColor != 0; }
+
+		// valid for PixelFormat::TrueColor
+		const int* row(int y) const { return static_cast<const int*>(rows[area.y + y]) + area.x; }
+		// valid for PixelFormat::Palette
+		const unsigned char* indexRow(int y) const { return static_cast<const unsigned char*>(rows[area.y + y]) + area.x; }
+
+		// Pixel in gd's truecolor format, regardless of the view format
+		int pixel(int x, int y) const
+		{
+			if (img->trueColor)
+				return row(y)[x];
+
+			int c = indexRow(y)[x];
+			return gdTrueColorAlpha(img->red[c], img->green[c], img->blue[c], img->alpha[c]);
+		}
+
+		// crop is relative to this view and gets clipped to it
+		ImageView sub(const Rect& crop) const
+		{
+			return ImageView{ img, clipped(crop), true };
+		}
+
+	protected:
+		Rect clipped(const Rect& crop) const
+		{
+			Rect abs{ area.x + crop.x, area.y + crop.y, crop.width, crop.height };
+			return abs.intersect(area);
+		}
+	};
+
+	class MutableImageView : public ImageView
+	{
+		MutableImageView(gdImagePtr img, const Rect& crop, bool)
+			: ImageView(img, crop, true)
+		{
+		}
+	public:
+		MutableImageView() {}
+		explicit MutableImageView(gdImagePtr img)
+			: ImageView(img, { 0, 0, img ? img->sx : 0, img ? img->sy : 0 }, true)
+		{
+		}
+		MutableImageView(gdImagePtr img, const Rect& crop)
+			: ImageView(img, crop, true)
+		{
+		}
+
+		gdImagePtr image() const { return img; }
+
+		int* row(int y) const { return static_cast<int*>(rows[area.y + y]) + area.x; }
+		unsigned char* indexRow(int y) const { return static_cast<unsigned char*>(rows[area.y + y]) + area.x; }
+
+		MutableImageView sub(const Rect& crop) const
+		{
+			return MutableImageView{ img, clipped(crop), true };
+		}
+	};
+};
+
+#endif // __GDEX_VIEW_HPP__
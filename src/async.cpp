@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "gdex_async.hpp"
+#include "pixels/pool.hpp"
+
+namespace gd
+{
+	namespace
+	{
+		typedef std::shared_ptr<std::vector<unsigned char>> Bytes;
+		typedef std::shared_ptr<MemoryReservation> Reservation;
+
+		// The CPU stages; the caller is often an event loop, so with no
+		// workers to take them they queue behind the reads instead of
+		// running inline. Stages following a read on an I/O thread go
+		// on right there: queued, they would hold their reservation
+		// while the I/O threads wait for memory ahead of them.
+		void compute(pixels::WorkPool::Task task)
+		{
+			auto priority = workPriority();
+			auto& workers = pixels::WorkPool::shared();
+			if (workers.size())
+				workers.submit(std::move(task), priority);
+			else if (pixels::onIoThread())
+				task();
+			else
+				pixels::IoQueue::shared().submit(std::move(task), priority);
+		}
+
+		// Memory is reserved ahead of the decode, on the I/O threads,
+		// which may wait for it; pool workers must not
+		void decode(const Bytes& data, const LoadOptions& options, const Reservation& reserved, const ImageCallback& done)
+		{
+			Opacity opacity = Opacity::Unknown;
+			gdImagePtr img = nullptr;
+			if (!data->empty())
+				img = loadImage((int)data->size(), data->data(), options, opacity, *reserved);
+
+			// the file buffer is not needed past the decoder
+			std::vector<unsigned char>().swap(*data);
+			done(GdImage{ img, opacity });
+		}
+	}
+
+	BGDEX_DECLARE_CC(void) loadImageAsync(const std::string& path, const LoadOptions& options, const ImageCallback& done)
+	{
+		pixels::IoQueue::shared().submit([=] {
+			// the file and its pixels are reserved before the read, as
+			// loadImage(path) does, and the decode inherits it
+			auto data = std::make_shared<std::vector<unsigned char>>();
+			auto reserved = std::make_shared<MemoryReservation>();
+			if (!readFile(path, *data, options, *reserved))
+			{
+				done(GdImage{ nullptr });
+				return;
+			}
+			compute([=] { decode(data, options, reserved, done); });
+		}, workPriority());
+	}
+
+	BGDEX_DECLARE_CC(void) decodeImageAsync(std::vector<unsigned char> data, const LoadOptions& options, const ImageCallback& done)
+	{
+		auto bytes = std::make_shared<std::vector<unsigned char>>(std::move(data));
+		pixels::IoQueue::shared().submit([=] {
+			auto reserved = std::make_shared<MemoryReservation>();
+			if (!reserved->reserve(decodedSize(bytes->data(), bytes->size(), options)))
+			{
+				done(GdImage{ nullptr });
+				return;
+			}
+			compute([=] { decode(bytes, options, reserved, done); });
+		}, workPriority());
+	}
+
+	BGDEX_DECLARE_CC(void) resampleAsync(GdImage&& src, int w, int h, const ResampleOptions& options, const ImageCallback& done)
+	{
+		auto image = std::make_shared<GdImage>(std::move(src));
+		compute([=] {
+			if (*image && !image->resample(w, h, options))
+				image->reset(nullptr);
+			done(std::move(*image));
+		});
+	}
+
+	BGDEX_DECLARE_CC(void) encodeImageAsync(GdImage&& img, const EncodeOptions& options, const BytesCallback& done)
+	{
+		auto image = std::make_shared<GdImage>(std::move(img));
+		compute([=] {
+			std::vector<unsigned char> out;
+			if (*image)
+				encodeImage(image->view().image(), options, out);
+			image->reset(nullptr);
+			done(std::move(out));
+		});
+	}
+}
@@ -0,0 +1,356 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "gdex_batch.hpp"
+#include "pixels/queue.hpp"
+#include <mutex>
+#include <thread>
+
+namespace gd
+{
+	namespace
+	{
+		struct Item
+		{
+			size_t index;
+			bool failed;
+			std::string path;
+			std::vector<unsigned char> bytes;
+			// the file and its pixels, from before reading until decoded
+			MemoryReservation reserved;
+			std::unique_ptr<GdImage> image;
+
+			explicit Item(size_t index) : index(index), failed(false) {}
+		};
+
+		typedef std::unique_ptr<Item> ItemPtr;
+		typedef pixels::BoundedQueue<ItemPtr> Queue;
+
+		int stageThreads(int requested)
+		{
+			if (requested < 0)
+				return (int)std::max(1u, std::thread::hardware_concurrency());
+			return std::max(1, requested);
+		}
+
+		void push(Queue& queue, ItemPtr& item)
+		{
+			pixels::Backoff backoff;
+			while (!queue.tryPush(item))
+				backoff.wait();
+		}
+
+		class Pipeline
+		{
+			const BatchSource& source;
+			const BatchTransform& transform;
+			const BatchSink& sink;
+			const BatchOptions& options;
+
+			Queue decodeQueue;
+			Queue transformQueue;
+			Queue encodeQueue;
+			// threads of each stage still running; a stage is finished
+			// with its queue once the one feeding it is down to 0 and
+			// the queue is empty
+			std::atomic<int> reading;
+			std::atomic<int> decoding;
+			std::atomic<int> transforming;
+
+			std::mutex sourceLock;
+			size_t issued;
+			bool exhausted;
+
+			struct Slot
+			{
+				bool ready;
+				BatchResult result;
+			};
+
+			std::mutex sinkLock;
+			// Results that overtook an earlier input, when ordered, at
+			// index % window. Never more than window apart, so they are
+			// all set up front and delivering allocates nothing.
+			std::vector<Slot> held;
+			size_t nextOut;
+			std::atomic<size_t> delivered;
+			// Inputs read but not handed to sink. Reordering holds results
+			// back, so in ordered mode readers stop short of this many.
+			size_t window;
+
+		public:
+			Pipeline(const BatchSource& source, const BatchTransform& transform, const BatchSink& sink, const BatchOptions& options)
+				: source(source)
+				, transform(transform)
+				, sink(sink)
+				, options(options)
+				, decodeQueue(std::max(1, options.queueDepth))
+				, transformQueue(std::max(1, options.queueDepth))
+				, encodeQueue(std::max(1, options.queueDepth))
+				, reading(0)
+				, decoding(0)
+				, transforming(0)
+				, issued(0)
+				, exhausted(false)
+				, nextOut(0)
+				, delivered(0)
+				, window(0)
+			{
+			}
+
+			size_t run()
+			{
+				int readers = stageThreads(options.readers);
+				int decoders = stageThreads(options.decoders);
+				int transformers = transform ? stageThreads(options.transformers) : 0;
+				int encoders = stageThreads(options.encoders);
+
+				window = 4 * (size_t)std::max(1, options.queueDepth) + readers + decoders + transformers + encoders;
+				if (options.ordered)
+					held.resize(window);
+				reading = readers;
+				decoding = decoders;
+				transforming = transformers;
+
+				// the stages work under the caller's token, if any; the
+				// caller waits for them, so the pointer stays good
+				auto token = cancelToken();
+				std::vector<std::thread> threads;
+				auto start = [&](int count, void (Pipeline::*stage)()) {
+					for (int i = 0; i < count; ++i)
+					{
+						threads.emplace_back([this, stage, token] {
+							PriorityScope lane{ options.priority };
+							setCancelToken(token);
+							(this->*stage)();
+						});
+					}
+				};
+				start(readers, &Pipeline::read);
+				start(decoders, &Pipeline::decode);
+				start(transformers, &Pipeline::transformImages);
+				start(encoders, &Pipeline::encode);
+
+				for (auto& thread : threads)
+					thread.join();
+				return issued;
+			}
+
+		private:
+			ItemPtr next()
+			{
+				pixels::Backoff backoff;
+				for (;;)
+				{
+					{
+						std::lock_guard<std::mutex> guard{ sourceLock };
+						// once cancelled, what is in flight fails fast
+						// and nothing more is taken in
+						if (exhausted || cancelled())
+							return nullptr;
+
+						if (!options.ordered || issued - delivered < window)
+						{
+							ItemPtr item;
+							try
+							{
+								item.reset(new Item{ issued });
+								BatchInput input;
+								if (!source(input))
+								{
+									exhausted = true;
+									return nullptr;
+								}
+								item->path = std::move(input.path);
+								item->bytes = std::move(input.data);
+							}
+							catch (...)
+							{
+								// a throwing source has nothing more to
+								// give; its input fails, the ones already
+								// taken go on
+								exhausted = true;
+								if (!item)
+									return nullptr;
+								item->failed = true;
+							}
+							++issued;
+							return item;
+						}
+					}
+					backoff.wait();
+				}
+			}
+
+			// Runs work on everything in queue until the stage before is
+			// done, then leaves, handing each item to done. Whatever work
+			// throws fails just that item: let out of the stage thread,
+			// it would end the process.
+			template <typename Work, typename Done>
+			void drain(Queue& queue, std::atomic<int>& upstream, Work work, Done done)
+			{
+				pixels::Backoff backoff;
+				for (;;)
+				{
+					ItemPtr item;
+					if (!queue.tryPop(item))
+					{
+						// nothing more gets pushed once upstream is 0, but
+						// something may have been just before
+						if (upstream != 0)
+						{
+							backoff.wait();
+							continue;
+						}
+						if (!queue.tryPop(item))
+							return;
+					}
+
+					backoff.reset();
+					try
+					{
+						work(*item);
+					}
+					catch (...)
+					{
+						item->failed = true;
+					}
+					done(item);
+				}
+			}
+
+			void read()
+			{
+				while (auto item = next())
+				{
+					try
+					{
+						// in the reader, whose threads may wait for room,
+						// before there is anything to hold on to
+						bool ok = item->path.empty()
+							? item->reserved.reserve(decodedSize(item->bytes.data(), item->bytes.size(), options.load))
+							: readFile(item->path, item->bytes, options.load, item->reserved);
+						if (!ok)
+							item->failed = true;
+					}
+					catch (...)
+					{
+						item->failed = true;
+					}
+					push(decodeQueue, item);
+				}
+				--reading;
+			}
+
+			void decode()
+			{
+				auto& out = transform ? transformQueue : encodeQueue;
+				drain(decodeQueue, reading, [&](Item& item) {
+					if (item.failed)
+						return;
+
+					Opacity opacity = Opacity::Unknown;
+					auto img = item.bytes.empty() ? nullptr : loadImage((int)item.bytes.size(), item.bytes.data(), options.load, opacity, item.reserved);
+					std::vector<unsigned char>().swap(item.bytes);
+					if (img)
+						item.image.reset(new GdImage{ img, opacity });
+					else
+						item.failed = true;
+				}, [&](ItemPtr& item) { push(out, item); });
+				--decoding;
+			}
+
+			void transformImages()
+			{
+				drain(transformQueue, decoding, [&](Item& item) {
+					if (!item.failed && !cancelled())
+						transform(*item.image);
+				}, [&](ItemPtr& item) { push(encodeQueue, item); });
+				--transforming;
+			}
+
+			// the encoded image goes into bytes, emptied by decode
+			void encode()
+			{
+				auto& upstream = transform ? transforming : decoding;
+				drain(encodeQueue, upstream, [&](Item& item) {
+					// a cancelled transform may have left the image as it was
+					if (item.failed || !*item.image || cancelled())
+						item.failed = true;
+					else if (!encodeImage(item.image->view().image(), options.encode, item.bytes))
+						item.failed = true;
+				}, [&](ItemPtr& item) {
+					BatchResult result = { item->index, !item->failed, std::vector<unsigned char>() };
+					if (result.ok)
+						result.data.swap(item->bytes);
+					item.reset();
+					deliver(std::move(result));
+				});
+			}
+
+			void deliver(BatchResult result)
+			{
+				std::lock_guard<std::mutex> guard{ sinkLock };
+				if (!options.ordered)
+				{
+					hand(std::move(result));
+					++delivered;
+					return;
+				}
+
+				auto& slot = held[result.index % held.size()];
+				slot.result = std::move(result);
+				slot.ready = true;
+				for (;;)
+				{
+					auto& first = held[nextOut % held.size()];
+					if (!first.ready)
+						break;
+					first.ready = false;
+					hand(std::move(first.result));
+					++nextOut;
+					++delivered;
+				}
+			}
+
+			// what sink throws is its own business; the batch goes on
+			void hand(BatchResult result)
+			{
+				try
+				{
+					sink(std::move(result));
+				}
+				catch (...)
+				{
+				}
+			}
+		};
+	}
+
+	BGDEX_DECLARE_CC(size_t) processBatch(const BatchSource& source, const BatchTransform& transform, const BatchSink& sink, const BatchOptions& options)
+	{
+		Pipeline pipeline{ source, transform, sink, options };
+		return pipeline.run();
+	}
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "gdex.hpp"
+
+namespace gd
+{
+	struct CancelContext : gdIOCtx
+	{
+		IOHandle inner;
+		CancelToken token;
+
+		static CancelContext* _this(gdIOCtx* ctx) { return static_cast<CancelContext*>(ctx); }
+		static const IOHandle& _inner(gdIOCtx* ctx) { return _this(ctx)->inner; }
+		static bool _cancelled(gdIOCtx* ctx) { return _this(ctx)->token.cancelled(); }
+
+		static void cancelPutchar(gdIOCtx* ctx, int c)
+		{
+			if (!_cancelled(ctx))
+				_inner(ctx).putC(c);
+		}
+
+		static int cancelGetchar(gdIOCtx* ctx)
+		{
+			if (_cancelled(ctx))
+				return EOF;
+			return _inner(ctx).getC();
+		}
+
+		static int cancelGetbuf(gdIOCtx* ctx, void * ptr, int size)
+		{
+			if (_cancelled(ctx))
+				return 0;
+			return _inner(ctx).getBuf(ptr, size);
+		}
+		static int cancelPutbuf(gdIOCtx* ctx, const void * ptr, int size)
+		{
+			if (_cancelled(ctx))
+				return 0;
+			return _inner(ctx).putBuf(ptr, size);
+		}
+
+		static int cancelSeek(struct gdIOCtx* ctx, const int offset)
+		{
+			if (_cancelled(ctx))
+				return 0;
+			return _inner(ctx).seek(offset);
+		}
+		static long cancelTell(struct gdIOCtx* ctx)
+		{
+			return _inner(ctx).tell();
+		}
+		static void gdFreeCancelCtx(gdIOCtx* ctx)
+		{
+			delete _this(ctx);
+		}
+
+		void vtable()
+		{
+			getC = cancelGetchar;
+			putC = cancelPutchar;
+
+			getBuf = cancelGetbuf;
+			putBuf = cancelPutbuf;
+
+			tell = cancelTell;
+			seek = cancelSeek;
+
+			gd_free = gdFreeCancelCtx;
+		}
+
+		CancelContext(gdIOCtx * inner, const CancelToken& token)
+			: inner(inner)
+			, token(token)
+		{
+			vtable();
+		}
+	};
+
+	BGDEX_DECLARE_CC(gdIOCtx*) newCancellableCtx(gdIOCtx* inner, const CancelToken& token)
+	{
+		if (!inner)
+			return nullptr;
+
+		return new (std::nothrow) CancelContext(inner, token);
+	}
+}
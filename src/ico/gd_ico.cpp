@@ -306,7 +306,8 @@ BGDEX_DECLARE(gdImagePtr) gdImageCreateFromIconCtx(gdIOCtx * ctx, int iconSize)
 	if (entry.width == iconSize && entry.height == iconSize)
 		return image.release();
 
-	image.resample(iconSize, iconSize);
+	if (!image.resample(iconSize, iconSize))
+		return nullptr;
 	return image.release();
 }
 
@@ -49,6 +49,12 @@ namespace gd
 				return resize(10240);
 			return resize(size << 1);
 		}
+		void reset()
+		{
+			free(ptr);
+			ptr = nullptr;
+			size = 0;
+		}
 		~unique_array() { free(ptr); }
 	};
 
@@ -61,56 +67,236 @@ namespace gd
 		~File() { if (f) fclose(f); }
 		explicit operator bool() const { return f != nullptr; }
 
+		// a chunk at a time, so a cancelled load stops reading
 		size_t read(char* buffer, size_t size)
 		{
-			return fread(buffer, 1, size, f);
+			static const size_t chunk = 1024 * 1024;
+
+			size_t done = 0;
+			while (done < size && !cancelled())
+			{
+				auto read = fread(buffer + done, 1, std::min(size - done, chunk), f);
+				if (!read)
+					break;
+				done += read;
+			}
+			return done;
 		}
 	};
 
-	BGDEX_DECLARE_CC(gdImagePtr) loadImage(int size, void* data)
+	namespace
 	{
+		// covers the frame header of all but JPEGs with very large
+		// metadata, which then go unreserved until decoded
+		const size_t headerProbe = 64 * 1024;
+
+		// the file buffer and the pixels its header promises
+		size_t loadCost(const void* head, size_t headSize, size_t fileSize, const LoadOptions& options)
+		{
+			auto pixels = decodedSize(head, headSize, options);
+			return pixels > SIZE_MAX - fileSize ? SIZE_MAX : fileSize + pixels;
+		}
+
+		gdImagePtr decode(int size, void* data, const LoadOptions& options, Opacity& opacity)
+		{
 #ifdef WIN32
 #define CALLTYPE _stdcall
 #else
 #define CALLTYPE
 #endif
-		using creator_t = gdImagePtr(CALLTYPE*)(int size, void *data);
-		creator_t creators[] = {
-			gdImageCreateFromPngPtr,
-			gdImageCreateFromJpegPtr,
-			gdImageCreateFromGifPtr
-		};
-
-		for (auto&& creator : creators)
-		{
-			auto ret = creator(size, data);
-			if (ret)
+			using creator_t = gdImagePtr(CALLTYPE*)(int size, void *data);
+			using ctx_creator_t = gdImagePtr(CALLTYPE*)(gdIOCtxPtr in);
+			struct Decoder
+			{
+				creator_t fromPtr;
+				ctx_creator_t fromCtx;
+			};
+			Decoder decoders[] = {
+				{ gdImageCreateFromPngPtr, gdImageCreateFromPngCtx },
+				{ gdImageCreateFromJpegPtr, gdImageCreateFromJpegCtx },
+				{ gdImageCreateFromGifPtr, gdImageCreateFromGifCtx }
+			};
+
+			opacity = Opacity::Unknown;
+			auto token = cancelToken();
+			for (auto&& decoder : decoders)
+			{
+				gdImagePtr ret = nullptr;
+				if (token)
+				{
+					if (token->cancelled())
+						return nullptr;
+
+					// reads start failing once cancelled, and the
+					// decoder bails out with them
+					auto memory = IOCtx::createFromReadOnlyMemory(size, data);
+					IOCtx reader{ newCancellableCtx(memory.get(), *token) };
+					if (reader)
+						ret = decoder.fromCtx(reader.get());
+
+					// libjpeg pads a truncated stream and carries on
+					if (ret && token->cancelled())
+					{
+						gdImageDestroy(ret);
+						return nullptr;
+					}
+				}
+				else
+					ret = decoder.fromPtr(size, data);
+
+				if (!ret)
+					continue;
+
+				// JPEG has no alpha at all; palette images are classified
+				// from the palette first and only scanned if it has holes
+				if (decoder.fromPtr == gdImageCreateFromJpegPtr)
+					opacity = Opacity::Opaque;
+				else if (!ret->trueColor)
+					opacity = gd::opacity(ImageView{ ret });
+
+				if (options.trueColor && !ret->trueColor)
+				{
+					auto expanded = toTrueColor(ret);
+					gdImageDestroy(ret);
+					ret = expanded;
+				}
 				return ret;
+			}
+			return nullptr;
 		}
-		return nullptr;
+	}
+
+	BGDEX_DECLARE_CC(gdImagePtr) loadImage(int size, void* data)
+	{
+		return loadImage(size, data, LoadOptions());
 	}
 
 	BGDEX_DECLARE_CC(gdImagePtr) loadImage(const std::string& path)
 	{
+		return loadImage(path, LoadOptions());
+	}
+
+	BGDEX_DECLARE_CC(gdImagePtr) loadImage(int size, void* data, const LoadOptions& options)
+	{
+		Opacity opacity;
+		return loadImage(size, data, options, opacity);
+	}
+
+	BGDEX_DECLARE_CC(gdImagePtr) loadImage(const std::string& path, const LoadOptions& options)
+	{
+		Opacity opacity;
+		return loadImage(path, options, opacity);
+	}
+
+	BGDEX_DECLARE_CC(gdImagePtr) loadImage(int size, void* data, const LoadOptions& options, Opacity& opacity)
+	{
+		opacity = Opacity::Unknown;
+
+		MemoryReservation pixels{ size > 0 ? decodedSize(data, (size_t)size, options) : 0 };
+		if (!pixels)
+			return nullptr;
+
+		return loadImage(size, data, options, opacity, pixels);
+	}
+
+	BGDEX_DECLARE_CC(gdImagePtr) loadImage(int size, void* data, const LoadOptions& options, Opacity& opacity, MemoryReservation& reserved)
+	{
+		auto ret = decode(size, data, options, opacity);
+		reserved.charge(ret);
+		return ret;
+	}
+
+	BGDEX_DECLARE_CC(gdImagePtr) loadImage(const std::string& path, const LoadOptions& options, Opacity& opacity)
+	{
+		opacity = Opacity::Unknown;
 
 		File f{ fopen(path.c_str(), "rb") };
 		if (!f)
 			return nullptr;
 
+		struct stat st;
+		if (stat(path.c_str(), &st))
+			return nullptr;
+
+		// Just the header at first, to reserve for the buffer and the
+		// pixels in one go before reading the rest; threads holding one
+		// while waiting for the other could starve each other
+		size_t size = (size_t)st.st_size;
 		unique_array<char> buffer;
+		if (!buffer.resize(std::min(size, headerProbe)))
+			return nullptr;
+		if (f.read(buffer.ptr, buffer.size) != buffer.size)
+			return nullptr;
+
+		MemoryReservation reserved{ loadCost(buffer.ptr, buffer.size, size, options) };
+		if (!reserved)
+			return nullptr;
+
+		size_t head = buffer.size;
+		if (!buffer.resize(size))
+			return nullptr;
+		if (f.read(buffer.ptr + head, size - head) != size - head)
+			return nullptr;
+
+		auto ret = decode((int)buffer.size, buffer.ptr, options, opacity);
+		// what the buffer took goes back as the rest becomes the image's
+		buffer.reset();
+		reserved.charge(ret);
+		return ret;
+	}
+
+	BGDEX_DECLARE_CC(bool) readFile(const std::string& path, std::vector<unsigned char>& out)
+	{
+		out.clear();
+
+		File f{ fopen(path.c_str(), "rb") };
+		if (!f)
+			return false;
 
 		struct stat st;
-		if (!stat(path.c_str(), &st))
+		if (stat(path.c_str(), &st))
+			return false;
+
+		out.resize((size_t)st.st_size);
+		if (f.read((char*)out.data(), out.size()) != out.size())
 		{
-			if (!buffer.resize((size_t)st.st_size))
-				return nullptr;
+			out.clear();
+			return false;
 		}
-		else
-			return nullptr;
+		return true;
+	}
 
-		if (f.read(buffer.ptr, buffer.size) != buffer.size)
-			return nullptr;
+	BGDEX_DECLARE_CC(bool) readFile(const std::string& path, std::vector<unsigned char>& out, const LoadOptions& options, MemoryReservation& reserved)
+	{
+		out.clear();
+		reserved.reset();
+
+		File f{ fopen(path.c_str(), "rb") };
+		if (!f)
+			return false;
 
-		return loadImage(buffer.size, buffer.ptr);
+		struct stat st;
+		if (stat(path.c_str(), &st))
+			return false;
+
+		// the header first, as in loadImage(path)
+		size_t size = (size_t)st.st_size;
+		out.resize(std::min(size, headerProbe));
+		if (f.read((char*)out.data(), out.size()) != out.size()
+			|| !reserved.reserve(loadCost(out.data(), out.size(), size, options)))
+		{
+			out.clear();
+			return false;
+		}
+
+		size_t head = out.size();
+		out.resize(size);
+		if (f.read((char*)out.data() + head, size - head) != size - head)
+		{
+			out.clear();
+			reserved.reset();
+			return false;
+		}
+		return true;
 	}
 }
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "gdex.hpp"
+#include "pixels/pool.hpp"
+#include <assert.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <unordered_map>
+
+namespace gd
+{
+	namespace
+	{
+		std::mutex lock;
+		std::condition_variable released;
+		// guarded by lock
+		MemoryBudget budget;
+		size_t used = 0;
+		std::unordered_map<const gdImage*, size_t> charges;
+		// charges.size(), read without the lock so destroyImage on
+		// uncharged images stays free while nothing is charged
+		std::atomic<size_t> charged(0);
+
+		// with lock held
+		void give(size_t bytes)
+		{
+			used -= std::min(bytes, used);
+			released.notify_all();
+		}
+	}
+
+	BGDEX_DECLARE_CC(void) configureMemoryBudget(const MemoryBudget& options)
+	{
+		std::lock_guard<std::mutex> guard{ lock };
+		budget = options;
+		released.notify_all();
+	}
+
+	BGDEX_DECLARE_CC(size_t) memoryInUse()
+	{
+		std::lock_guard<std::mutex> guard{ lock };
+		return used;
+	}
+
+	BGDEX_DECLARE_CC(bool) reserveMemory(size_t bytes, bool& counted)
+	{
+		counted = false;
+
+		std::unique_lock<std::mutex> guard{ lock };
+		for (;;)
+		{
+			if (!budget.bytes)
+				return true;
+			if (bytes > budget.bytes)
+				return false;
+			if (used + bytes <= budget.bytes)
+				break;
+			// a pool worker could be waiting on tasks queued behind it
+			if (budget.whenFull == Admission::Reject || pixels::onPoolWorker())
+				return false;
+
+			// a cancelled wait has no one to wake it
+			auto token = cancelToken();
+			if (!token)
+				released.wait(guard);
+			else if (token->cancelled())
+				return false;
+			else
+				released.wait_for(guard, std::chrono::milliseconds(10));
+		}
+
+		used += bytes;
+		counted = true;
+		return true;
+	}
+
+	BGDEX_DECLARE_CC(void) releaseMemory(size_t bytes)
+	{
+		std::lock_guard<std::mutex> guard{ lock };
+		give(bytes);
+	}
+
+	BGDEX_DECLARE_CC(void) chargeImage(const gdImage* img, size_t reserved)
+	{
+		// the estimate came from the header; what the decoder made of
+		// it is what stays charged, even if that is more
+		auto footprint = imageFootprint(img);
+
+		std::lock_guard<std::mutex> guard{ lock };
+		auto& charge = charges[img];
+		if (charge)
+		{
+			// left by an image freed with gdImageDestroy, whose address
+			// came back; what it still counted is lost memory no more
+			assert(!"a charged image was freed without destroyImage");
+			give(charge);
+		}
+		charge = footprint;
+		charged = charges.size();
+		if (footprint >= reserved)
+			used += footprint - reserved;
+		else
+			give(reserved - footprint);
+	}
+
+	BGDEX_DECLARE_CC(void) destroyImage(gdImagePtr img)
+	{
+		if (charged)
+		{
+			std::lock_guard<std::mutex> guard{ lock };
+			auto it = charges.find(img);
+			if (it != charges.end())
+			{
+				give(it->second);
+				charges.erase(it);
+				charged = charges.size();
+			}
+		}
+		gdImageDestroy(img);
+	}
+
+	BGDEX_DECLARE_CC(size_t) imageFootprint(const gdImage* img)
+	{
+		if (!img)
+			return 0;
+
+		size_t pixel = img->trueColor ? sizeof(int) : sizeof(unsigned char);
+		return sizeof(gdImage) + (size_t)img->sy * (sizeof(void*) + (size_t)img->sx * pixel);
+	}
+}
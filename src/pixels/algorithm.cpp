@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "gdex.hpp"
+#include "pixels/palette.hpp"
+#include "pixels/parallel.hpp"
+#include <string.h>
+
+namespace gd
+{
+	BGDEX_DECLARE_CC(void) forEachBand(int rows, size_t rowCost, Execution policy, const std::function<void(int, int)>& fn)
+	{
+		if (rows <= 0)
+			return;
+
+		if (policy != Execution::Parallel)
+		{
+			fn(0, rows);
+			return;
+		}
+
+		pixels::parallelRows(rows, rowCost, 1, [&](int begin, int end) { fn(begin, end); });
+	}
+
+	BGDEX_DECLARE_CC(void) paletteColors(const gdImage* img, int* colors)
+	{
+		pixels::PaletteTable palette{ img };
+		memcpy(colors, palette.colors, sizeof(palette.colors));
+	}
+
+	BGDEX_DECLARE_CC(void) expandIndices(int* out, const unsigned char* indices, int count, const int* colors)
+	{
+		pixels::expandRow(out, indices, count, colors);
+	}
+};
@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "gdex.hpp"
+#include "pixels/blend.hpp"
+#include "pixels/cpu.hpp"
+#include "pixels/simd.hpp"
+
+namespace gd { namespace pixels {
+
+#ifdef GDEX_HAS_SSE2
+	namespace
+	{
+		// (x + (x >> 7) + 1) >> 7 equals x / 127 for x <= 127 * 127
+		inline __m128i div127(__m128i x)
+		{
+			auto one = _mm_set1_epi32(1);
+			return _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(x, _mm_srli_epi32(x, 7)), one), 7);
+		}
+
+		// 32-bit lane product for operands below 2^15
+		inline __m128i mul15(__m128i a, __m128i b)
+		{
+			return _mm_madd_epi16(a, b);
+		}
+
+		// Exact for numerators below 2^16: the quotient is either an
+		// integer or at least 1/254 away from one, well above the
+		// rounding error of a single-precision division.
+		inline __m128i divExact(__m128i num, __m128 den)
+		{
+			return _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(num), den));
+		}
+
+		inline __m128i channel(__m128i px, int shift)
+		{
+			return _mm_and_si128(_mm_srli_epi32(px, shift), _mm_set1_epi32(0xFF));
+		}
+
+		__m128i blend4(__m128i d, __m128i s, __m128i sa)
+		{
+			auto max = _mm_set1_epi32(gdAlphaMax);
+			auto da = _mm_and_si128(_mm_srli_epi32(d, 24), max);
+
+			auto sw = _mm_sub_epi32(max, sa);
+			auto dw = div127(mul15(_mm_sub_epi32(max, da), sa));
+			auto tot = _mm_add_epi32(sw, dw);
+			// tot is 0 only for transparent-over-transparent, which
+			// gdAlphaBlend resolves to dst; keep the division finite
+			auto empty = _mm_cmpeq_epi32(tot, _mm_setzero_si128());
+			auto den = _mm_cvtepi32_ps(_mm_or_si128(tot, _mm_and_si128(empty, _mm_set1_epi32(1))));
+
+			auto alpha = div127(mul15(sa, da));
+			auto red = divExact(_mm_add_epi32(mul15(channel(s, 16), sw), mul15(channel(d, 16), dw)), den);
+			auto green = divExact(_mm_add_epi32(mul15(channel(s, 8), sw), mul15(channel(d, 8), dw)), den);
+			auto blue = divExact(_mm_add_epi32(mul15(channel(s, 0), sw), mul15(channel(d, 0), dw)), den);
+
+			auto out = _mm_or_si128(
+				_mm_or_si128(_mm_slli_epi32(alpha, 24), _mm_slli_epi32(red, 16)),
+				_mm_or_si128(_mm_slli_epi32(green, 8), blue));
+
+			// opaque sources are copied verbatim, as gdAlphaBlend does
+			auto keepSrc = _mm_cmpeq_epi32(sa, _mm_setzero_si128());
+			auto keepDst = _mm_or_si128(empty, _mm_cmpeq_epi32(sa, max));
+			out = _mm_or_si128(_mm_andnot_si128(keepSrc, out), _mm_and_si128(keepSrc, s));
+			return _mm_or_si128(_mm_andnot_si128(keepDst, out), _mm_and_si128(keepDst, d));
+		}
+	}
+#endif
+
+#ifdef GDEX_HAS_AVX2
+	namespace
+	{
+		// blend4 at twice the width, same arithmetic lane for lane
+		GDEX_TARGET_AVX2 inline __m256i div127(__m256i x)
+		{
+			auto one = _mm256_set1_epi32(1);
+			return _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(x, _mm256_srli_epi32(x, 7)), one), 7);
+		}
+
+		GDEX_TARGET_AVX2 inline __m256i mul15(__m256i a, __m256i b)
+		{
+			return _mm256_madd_epi16(a, b);
+		}
+
+		GDEX_TARGET_AVX2 inline __m256i divExact(__m256i num, __m256 den)
+		{
+			return _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(num), den));
+		}
+
+		GDEX_TARGET_AVX2 inline __m256i channel(__m256i px, int shift)
+		{
+			return _mm256_and_si256(_mm256_srli_epi32(px, shift), _mm256_set1_epi32(0xFF));
+		}
+
+		GDEX_TARGET_AVX2 __m256i blend8(__m256i d, __m256i s, __m256i sa)
+		{
+			auto max = _mm256_set1_epi32(gdAlphaMax);
+			auto da = _mm256_and_si256(_mm256_srli_epi32(d, 24), max);
+
+			auto sw = _mm256_sub_epi32(max, sa);
+			auto dw = div127(mul15(_mm256_sub_epi32(max, da), sa));
+			auto tot = _mm256_add_epi32(sw, dw);
+			auto empty = _mm256_cmpeq_epi32(tot, _mm256_setzero_si256());
+			auto den = _mm256_cvtepi32_ps(_mm256_or_si256(tot, _mm256_and_si256(empty, _mm256_set1_epi32(1))));
+
+			auto alpha = div127(mul15(sa, da));
+			auto red = divExact(_mm256_add_epi32(mul15(channel(s, 16), sw), mul15(channel(d, 16), dw)), den);
+			auto green = divExact(_mm256_add_epi32(mul15(channel(s, 8), sw), mul15(channel(d, 8), dw)), den);
+			auto blue = divExact(_mm256_add_epi32(mul15(channel(s, 0), sw), mul15(channel(d, 0), dw)), den);
+
+			auto out = _mm256_or_si256(
+				_mm256_or_si256(_mm256_slli_epi32(alpha, 24), _mm256_slli_epi32(red, 16)),
+				_mm256_or_si256(_mm256_slli_epi32(green, 8), blue));
+
+			auto keepSrc = _mm256_cmpeq_epi32(sa, _mm256_setzero_si256());
+			auto keepDst = _mm256_or_si256(empty, _mm256_cmpeq_epi32(sa, max));
+			out = _mm256_blendv_epi8(out, s, keepSrc);
+			return _mm256_blendv_epi8(out, d, keepDst);
+		}
+	}
+#endif
+
+	namespace
+	{
+		void blendRowScalar(int* dst, const int* src, int count)
+		{
+			for (; count > 0; --count, ++dst, ++src)
+				*dst = alphaBlend(*dst, *src);
+		}
+
+#ifdef GDEX_HAS_SSE2
+		void blendRowSSE2(int* dst, const int* src, int count)
+		{
+			auto max = _mm_set1_epi32(gdAlphaMax);
+			auto zero = _mm_setzero_si128();
+			for (; count >= 4; count -= 4, dst += 4, src += 4)
+			{
+				auto s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+				auto sa = _mm_and_si128(_mm_srli_epi32(s, 24), max);
+
+				// icons are mostly opaque or fully transparent runs
+				auto opaque = _mm_movemask_epi8(_mm_cmpeq_epi32(sa, zero));
+				if (opaque == 0xFFFF)
+				{
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), s);
+					continue;
+				}
+				if (_mm_movemask_epi8(_mm_cmpeq_epi32(sa, max)) == 0xFFFF)
+					continue;
+
+				auto d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), blend4(d, s, sa));
+			}
+			blendRowScalar(dst, src, count);
+		}
+#endif
+
+#ifdef GDEX_HAS_AVX2
+		GDEX_TARGET_AVX2 void blendRowAVX2(int* dst, const int* src, int count)
+		{
+			auto max = _mm256_set1_epi32(gdAlphaMax);
+			auto zero = _mm256_setzero_si256();
+			for (; count >= 8; count -= 8, dst += 8, src += 8)
+			{
+				auto s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+				auto sa = _mm256_and_si256(_mm256_srli_epi32(s, 24), max);
+
+				if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(sa, zero)) == -1)
+				{
+					_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), s);
+					continue;
+				}
+				if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(sa, max)) == -1)
+					continue;
+
+				auto d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), blend8(d, s, sa));
+			}
+			blendRowScalar(dst, src, count);
+		}
+#endif
+
+		typedef void (*BlendRow)(int* dst, const int* src, int count);
+		BlendRow blendRowImpl()
+		{
+			static const BlendRow impl = dispatch<BlendRow>(blendRowScalar,
+				GDEX_SSE2_KERNEL(blendRowSSE2), GDEX_AVX2_KERNEL(blendRowAVX2));
+			return impl;
+		}
+	}
+
+	void blendRow(int* dst, const int* src, int count)
+	{
+		blendRowImpl()(dst, src, count);
+	}
+}}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __GDEX_PIXELS_BLEND_HPP__
+#define __GDEX_PIXELS_BLEND_HPP__
+
+#include <gd.h>
+
+namespace gd { namespace pixels {
+
+	// Bit-exact gdAlphaBlend, small enough to be inlined into row loops
+	inline int alphaBlend(int dst, int src)
+	{
+		int src_alpha = gdTrueColorGetAlpha(src);
+		if (src_alpha == gdAlphaOpaque)
+			return src;
+
+		int dst_alpha = gdTrueColorGetAlpha(dst);
+		if (src_alpha == gdAlphaTransparent)
+			return dst;
+		if (dst_alpha == gdAlphaTransparent)
+			return src;
+
+		int src_weight = gdAlphaTransparent - src_alpha;
+		int dst_weight = (gdAlphaTransparent - dst_alpha) * src_alpha / gdAlphaMax;
+		int tot_weight = src_weight + dst_weight;
+
+		int alpha = src_alpha * dst_alpha / gdAlphaMax;
+		int red = (gdTrueColorGetRed(src) * src_weight + gdTrueColorGetRed(dst) * dst_weight) / tot_weight;
+		int green = (gdTrueColorGetGreen(src) * src_weight + gdTrueColorGetGreen(dst) * dst_weight) / tot_weight;
+		int blue = (gdTrueColorGetBlue(src) * src_weight + gdTrueColorGetBlue(dst) * dst_weight) / tot_weight;
+
+		return ((alpha << 24) + (red << 16) + (green << 8) + blue);
+	}
+
+	// dst[i] = gdAlphaBlend(dst[i], src[i])
+	void blendRow(int* dst, const int* src, int count);
+}}
+
+#endif // __GDEX_PIXELS_BLEND_HPP__
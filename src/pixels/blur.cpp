@@ -0,0 +1,442 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "gdex.hpp"
+#include "pixels/cpu.hpp"
+#include "pixels/parallel.hpp"
+#include "pixels/simd.hpp"
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <memory>
+#include <new>
+
+namespace gd
+{
+	namespace
+	{
+		// Premultiplied channels, all scaled to 0..255*127: colors are
+		// multiplied by coverage (127 - alpha), coverage by 255. Every
+		// value fits in 15 bits, window sums in 32.
+		struct Plane
+		{
+			int width;
+			int height;
+			int channels;
+			std::vector<uint16_t> data;
+
+			Plane(int width, int height, int channels)
+				: width(width), height(height), channels(channels)
+				, data((size_t)width * height * channels)
+			{
+			}
+
+			size_t stride() const { return (size_t)width * channels; }
+			uint16_t* row(int y) { return data.data() + y * stride(); }
+			const uint16_t* row(int y) const { return data.data() + y * stride(); }
+		};
+
+		static const int boxPasses = 3;
+		// keeps window sums of 15-bit values within 31 bits
+		static const int maxRadius = 16383;
+		// where every radius has reached maxRadius
+		static const float maxSigma = 16384.0f;
+
+		bool finite(float sigma)
+		{
+			// NaN fails both
+			return sigma >= -FLT_MAX && sigma <= FLT_MAX;
+		}
+
+		bool validSigma(float sigma)
+		{
+			return finite(sigma) && sigma > 0.0f;
+		}
+
+		// Box widths whose three passes have the variance of the
+		// requested Gaussian, following Kovesi's construction
+		void boxRadii(float sigma, int (&radii)[boxPasses])
+		{
+			// in double: 3 * lower * lower passes 2^31 near maxSigma
+			double clamped = std::min(sigma, maxSigma);
+			double variance = 12.0 * clamped * clamped;
+			int lower = (int)floor(sqrt(variance / boxPasses + 1.0));
+			if (lower % 2 == 0)
+				--lower;
+			int upper = lower + 2;
+
+			double side = lower;
+			int small = (int)floor((variance - boxPasses * side * side - 4 * boxPasses * side - 3 * boxPasses) / (-4.0 * side - 4.0) + 0.5);
+			for (int i = 0; i < boxPasses; ++i)
+				radii[i] = std::min(((i < small ? lower : upper) - 1) / 2, maxRadius);
+		}
+
+		template <int Channels>
+		void boxRow(uint16_t* dst, const uint16_t* src, int width, int radius)
+		{
+			float scale = 1.0f / (2 * radius + 1);
+			int last = width - 1;
+
+			int sum[Channels];
+			for (int c = 0; c < Channels; ++c)
+				sum[c] = src[c] * (radius + 1);
+			for (int i = 1; i <= radius; ++i)
+			{
+				auto px = src + std::min(i, last) * Channels;
+				for (int c = 0; c < Channels; ++c)
+					sum[c] += px[c];
+			}
+
+			for (int x = 0; x < width; ++x)
+			{
+				auto add = src + std::min(x + radius + 1, last) * Channels;
+				auto sub = src + std::max(x - radius, 0) * Channels;
+				for (int c = 0; c < Channels; ++c)
+				{
+					dst[x * Channels + c] = (uint16_t)(sum[c] * scale + 0.5f);
+					sum[c] += add[c] - sub[c];
+				}
+			}
+		}
+
+#ifdef GDEX_HAS_SSE2
+		inline __m128i load4(const uint16_t* px)
+		{
+			return _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(px)), _mm_setzero_si128());
+		}
+
+		// all four channels of a pixel slide in one register
+		template <>
+		void boxRow<4>(uint16_t* dst, const uint16_t* src, int width, int radius)
+		{
+			auto scale = _mm_set1_ps(1.0f / (2 * radius + 1));
+			auto half = _mm_set1_ps(0.5f);
+			int last = width - 1;
+
+			auto sum = _mm_madd_epi16(load4(src), _mm_set1_epi32(radius + 1));
+			for (int i = 1; i <= radius; ++i)
+				sum = _mm_add_epi32(sum, load4(src + std::min(i, last) * 4));
+
+			for (int x = 0; x < width; ++x)
+			{
+				auto out = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(sum), scale), half));
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x * 4), _mm_packs_epi32(out, out));
+
+				auto add = load4(src + std::min(x + radius + 1, last) * 4);
+				auto sub = load4(src + std::max(x - radius, 0) * 4);
+				sum = _mm_add_epi32(sum, _mm_sub_epi32(add, sub));
+			}
+		}
+#endif
+
+		// Vertical window over the elements [begin, end) of every row
+		void boxColumns(Plane& dst, const Plane& src, size_t begin, size_t end, int radius)
+		{
+			float scale = 1.0f / (2 * radius + 1);
+			int last = src.height - 1;
+			auto count = end - begin;
+
+			std::vector<int32_t> sums(count);
+			for (size_t e = 0; e < count; ++e)
+				sums[e] = src.row(0)[begin + e] * (radius + 1);
+			for (int i = 1; i <= radius; ++i)
+			{
+				auto row = src.row(std::min(i, last)) + begin;
+				for (size_t e = 0; e < count; ++e)
+					sums[e] += row[e];
+			}
+
+			for (int y = 0; y < src.height; ++y)
+			{
+				auto out = dst.row(y) + begin;
+				auto add = src.row(std::min(y + radius + 1, last)) + begin;
+				auto sub = src.row(std::max(y - radius, 0)) + begin;
+				auto sum = sums.data();
+
+				size_t e = 0;
+#ifdef GDEX_HAS_SSE2
+				auto vscale = _mm_set1_ps(scale);
+				auto half = _mm_set1_ps(0.5f);
+				auto zero = _mm_setzero_si128();
+				for (; e + 8 <= count; e += 8)
+				{
+					auto lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sum + e));
+					auto hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sum + e + 4));
+
+					auto outLo = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(lo), vscale), half));
+					auto outHi = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(hi), vscale), half));
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(out + e), _mm_packs_epi32(outLo, outHi));
+
+					auto a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(add + e));
+					auto s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sub + e));
+					lo = _mm_add_epi32(lo, _mm_sub_epi32(_mm_unpacklo_epi16(a, zero), _mm_unpacklo_epi16(s, zero)));
+					hi = _mm_add_epi32(hi, _mm_sub_epi32(_mm_unpackhi_epi16(a, zero), _mm_unpackhi_epi16(s, zero)));
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(sum + e), lo);
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(sum + e + 4), hi);
+				}
+#endif
+				for (; e < count; ++e)
+				{
+					out[e] = (uint16_t)(sum[e] * scale + 0.5f);
+					sum[e] += add[e] - sub[e];
+				}
+			}
+		}
+
+		template <int Channels>
+		void boxBlur(Plane& plane, const int (&radii)[boxPasses])
+		{
+			Plane tmp{ plane.width, plane.height, plane.channels };
+			Plane* src = &plane;
+			Plane* dst = &tmp;
+
+			for (auto radius : radii)
+			{
+				pixels::parallelRows(src->height, src->stride(), 1, [=](int begin, int end)
+				{
+					for (int y = begin; y < end; ++y)
+						boxRow<Channels>(dst->row(y), src->row(y), src->width, radius);
+				});
+				std::swap(src, dst);
+			}
+
+			// columns are split into cache-line multiples between threads
+			for (auto radius : radii)
+			{
+				pixels::parallelRows((int)src->stride(), src->height, 32, [=](int begin, int end)
+				{
+					boxColumns(*dst, *src, begin, end, radius);
+				});
+				std::swap(src, dst);
+			}
+
+			// an even number of passes ends up back in plane
+		}
+
+		int coverage(const gdImage* img, int x, int y)
+		{
+			if (img->trueColor)
+				return gdAlphaMax - gdTrueColorGetAlpha(img->tpixels[y][x]);
+
+			int c = img->pixels[y][x];
+			return c == img->transparent ? 0 : gdAlphaMax - img->alpha[c];
+		}
+
+		// Shadow pixels from a blurred coverage mask (0..255*127):
+		// dst = rgb with alpha 127 - round(mask * opacity / (255*127))
+		const int maskScale = 255 * gdAlphaMax;
+
+		void expandMaskScalar(int* dst, const uint16_t* mask, int count, int rgb, int opacity)
+		{
+			for (int x = 0; x < count; ++x)
+				dst[x] = rgb | ((gdAlphaMax - (mask[x] * opacity + maskScale / 2) / maskScale) << 24);
+		}
+
+		// The numerator stays below 2^23, so the float quotient is off
+		// by at most one and the integer remainder puts it right; all
+		// products fit madd's 16-bit operands.
+#ifdef GDEX_HAS_SSE2
+		inline __m128i expand4(__m128i cov, __m128i rgb, __m128i opacity)
+		{
+			auto scale = _mm_set1_epi32(maskScale);
+			auto n = _mm_add_epi32(_mm_madd_epi16(cov, opacity), _mm_set1_epi32(maskScale / 2));
+			auto q = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(n), _mm_set1_ps(1.0f / maskScale)));
+			auto r = _mm_sub_epi32(n, _mm_madd_epi16(q, scale));
+			q = _mm_sub_epi32(q, _mm_cmpgt_epi32(r, _mm_set1_epi32(maskScale - 1)));
+			q = _mm_add_epi32(q, _mm_cmplt_epi32(r, _mm_setzero_si128()));
+			return _mm_or_si128(rgb, _mm_slli_epi32(_mm_sub_epi32(_mm_set1_epi32(gdAlphaMax), q), 24));
+		}
+
+		void expandMaskSSE2(int* dst, const uint16_t* mask, int count, int rgb, int opacity)
+		{
+			auto color = _mm_set1_epi32(rgb);
+			auto weight = _mm_set1_epi32(opacity);
+			auto zero = _mm_setzero_si128();
+			int x = 0;
+			for (; x + 8 <= count; x += 8)
+			{
+				auto cov = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mask + x));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), expand4(_mm_unpacklo_epi16(cov, zero), color, weight));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x + 4), expand4(_mm_unpackhi_epi16(cov, zero), color, weight));
+			}
+			expandMaskScalar(dst + x, mask + x, count - x, rgb, opacity);
+		}
+#endif
+
+#ifdef GDEX_HAS_AVX2
+		GDEX_TARGET_AVX2 void expandMaskAVX2(int* dst, const uint16_t* mask, int count, int rgb, int opacity)
+		{
+			auto color = _mm256_set1_epi32(rgb);
+			auto weight = _mm256_set1_epi32(opacity);
+			auto scale = _mm256_set1_epi32(maskScale);
+			int x = 0;
+			for (; x + 8 <= count; x += 8)
+			{
+				auto cov = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(mask + x)));
+				auto n = _mm256_add_epi32(_mm256_mullo_epi32(cov, weight), _mm256_set1_epi32(maskScale / 2));
+				auto q = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(n), _mm256_set1_ps(1.0f / maskScale)));
+				auto r = _mm256_sub_epi32(n, _mm256_mullo_epi32(q, scale));
+				q = _mm256_sub_epi32(q, _mm256_cmpgt_epi32(r, _mm256_set1_epi32(maskScale - 1)));
+				q = _mm256_add_epi32(q, _mm256_cmpgt_epi32(_mm256_setzero_si256(), r));
+				auto alpha = _mm256_slli_epi32(_mm256_sub_epi32(_mm256_set1_epi32(gdAlphaMax), q), 24);
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x), _mm256_or_si256(color, alpha));
+			}
+			expandMaskScalar(dst + x, mask + x, count - x, rgb, opacity);
+		}
+#endif
+
+		typedef void (*ExpandMask)(int* dst, const uint16_t* mask, int count, int rgb, int opacity);
+		ExpandMask expandMaskImpl()
+		{
+			static const ExpandMask impl = pixels::dispatch<ExpandMask>(expandMaskScalar,
+				GDEX_SSE2_KERNEL(expandMaskSSE2), GDEX_AVX2_KERNEL(expandMaskAVX2));
+			return impl;
+		}
+	}
+
+	BGDEX_DECLARE_CC(int) blurExtent(float sigma)
+	{
+		if (!validSigma(sigma))
+			return 0;
+
+		int radii[boxPasses];
+		boxRadii(sigma, radii);
+		return radii[0] + radii[1] + radii[2];
+	}
+
+	BGDEX_DECLARE_CC(bool) blur(gdImagePtr img, float sigma)
+	{
+		if (!img || !img->trueColor || !validSigma(sigma))
+			return false;
+
+		int radii[boxPasses];
+		boxRadii(sigma, radii);
+
+		int width = img->sx;
+		Plane plane{ width, img->sy, 4 };
+		pixels::parallelRows(img->sy, width, 1, [&](int begin, int end)
+		{
+			for (int y = begin; y < end; ++y)
+			{
+				auto src = img->tpixels[y];
+				auto dst = plane.row(y);
+				for (int x = 0; x < width; ++x, dst += 4)
+				{
+					int px = src[x];
+					int cov = gdAlphaMax - gdTrueColorGetAlpha(px);
+					dst[0] = (uint16_t)(gdTrueColorGetBlue(px) * cov);
+					dst[1] = (uint16_t)(gdTrueColorGetGreen(px) * cov);
+					dst[2] = (uint16_t)(gdTrueColorGetRed(px) * cov);
+					dst[3] = (uint16_t)(cov * 255);
+				}
+			}
+		});
+
+		boxBlur<4>(plane, radii);
+		// img is untouched until here
+		if (cancelled())
+			return false;
+
+		pixels::parallelRows(img->sy, width, 1, [&](int begin, int end)
+		{
+			for (int y = begin; y < end; ++y)
+			{
+				auto src = plane.row(y);
+				auto dst = img->tpixels[y];
+				for (int x = 0; x < width; ++x, src += 4)
+				{
+					int cov = src[3];
+					if (!cov)
+					{
+						dst[x] = gdTrueColorAlpha(0, 0, 0, gdAlphaTransparent);
+						continue;
+					}
+
+					float scale = 255.0f / cov;
+					int blue = std::min(255, (int)(src[0] * scale + 0.5f));
+					int green = std::min(255, (int)(src[1] * scale + 0.5f));
+					int red = std::min(255, (int)(src[2] * scale + 0.5f));
+					dst[x] = gdTrueColorAlpha(red, green, blue, gdAlphaMax - (cov + 127) / 255);
+				}
+			}
+		});
+
+		return !cancelled();
+	}
+
+	BGDEX_DECLARE_CC(gdImagePtr) dropShadow(const gdImage* img, float sigma, int color)
+	{
+		if (!img || !finite(sigma))
+			return nullptr;
+
+		int radii[boxPasses] = {};
+		if (sigma > 0.0f)
+			boxRadii(sigma, radii);
+		int pad = radii[0] + radii[1] + radii[2];
+
+		// gdImageCreateTrueColor would refuse the shadow anyway; found
+		// out before allocating the plane, which may not fit either
+		long long outWidth = img->sx + 2ll * pad;
+		long long outHeight = img->sy + 2ll * pad;
+		if (outWidth * outHeight > INT_MAX || outWidth > INT_MAX / (long long)sizeof(int))
+			return nullptr;
+
+		int width = img->sx;
+		std::unique_ptr<Plane> shadow;
+		try
+		{
+			shadow.reset(new Plane{ (int)outWidth, (int)outHeight, 1 });
+		}
+		catch (const std::bad_alloc&)
+		{
+			return nullptr;
+		}
+
+		auto& plane = *shadow;
+		for (int y = 0; y < img->sy; ++y)
+		{
+			auto dst = plane.row(y + pad) + pad;
+			for (int x = 0; x < width; ++x)
+				dst[x] = (uint16_t)(coverage(img, x, y) * 255);
+		}
+
+		if (sigma > 0.0f)
+			boxBlur<1>(plane, radii);
+		if (cancelled())
+			return nullptr;
+
+		auto out = gdImageCreateTrueColor(plane.width, plane.height);
+		if (!out)
+			return nullptr;
+		gdImageSaveAlpha(out, 1);
+
+		int rgb = color & 0xFFFFFF;
+		int opacity = gdAlphaMax - gdTrueColorGetAlpha(color);
+		auto expandMask = expandMaskImpl();
+		for (int y = 0; y < plane.height; ++y)
+			expandMask(out->tpixels[y], plane.row(y), plane.width, rgb, opacity);
+
+		return out;
+	}
+}
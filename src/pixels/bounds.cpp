@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "gdex.hpp"
+#include "pixels/image.hpp"
+#include "pixels/simd.hpp"
+#include <string.h>
+
+namespace gd
+{
+	namespace
+	{
+		static const int alphaBits = 0x7F000000;
+
+		// Truecolor pixels are empty when fully transparent or equal to
+		// the transparent color. No gd pixel has the top bit set, so -1
+		// stands for "no transparent color" and never matches.
+		struct TrueColorEmpty
+		{
+			int key;
+
+			explicit TrueColorEmpty(const gdImage* img) : key(img->transparent < 0 ? -1 : img->transparent) {}
+
+			bool operator()(int px) const
+			{
+				return (px & alphaBits) == (gdAlphaTransparent << 24) || px == key;
+			}
+
+			// index of the first pixel with content, or count
+			int first(const int* row, int count) const
+			{
+				int x = 0;
+#ifdef GDEX_HAS_SSE2
+				auto alpha = _mm_set1_epi32(alphaBits);
+				auto transparent = _mm_set1_epi32(gdAlphaTransparent << 24);
+				auto keys = _mm_set1_epi32(key);
+				for (; x + 4 <= count; x += 4)
+				{
+					auto px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x));
+					auto empty = _mm_or_si128(
+						_mm_cmpeq_epi32(_mm_and_si128(px, alpha), transparent),
+						_mm_cmpeq_epi32(px, keys));
+					if (_mm_movemask_epi8(empty) != 0xFFFF)
+						break;
+				}
+#endif
+				for (; x < count; ++x)
+				{
+					if (!(*this)(row[x]))
+						return x;
+				}
+				return count;
+			}
+
+			// one past the last pixel with content, or 0
+			int last(const int* row, int count) const
+			{
+				int x = count;
+#ifdef GDEX_HAS_SSE2
+				auto alpha = _mm_set1_epi32(alphaBits);
+				auto transparent = _mm_set1_epi32(gdAlphaTransparent << 24);
+				auto keys = _mm_set1_epi32(key);
+				for (; x >= 4; x -= 4)
+				{
+					auto px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x - 4));
+					auto empty = _mm_or_si128(
+						_mm_cmpeq_epi32(_mm_and_si128(px, alpha), transparent),
+						_mm_cmpeq_epi32(px, keys));
+					if (_mm_movemask_epi8(empty) != 0xFFFF)
+						break;
+				}
+#endif
+				for (; x > 0; --x)
+				{
+					if (!(*this)(row[x - 1]))
+						return x;
+				}
+				return 0;
+			}
+		};
+
+		// Palette pixels are empty through the transparent index or a
+		// fully transparent palette entry
+		struct PaletteEmpty
+		{
+			bool empty[gdMaxColors];
+
+			explicit PaletteEmpty(const gdImage* img)
+			{
+				for (int c = 0; c < gdMaxColors; ++c)
+					empty[c] = c == img->transparent || img->alpha[c] == gdAlphaTransparent;
+			}
+
+			int first(const unsigned char* row, int count) const
+			{
+				for (int x = 0; x < count; ++x)
+				{
+					if (!empty[row[x]])
+						return x;
+				}
+				return count;
+			}
+
+			int last(const unsigned char* row, int count) const
+			{
+				for (int x = count; x > 0; --x)
+				{
+					if (!empty[row[x - 1]])
+						return x;
+				}
+				return 0;
+			}
+		};
+
+		// Top and bottom come from whole-row scans from either end;
+		// left and right only scan the rows in between, and each row
+		// stops as soon as it reaches the edges already found
+		template <typename Empty, typename Row>
+		Rect bounds(const Empty& empty, int width, int height, Row row)
+		{
+			int top = 0;
+			while (top < height && empty.first(row(top), width) == width)
+				++top;
+			if (top == height)
+				return{ 0, 0, 0, 0 };
+
+			int bottom = height;
+			while (empty.last(row(bottom - 1), width) == 0)
+				--bottom;
+
+			int left = width;
+			int right = 0;
+			for (int y = top; y < bottom && (left > 0 || right < width); ++y)
+			{
+				auto line = row(y);
+				if (left > 0)
+					left = empty.first(line, left);
+				if (right < width)
+					right += empty.last(line + right, width - right);
+			}
+
+			return{ left, top, right - left, bottom - top };
+		}
+	}
+
+	BGDEX_DECLARE_CC(Rect) contentBounds(const ImageView& view)
+	{
+		if (!view)
+			return{ view.crop().x, view.crop().y, 0, 0 };
+
+		Rect found;
+		if (view.trueColor())
+			found = bounds(TrueColorEmpty{ view.image() }, view.width(), view.height(), [&](int y) { return view.row(y); });
+		else
+			found = bounds(PaletteEmpty{ view.image() }, view.width(), view.height(), [&](int y) { return view.indexRow(y); });
+
+		found.x += view.crop().x;
+		found.y += view.crop().y;
+		return found;
+	}
+
+	BGDEX_DECLARE_CC(gdImagePtr) crop(const ImageView& view)
+	{
+		if (!view)
+			return nullptr;
+
+		auto img = pixels::createLike(view.image(), view.width(), view.height());
+		if (!img)
+			return nullptr;
+
+		MutableImageView target{ img };
+		if (view.trueColor())
+		{
+			for (int y = 0; y < view.height(); ++y)
+				memcpy(target.row(y), view.row(y), view.width() * sizeof(int));
+		}
+		else
+		{
+			for (int y = 0; y < view.height(); ++y)
+				memcpy(target.indexRow(y), view.indexRow(y), view.width());
+		}
+		return img;
+	}
+};
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __GDEX_PIXELS_CLIP_HPP__
+#define __GDEX_PIXELS_CLIP_HPP__
+
+#include "gdex.hpp"
+
+namespace gd { namespace pixels {
+
+	// gdImageSetPixel only touches pixels inside this rectangle
+	inline Rect clipRect(const gdImage* img)
+	{
+		return{ img->cx1, img->cy1, img->cx2 - img->cx1 + 1, img->cy2 - img->cy1 + 1 };
+	}
+
+	// Clips a srcRect -> (dstX, dstY) transfer against both the source
+	// image and the destination clip rectangle, moving both corners by
+	// the same amount. Returns false, when nothing is left to transfer.
+	inline bool clipTransfer(const gdImage* dst, const gdImage* src, int& dstX, int& dstY, Rect& srcRect)
+	{
+		auto from = srcRect.intersect({ 0, 0, src->sx, src->sy });
+		dstX += from.x - srcRect.x;
+		dstY += from.y - srcRect.y;
+
+		auto to = Rect{ dstX, dstY, from.width, from.height }.intersect(clipRect(dst));
+		if (to.empty())
+			return false;
+
+		srcRect = { from.x + to.x - dstX, from.y + to.y - dstY, to.width, to.height };
+		dstX = to.x;
+		dstY = to.y;
+		return true;
+	}
+}}
+
+#endif // __GDEX_PIXELS_CLIP_HPP__
@@ -0,0 +1,354 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "gdex.hpp"
+#include "pixels/luma.hpp"
+#include "pixels/palette.hpp"
+#include "pixels/parallel.hpp"
+#include "pixels/simd.hpp"
+#include <atomic>
+#include <limits>
+#include <math.h>
+#include <mutex>
+#include <stdlib.h>
+#include <string.h>
+
+namespace gd
+{
+	namespace
+	{
+		bool sameSize(const ImageView& lhs, const ImageView& rhs)
+		{
+			return lhs && rhs && lhs.width() == rhs.width() && lhs.height() == rhs.height();
+		}
+
+		// Largest absolute channel difference and sum of squared ones,
+		// with alpha doubled to weigh like the 8-bit channels
+		struct Errors
+		{
+			int max;
+			uint64_t squares;
+
+			Errors() : max(0), squares(0) {}
+
+			void add(const int* lhs, const int* rhs, int count)
+			{
+				int x = 0;
+#ifdef GDEX_HAS_SSE2
+				auto zero = _mm_setzero_si128();
+				// alpha is the top byte of each pixel, lanes 3 and 7 once widened
+				auto alpha = _mm_setr_epi16(0, 0, 0, -1, 0, 0, 0, -1);
+				auto maxima = zero;
+				// a lane grows by at most 2 * 2 * 255^2 per four pixels, so
+				// a chunk of 4096 pixels cannot overflow it
+				while (x + 4 <= count)
+				{
+					auto sums = zero;
+					for (int end = std::min(count & ~3, x + 4096); x < end; x += 4)
+					{
+						auto l = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lhs + x));
+						auto r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rhs + x));
+
+						auto lo = _mm_sub_epi16(_mm_unpacklo_epi8(l, zero), _mm_unpacklo_epi8(r, zero));
+						auto hi = _mm_sub_epi16(_mm_unpackhi_epi8(l, zero), _mm_unpackhi_epi8(r, zero));
+						lo = _mm_add_epi16(lo, _mm_and_si128(lo, alpha));
+						hi = _mm_add_epi16(hi, _mm_and_si128(hi, alpha));
+
+						maxima = _mm_max_epi16(maxima, _mm_max_epi16(lo, _mm_sub_epi16(zero, lo)));
+						maxima = _mm_max_epi16(maxima, _mm_max_epi16(hi, _mm_sub_epi16(zero, hi)));
+						sums = _mm_add_epi32(sums, _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi)));
+					}
+
+					uint32_t lanes[4];
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sums);
+					squares += (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+				}
+
+				int16_t peaks[8];
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(peaks), maxima);
+				for (auto peak : peaks)
+					max = std::max(max, (int)peak);
+#endif
+				for (; x < count; ++x)
+				{
+					int l = lhs[x], r = rhs[x];
+					int diffs[4] = {
+						gdTrueColorGetRed(l) - gdTrueColorGetRed(r),
+						gdTrueColorGetGreen(l) - gdTrueColorGetGreen(r),
+						gdTrueColorGetBlue(l) - gdTrueColorGetBlue(r),
+						(gdTrueColorGetAlpha(l) - gdTrueColorGetAlpha(r)) * 2
+					};
+					for (auto diff : diffs)
+					{
+						max = std::max(max, abs(diff));
+						squares += diff * diff;
+					}
+				}
+			}
+		};
+
+		// A block's sums would fit 32 bits, but wholeImage takes in
+		// strips of any length, where 255^2 per pixel does not
+		struct Moments
+		{
+			uint64_t x, y, xx, yy, xy;
+
+			Moments& operator+=(const Moments& oth)
+			{
+				x += oth.x;
+				y += oth.y;
+				xx += oth.xx;
+				yy += oth.yy;
+				xy += oth.xy;
+				return *this;
+			}
+		};
+
+		// The usual 8x8 windows 4 pixels apart: every window is made of
+		// four 4x4 blocks, so the moments are only taken per block, one
+		// row of blocks at a time, and each pixel is read once
+		static const int ssimBlock = 4;
+
+		class BlockRows
+		{
+			pixels::RowReader left;
+			pixels::RowReader right;
+			int width;
+			int blocks;
+			std::vector<unsigned char> lumaLeft;
+			std::vector<unsigned char> lumaRight;
+
+		public:
+			BlockRows(const ImageView& lhs, const ImageView& rhs)
+				: left(lhs)
+				, right(rhs)
+				, width(lhs.width())
+				, blocks(lhs.width() / ssimBlock)
+				, lumaLeft(ssimBlock * width)
+				, lumaRight(ssimBlock * width)
+			{
+			}
+
+			void compute(int row, Moments* out)
+			{
+				for (int y = 0; y < ssimBlock; ++y)
+				{
+					auto l = left.row(row * ssimBlock + y);
+					auto r = right.row(row * ssimBlock + y);
+					auto a = &lumaLeft[y * width];
+					auto b = &lumaRight[y * width];
+					for (int x = 0; x < width; ++x)
+					{
+						a[x] = (unsigned char)pixels::luma(l[x]);
+						b[x] = (unsigned char)pixels::luma(r[x]);
+					}
+				}
+
+				int block = 0;
+#ifdef GDEX_HAS_SSE2
+				// two blocks per 8 pixels; madd leaves each block in a lane pair
+				auto zero = _mm_setzero_si128();
+				auto ones = _mm_set1_epi16(1);
+				for (; block + 2 <= blocks; block += 2)
+				{
+					auto sx = zero, sy = zero, sxx = zero, syy = zero, sxy = zero;
+					for (int y = 0; y < ssimBlock; ++y)
+					{
+						auto a = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&lumaLeft[y * width + block * ssimBlock])), zero);
+						auto b = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&lumaRight[y * width + block * ssimBlock])), zero);
+						sx = _mm_add_epi32(sx, _mm_madd_epi16(a, ones));
+						sy = _mm_add_epi32(sy, _mm_madd_epi16(b, ones));
+						sxx = _mm_add_epi32(sxx, _mm_madd_epi16(a, a));
+						syy = _mm_add_epi32(syy, _mm_madd_epi16(b, b));
+						sxy = _mm_add_epi32(sxy, _mm_madd_epi16(a, b));
+					}
+
+					uint32_t lanes[5][4];
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes[0]), sx);
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes[1]), sy);
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes[2]), sxx);
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes[3]), syy);
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes[4]), sxy);
+					for (int half = 0; half < 2; ++half)
+					{
+						int i = half * 2;
+						out[block + half] = {
+							lanes[0][i] + lanes[0][i + 1],
+							lanes[1][i] + lanes[1][i + 1],
+							lanes[2][i] + lanes[2][i + 1],
+							lanes[3][i] + lanes[3][i + 1],
+							lanes[4][i] + lanes[4][i + 1]
+						};
+					}
+				}
+#endif
+				for (; block < blocks; ++block)
+				{
+					Moments m{ 0, 0, 0, 0, 0 };
+					for (int y = 0; y < ssimBlock; ++y)
+					{
+						auto a = &lumaLeft[y * width + block * ssimBlock];
+						auto b = &lumaRight[y * width + block * ssimBlock];
+						for (int x = 0; x < ssimBlock; ++x)
+						{
+							m.x += a[x];
+							m.y += b[x];
+							m.xx += a[x] * a[x];
+							m.yy += b[x] * b[x];
+							m.xy += a[x] * b[x];
+						}
+					}
+					out[block] = m;
+				}
+			}
+		};
+
+		// Images too small for a single window are one window
+		Moments wholeImage(const ImageView& lhs, const ImageView& rhs)
+		{
+			pixels::RowReader left{ lhs }, right{ rhs };
+			Moments m{ 0, 0, 0, 0, 0 };
+			for (int y = 0; y < lhs.height(); ++y)
+			{
+				auto l = left.row(y);
+				auto r = right.row(y);
+				for (int x = 0; x < lhs.width(); ++x)
+				{
+					uint32_t a = pixels::luma(l[x]), b = pixels::luma(r[x]);
+					m.x += a;
+					m.y += b;
+					m.xx += a * a;
+					m.yy += b * b;
+					m.xy += a * b;
+				}
+			}
+			return m;
+		}
+
+		double ssimOf(const Moments& m, double n)
+		{
+			static const double c1 = (0.01 * 255) * (0.01 * 255);
+			static const double c2 = (0.03 * 255) * (0.03 * 255);
+
+			double mx = m.x / n, my = m.y / n;
+			double vx = m.xx / n - mx * mx;
+			double vy = m.yy / n - my * my;
+			double cov = m.xy / n - mx * my;
+			return ((2 * mx * my + c1) * (2 * cov + c2)) / ((mx * mx + my * my + c1) * (vx + vy + c2));
+		}
+	}
+
+	BGDEX_DECLARE_CC(bool) equal(const ImageView& lhs, const ImageView& rhs)
+	{
+		if (!lhs || !rhs)
+			return !lhs && !rhs;
+		if (!sameSize(lhs, rhs))
+			return false;
+
+		// the first band to find a difference stops the others
+		std::atomic<bool> same{ true };
+		pixels::parallelRows(lhs.height(), lhs.width(), 1, [&](int begin, int end) {
+			pixels::RowReader left{ lhs }, right{ rhs };
+			size_t length = lhs.width() * sizeof(int);
+			for (int y = begin; y < end && same.load(std::memory_order_relaxed); ++y)
+			{
+				if (memcmp(left.row(y), right.row(y), length))
+					same = false;
+			}
+		});
+		// skipped bands prove nothing
+		return same && !cancelled();
+	}
+
+	BGDEX_DECLARE_CC(ImageDifference) difference(const ImageView& lhs, const ImageView& rhs)
+	{
+		ImageDifference diff;
+		if (!sameSize(lhs, rhs))
+			return diff;
+
+		Errors total;
+		std::mutex lock;
+		pixels::parallelRows(lhs.height(), lhs.width(), 1, [&](int begin, int end) {
+			pixels::RowReader left{ lhs }, right{ rhs };
+			Errors band;
+			for (int y = begin; y < end; ++y)
+				band.add(left.row(y), right.row(y), lhs.width());
+
+			std::lock_guard<std::mutex> guard{ lock };
+			total.max = std::max(total.max, band.max);
+			total.squares += band.squares;
+		});
+		if (cancelled())
+			return diff;
+
+		diff.maxChannel = total.max;
+		diff.mse = (double)total.squares / ((double)lhs.width() * lhs.height() * 4);
+		diff.psnr = total.squares
+			? 10.0 * log10(255.0 * 255.0 / diff.mse)
+			: std::numeric_limits<double>::infinity();
+		return diff;
+	}
+
+	BGDEX_DECLARE_CC(double) ssim(const ImageView& lhs, const ImageView& rhs)
+	{
+		if (!sameSize(lhs, rhs))
+			return 0.0;
+
+		if (lhs.width() < 2 * ssimBlock || lhs.height() < 2 * ssimBlock)
+			return ssimOf(wholeImage(lhs, rhs), (double)lhs.width() * lhs.height());
+
+		int across = lhs.width() / ssimBlock - 1;
+		int down = lhs.height() / ssimBlock - 1;
+
+		double total = 0.0;
+		std::mutex lock;
+		pixels::parallelRows(down, (size_t)lhs.width() * ssimBlock, 1, [&](int begin, int end) {
+			BlockRows rows{ lhs, rhs };
+			std::vector<Moments> above(across + 1), below(across + 1);
+			rows.compute(begin, above.data());
+
+			double band = 0.0;
+			for (int j = begin; j < end; ++j)
+			{
+				rows.compute(j + 1, below.data());
+				for (int i = 0; i < across; ++i)
+				{
+					auto m = above[i];
+					m += above[i + 1];
+					m += below[i];
+					m += below[i + 1];
+					band += ssimOf(m, 4 * ssimBlock * ssimBlock);
+				}
+				std::swap(above, below);
+			}
+
+			std::lock_guard<std::mutex> guard{ lock };
+			total += band;
+		});
+		if (cancelled())
+			return std::numeric_limits<double>::quiet_NaN();
+
+		return total / ((double)across * down);
+	}
+};
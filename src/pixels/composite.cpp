@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "gdex.hpp"
+#include "pixels/clip.hpp"
+#include "pixels/cpu.hpp"
+#include "pixels/palette.hpp"
+#include "pixels/parallel.hpp"
+#include "pixels/simd.hpp"
+#include <float.h>
+
+namespace gd
+{
+	namespace
+	{
+		// Porter-Duff factors, Fa = a0 + a1 * dst_coverage and
+		// Fb = b0 + b1 * src_coverage; covers all of CompositeOp
+		struct Factors
+		{
+			float a0, a1, b0, b1;
+		};
+
+		Factors factors(CompositeOp op)
+		{
+			switch (op)
+			{
+			case CompositeOp::Clear:           return{ 0, 0, 0, 0 };
+			case CompositeOp::Source:          return{ 1, 0, 0, 0 };
+			case CompositeOp::Over:            return{ 1, 0, 1, -1 };
+			case CompositeOp::In:              return{ 0, 1, 0, 0 };
+			case CompositeOp::Out:             return{ 1, -1, 0, 0 };
+			case CompositeOp::Atop:            return{ 0, 1, 1, -1 };
+			case CompositeOp::DestinationOver: return{ 1, -1, 1, 0 };
+			case CompositeOp::DestinationIn:   return{ 0, 0, 0, 1 };
+			case CompositeOp::DestinationOut:  return{ 0, 0, 1, -1 };
+			case CompositeOp::Xor:             return{ 1, -1, 1, -1 };
+			}
+			return{ 0, 0, 1, 0 };
+		}
+
+		// Instantiated per operator, so the factors are constants the
+		// compiler folds into the arithmetic instead of loads from memory
+		template <CompositeOp Op>
+		struct Kernel
+		{
+			float srcScale; // opacity / gdAlphaMax
+
+			int pixel(int d, int s) const
+			{
+				const Factors f = factors(Op);
+				float as = (gdAlphaMax - gdTrueColorGetAlpha(s)) * srcScale;
+				float ad = (gdAlphaMax - gdTrueColorGetAlpha(d)) * (1.0f / gdAlphaMax);
+				float ws = as * (f.a0 + f.a1 * ad);
+				float wd = ad * (f.b0 + f.b1 * as);
+				float ar = ws + wd;
+				if (ar <= 0.0f)
+					return gdTrueColorAlpha(0, 0, 0, gdAlphaTransparent);
+
+				// clamped as in the SIMD kernels, so a nearly uncovered
+				// pixel comes out the same whichever path handles it
+				float inv = 1.0f / std::max(ar, 1e-6f);
+				int r = (int)((gdTrueColorGetRed(s) * ws + gdTrueColorGetRed(d) * wd) * inv + 0.5f);
+				int g = (int)((gdTrueColorGetGreen(s) * ws + gdTrueColorGetGreen(d) * wd) * inv + 0.5f);
+				int b = (int)((gdTrueColorGetBlue(s) * ws + gdTrueColorGetBlue(d) * wd) * inv + 0.5f);
+				int a = gdAlphaMax - (int)(ar * gdAlphaMax + 0.5f);
+				return gdTrueColorAlpha(r, g, b, a);
+			}
+
+#ifdef GDEX_HAS_SSE2
+			static __m128 channel(__m128i px, int shift, int mask)
+			{
+				return _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px, shift), _mm_set1_epi32(mask)));
+			}
+
+			static __m128i pack(__m128 value, int shift)
+			{
+				return _mm_slli_epi32(_mm_cvttps_epi32(_mm_add_ps(value, _mm_set1_ps(0.5f))), shift);
+			}
+
+			__m128i pixel(__m128i d, __m128i s) const
+			{
+				const Factors f = factors(Op);
+				auto max = _mm_set1_ps((float)gdAlphaMax);
+				auto as = _mm_mul_ps(_mm_sub_ps(max, channel(s, 24, gdAlphaMax)), _mm_set1_ps(srcScale));
+				auto ad = _mm_mul_ps(_mm_sub_ps(max, channel(d, 24, gdAlphaMax)), _mm_set1_ps(1.0f / gdAlphaMax));
+				auto ws = _mm_mul_ps(as, _mm_add_ps(_mm_set1_ps(f.a0), _mm_mul_ps(_mm_set1_ps(f.a1), ad)));
+				auto wd = _mm_mul_ps(ad, _mm_add_ps(_mm_set1_ps(f.b0), _mm_mul_ps(_mm_set1_ps(f.b1), as)));
+				auto ar = _mm_add_ps(ws, wd);
+				auto covered = _mm_cmpgt_ps(ar, _mm_setzero_ps());
+				auto inv = _mm_and_ps(covered, _mm_div_ps(_mm_set1_ps(1.0f), _mm_max_ps(ar, _mm_set1_ps(1e-6f))));
+
+				auto r = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(channel(s, 16, 0xFF), ws), _mm_mul_ps(channel(d, 16, 0xFF), wd)), inv);
+				auto g = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(channel(s, 8, 0xFF), ws), _mm_mul_ps(channel(d, 8, 0xFF), wd)), inv);
+				auto b = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(channel(s, 0, 0xFF), ws), _mm_mul_ps(channel(d, 0, 0xFF), wd)), inv);
+				auto a = _mm_sub_epi32(_mm_set1_epi32(gdAlphaMax), _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(ar, max), _mm_set1_ps(0.5f))));
+
+				return _mm_or_si128(_mm_or_si128(_mm_slli_epi32(a, 24), pack(r, 16)), _mm_or_si128(pack(g, 8), pack(b, 0)));
+			}
+#endif
+
+#ifdef GDEX_HAS_AVX2
+			GDEX_TARGET_AVX2 static __m256 channel(__m256i px, int shift, int mask)
+			{
+				return _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(px, shift), _mm256_set1_epi32(mask)));
+			}
+
+			GDEX_TARGET_AVX2 static __m256i pack(__m256 value, int shift)
+			{
+				return _mm256_slli_epi32(_mm256_cvttps_epi32(_mm256_add_ps(value, _mm256_set1_ps(0.5f))), shift);
+			}
+
+			GDEX_TARGET_AVX2 __m256i pixel(__m256i d, __m256i s) const
+			{
+				const Factors f = factors(Op);
+				auto max = _mm256_set1_ps((float)gdAlphaMax);
+				auto as = _mm256_mul_ps(_mm256_sub_ps(max, channel(s, 24, gdAlphaMax)), _mm256_set1_ps(srcScale));
+				auto ad = _mm256_mul_ps(_mm256_sub_ps(max, channel(d, 24, gdAlphaMax)), _mm256_set1_ps(1.0f / gdAlphaMax));
+				auto ws = _mm256_mul_ps(as, _mm256_add_ps(_mm256_set1_ps(f.a0), _mm256_mul_ps(_mm256_set1_ps(f.a1), ad)));
+				auto wd = _mm256_mul_ps(ad, _mm256_add_ps(_mm256_set1_ps(f.b0), _mm256_mul_ps(_mm256_set1_ps(f.b1), as)));
+				auto ar = _mm256_add_ps(ws, wd);
+				auto covered = _mm256_cmp_ps(ar, _mm256_setzero_ps(), _CMP_GT_OQ);
+				auto inv = _mm256_and_ps(covered, _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_max_ps(ar, _mm256_set1_ps(1e-6f))));
+
+				auto r = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(channel(s, 16, 0xFF), ws), _mm256_mul_ps(channel(d, 16, 0xFF), wd)), inv);
+				auto g = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(channel(s, 8, 0xFF), ws), _mm256_mul_ps(channel(d, 8, 0xFF), wd)), inv);
+				auto b = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(channel(s, 0, 0xFF), ws), _mm256_mul_ps(channel(d, 0, 0xFF), wd)), inv);
+				auto a = _mm256_sub_epi32(_mm256_set1_epi32(gdAlphaMax), _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(ar, max), _mm256_set1_ps(0.5f))));
+
+				return _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(a, 24), pack(r, 16)), _mm256_or_si256(pack(g, 8), pack(b, 0)));
+			}
+#endif
+		};
+
+		template <CompositeOp Op>
+		void rowScalar(float srcScale, int* dst, const int* src, int count)
+		{
+			Kernel<Op> kernel{ srcScale };
+			for (; count > 0; --count, ++dst, ++src)
+				*dst = kernel.pixel(*dst, *src);
+		}
+
+#ifdef GDEX_HAS_SSE2
+		template <CompositeOp Op>
+		void rowSSE2(float srcScale, int* dst, const int* src, int count)
+		{
+			Kernel<Op> kernel{ srcScale };
+			for (; count >= 4; count -= 4, dst += 4, src += 4)
+			{
+				auto d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst));
+				auto s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), kernel.pixel(d, s));
+			}
+			rowScalar<Op>(srcScale, dst, src, count);
+		}
+#endif
+
+#ifdef GDEX_HAS_AVX2
+		template <CompositeOp Op>
+		GDEX_TARGET_AVX2 void rowAVX2(float srcScale, int* dst, const int* src, int count)
+		{
+			Kernel<Op> kernel{ srcScale };
+			for (; count >= 8; count -= 8, dst += 8, src += 8)
+			{
+				auto d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst));
+				auto s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), kernel.pixel(d, s));
+			}
+			rowScalar<Op>(srcScale, dst, src, count);
+		}
+#endif
+
+		typedef void (*CompositeRow)(float srcScale, int* dst, const int* src, int count);
+
+		template <CompositeOp Op>
+		CompositeRow bindRow()
+		{
+			return pixels::dispatch<CompositeRow>(rowScalar<Op>,
+				GDEX_SSE2_KERNEL(rowSSE2<Op>), GDEX_AVX2_KERNEL(rowAVX2<Op>));
+		}
+
+		// indexed by CompositeOp
+		const CompositeRow* compositeRows()
+		{
+			static const CompositeRow rows[] = {
+				bindRow<CompositeOp::Clear>(),
+				bindRow<CompositeOp::Source>(),
+				bindRow<CompositeOp::Over>(),
+				bindRow<CompositeOp::In>(),
+				bindRow<CompositeOp::Out>(),
+				bindRow<CompositeOp::Atop>(),
+				bindRow<CompositeOp::DestinationOver>(),
+				bindRow<CompositeOp::DestinationIn>(),
+				bindRow<CompositeOp::DestinationOut>(),
+				bindRow<CompositeOp::Xor>()
+			};
+			return rows;
+		}
+
+		template <PixelFormat Format>
+		void compositeFrom(CompositeRow row, float srcScale, const MutableImageView& target, const ImageView& source)
+		{
+			pixels::parallelRows(source.height(), source.width(), 1, [&](int begin, int end)
+			{
+				pixels::FormatRows<Format> rows{ source };
+				for (int y = begin; y < end; ++y)
+					row(srcScale, target.row(y), rows.row(y), source.width());
+			});
+		}
+	}
+
+	BGDEX_DECLARE_CC(bool) composite(gdImagePtr dst, const ImageView& src, CompositeOp op, int x, int y, float opacity)
+	{
+		if (!dst || !dst->trueColor)
+			return false;
+		if (!src)
+			return true;
+
+		if ((unsigned)op > (unsigned)CompositeOp::Xor)
+			return false;
+		// NaN fails both
+		if (!(opacity >= -FLT_MAX && opacity <= FLT_MAX))
+			return false;
+		if (opacity < 0.0f) opacity = 0.0f;
+		if (opacity > 1.0f) opacity = 1.0f;
+
+		Rect from = src.crop();
+		if (!pixels::clipTransfer(dst, src.image(), x, y, from))
+			return true;
+
+		ImageView source{ src.image(), from };
+		MutableImageView target{ dst, { x, y, from.width, from.height } };
+
+		// Bands would read rows other bands already wrote; compositing
+		// from a copy keeps the result what it would be for two images
+		GdImage copy{ nullptr };
+		if (src.image() == dst && !from.intersect(target.crop()).empty())
+		{
+			copy.reset(gd::crop(source));
+			if (!copy)
+				return false;
+			source = copy.view();
+		}
+
+		auto row = compositeRows()[(int)op];
+		if (source.trueColor())
+			compositeFrom<PixelFormat::TrueColor>(row, opacity / gdAlphaMax, target, source);
+		else
+			compositeFrom<PixelFormat::Palette>(row, opacity / gdAlphaMax, target, source);
+		return !cancelled();
+	}
+}
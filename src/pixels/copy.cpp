@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "gdex.hpp"
+#include "pixels/blend.hpp"
+#include "pixels/clip.hpp"
+#include "pixels/palette.hpp"
+
+namespace gd
+{
+	namespace
+	{
+		enum class CopyMode
+		{
+			Generic, // leave it to gdImageCopy
+			Store,
+			Blend
+		};
+
+		// gdImageCopy reads pixels outside the source as 0 (black, or
+		// palette index 0) and copies them like any other
+		bool withinSource(const gdImage* src, int srcX, int srcY, int w, int h)
+		{
+			return srcX >= 0 && srcY >= 0 && w <= src->sx - srcX && h <= src->sy - srcY;
+		}
+
+		CopyMode copyMode(const gdImage* dst, const gdImage* src, Opacity srcOpacity)
+		{
+			// truecolor color keys need per-pixel tests and self-copies
+			// may overlap; the palette table already maps a palette
+			// key to fully transparent, which blends to nothing
+			if (!dst->trueColor || dst == src || (src->trueColor && src->transparent != -1))
+				return CopyMode::Generic;
+
+			switch (dst->alphaBlendingFlag)
+			{
+			case gdEffectReplace:
+				// gdImageCopy skips palette keys rather than storing them
+				if (!src->trueColor && src->transparent != -1 && srcOpacity != Opacity::Opaque)
+					return CopyMode::Generic;
+				return CopyMode::Store;
+			case gdEffectAlphaBlend:
+			case gdEffectNormal:
+				// blending an opaque pixel just stores it
+				return srcOpacity == Opacity::Opaque ? CopyMode::Store : CopyMode::Blend;
+			}
+			return CopyMode::Generic;
+		}
+
+		// One instantiation per source format, so the row loops only
+		// see a memcpy or a palette expansion, never a format test
+		template <PixelFormat Format>
+		void transfer(CopyMode mode, const MutableImageView& target, const ImageView& source)
+		{
+			pixels::FormatRows<Format> rows{ source };
+			auto width = source.width();
+			auto height = source.height();
+
+			if (mode == CopyMode::Store)
+			{
+				for (int y = 0; y < height; ++y)
+					rows.row(y, target.row(y));
+				return;
+			}
+
+			for (int y = 0; y < height; ++y)
+				pixels::blendRow(target.row(y), rows.row(y), width);
+		}
+	}
+
+	BGDEX_DECLARE_CC(void) copy(gdImagePtr dst, const gdImage* src, int dstX, int dstY, int srcX, int srcY, int w, int h)
+	{
+		copy(dst, src, dstX, dstY, srcX, srcY, w, h, Opacity::Unknown);
+	}
+
+	BGDEX_DECLARE_CC(void) copy(gdImagePtr dst, const gdImage* src, int dstX, int dstY, int srcX, int srcY, int w, int h, Opacity srcOpacity)
+	{
+		if (!dst || !src)
+			return;
+
+		auto mode = copyMode(dst, src, srcOpacity);
+		if (mode == CopyMode::Generic || !withinSource(src, srcX, srcY, w, h))
+		{
+			gdImageCopy(dst, const_cast<gdImagePtr>(src), dstX, dstY, srcX, srcY, w, h);
+			return;
+		}
+
+		Rect from{ srcX, srcY, w, h };
+		if (!pixels::clipTransfer(dst, src, dstX, dstY, from))
+			return;
+
+		ImageView source{ src, from };
+		MutableImageView target{ dst, { dstX, dstY, from.width, from.height } };
+
+		if (source.trueColor())
+			transfer<PixelFormat::TrueColor>(mode, target, source);
+		else
+			transfer<PixelFormat::Palette>(mode, target, source);
+	}
+}
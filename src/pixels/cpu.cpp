@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "gdex.hpp"
+#include "pixels/cpu.hpp"
+#include "pixels/simd.hpp"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define GDEX_CPUID_MSVC 1
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#define GDEX_CPUID_GNUC 1
+#endif
+
+namespace gd
+{
+	namespace
+	{
+		struct Registers
+		{
+			unsigned eax, ebx, ecx, edx;
+		};
+
+#if defined(GDEX_CPUID_MSVC)
+		Registers cpuid(unsigned leaf)
+		{
+			int info[4];
+			__cpuidex(info, leaf, 0);
+			return{ (unsigned)info[0], (unsigned)info[1], (unsigned)info[2], (unsigned)info[3] };
+		}
+
+		unsigned long long xcr0()
+		{
+			return _xgetbv(0);
+		}
+#elif defined(GDEX_CPUID_GNUC)
+		Registers cpuid(unsigned leaf)
+		{
+			Registers r = { 0, 0, 0, 0 };
+			if (leaf <= __get_cpuid_max(0, nullptr))
+				__cpuid_count(leaf, 0, r.eax, r.ebx, r.ecx, r.edx);
+			return r;
+		}
+
+		unsigned long long xcr0()
+		{
+			unsigned lo, hi;
+			__asm__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+			return ((unsigned long long)hi << 32) | lo;
+		}
+#endif
+
+		SimdLevel hardwareLevel()
+		{
+#if defined(GDEX_CPUID_MSVC) || defined(GDEX_CPUID_GNUC)
+			if (cpuid(0).eax < 1)
+				return SimdLevel::Scalar;
+
+			auto basic = cpuid(1);
+			if (!(basic.edx & (1u << 26)))
+				return SimdLevel::Scalar;
+
+			// AVX2 also needs the OS to save the ymm registers
+			// (OSXSAVE, then XCR0 bits 1 and 2)
+			const unsigned osxsave = 1u << 27, avx = 1u << 28;
+			if ((basic.ecx & (osxsave | avx)) != (osxsave | avx) || (xcr0() & 6) != 6)
+				return SimdLevel::SSE2;
+			if (cpuid(0).eax < 7 || !(cpuid(7).ebx & (1u << 5)))
+				return SimdLevel::SSE2;
+			return SimdLevel::AVX2;
+#else
+			return SimdLevel::Scalar;
+#endif
+		}
+
+		// GDEX_SIMD can only take instruction sets away, so a bad value
+		// never lets a kernel run on a CPU without it
+		SimdLevel requestedLevel(SimdLevel detected)
+		{
+			auto env = getenv("GDEX_SIMD");
+			if (!env)
+				return detected;
+
+			SimdLevel requested = detected;
+			if (!strcmp(env, "scalar"))
+				requested = SimdLevel::Scalar;
+			else if (!strcmp(env, "sse2"))
+				requested = SimdLevel::SSE2;
+			else if (!strcmp(env, "avx2"))
+				requested = SimdLevel::AVX2;
+			return requested < detected ? requested : detected;
+		}
+
+		SimdLevel detectSimdLevel()
+		{
+			auto level = requestedLevel(hardwareLevel());
+#ifndef GDEX_HAS_AVX2
+			if (level > SimdLevel::SSE2)
+				level = SimdLevel::SSE2;
+#endif
+#ifndef GDEX_HAS_SSE2
+			level = SimdLevel::Scalar;
+#endif
+			return level;
+		}
+	}
+
+	namespace pixels
+	{
+		SimdLevel boundSimdLevel()
+		{
+			static const SimdLevel level = detectSimdLevel();
+			return level;
+		}
+	}
+
+	BGDEX_DECLARE_CC(SimdLevel) simdLevel()
+	{
+		return pixels::boundSimdLevel();
+	}
+};
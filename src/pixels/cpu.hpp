@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __GDEX_PIXELS_CPU_HPP__
+#define __GDEX_PIXELS_CPU_HPP__
+
+namespace gd { namespace pixels {
+
+	// Probes cpuid and GDEX_SIMD once, on first use; every kernel
+	// binds to this level and simdLevel() reports it
+	SimdLevel boundSimdLevel();
+
+	// Best variant for the bound level; a nullptr entry means the
+	// variant was not compiled in and the next one down is used.
+	// Kernels call this from a function-local static, so they are
+	// bound on first use, whatever initialises first.
+	template <typename Fn>
+	Fn dispatch(Fn scalar, Fn sse2, Fn avx2)
+	{
+		auto level = boundSimdLevel();
+		if (avx2 && level >= SimdLevel::AVX2)
+			return avx2;
+		if (sse2 && level >= SimdLevel::SSE2)
+			return sse2;
+		return scalar;
+	}
+}}
+
+#endif // __GDEX_PIXELS_CPU_HPP__
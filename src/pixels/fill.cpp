@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "gdex.hpp"
+#include "pixels/clip.hpp"
+#include "pixels/cpu.hpp"
+#include "pixels/fill.hpp"
+#include "pixels/simd.hpp"
+#include <string.h>
+
+namespace gd
+{
+	namespace pixels
+	{
+		namespace
+		{
+			void fillSpanScalar(int* dst, int count, int color)
+			{
+				while (count--)
+					*dst++ = color;
+			}
+
+#ifdef GDEX_HAS_SSE2
+			void fillSpanSSE2(int* dst, int count, int color)
+			{
+				auto value = _mm_set1_epi32(color);
+				for (; count >= 16; count -= 16, dst += 16)
+				{
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), value);
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 4), value);
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 8), value);
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 12), value);
+				}
+				for (; count >= 4; count -= 4, dst += 4)
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), value);
+				fillSpanScalar(dst, count, color);
+			}
+#endif
+
+#ifdef GDEX_HAS_AVX2
+			GDEX_TARGET_AVX2 void fillSpanAVX2(int* dst, int count, int color)
+			{
+				auto value = _mm256_set1_epi32(color);
+				for (; count >= 32; count -= 32, dst += 32)
+				{
+					_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), value);
+					_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 8), value);
+					_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 16), value);
+					_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 24), value);
+				}
+				for (; count >= 8; count -= 8, dst += 8)
+					_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), value);
+				fillSpanScalar(dst, count, color);
+			}
+#endif
+
+			typedef void (*FillSpan)(int* dst, int count, int color);
+			FillSpan fillSpanImpl()
+			{
+				static const FillSpan impl = dispatch<FillSpan>(fillSpanScalar,
+					GDEX_SSE2_KERNEL(fillSpanSSE2), GDEX_AVX2_KERNEL(fillSpanAVX2));
+				return impl;
+			}
+		}
+
+		void fillSpan(int* dst, int count, int color)
+		{
+			fillSpanImpl()(dst, count, color);
+		}
+	}
+
+	namespace
+	{
+		// Would gdImageSetPixel store the color as-is? Negative colors
+		// are gdStyled, gdBrushed, gdTiled and friends, overlay and
+		// multiply effects always need the destination pixel.
+		bool storesDirectly(const gdImage* img, int color)
+		{
+			if (color < 0)
+				return false;
+
+			if (!img->trueColor)
+				return true;
+
+			switch (img->alphaBlendingFlag)
+			{
+			case gdEffectReplace:
+				return true;
+			case gdEffectAlphaBlend:
+			case gdEffectNormal:
+				return gdTrueColorGetAlpha(color) == gdAlphaOpaque;
+			}
+			return false;
+		}
+
+		template <PixelFormat Format>
+		void fillArea(const MutableImageView& view, int color);
+
+		template <>
+		void fillArea<PixelFormat::TrueColor>(const MutableImageView& view, int color)
+		{
+			for (int y = 0, height = view.height(); y < height; ++y)
+				pixels::fillSpan(view.row(y), view.width(), color);
+		}
+
+		template <>
+		void fillArea<PixelFormat::Palette>(const MutableImageView& view, int color)
+		{
+			for (int y = 0, height = view.height(); y < height; ++y)
+				memset(view.indexRow(y), color, view.width());
+		}
+
+		template <PixelFormat Format>
+		void fillClipped(gdImagePtr img, const Rect* rects, size_t count, int color)
+		{
+			auto clip = pixels::clipRect(img);
+			for (size_t i = 0; i < count; ++i)
+			{
+				auto area = rects[i].intersect(clip);
+				if (!area.empty())
+					fillArea<Format>(MutableImageView{ img, area }, color);
+			}
+		}
+	}
+
+	BGDEX_DECLARE_CC(void) fill(const MutableImageView& view, int color)
+	{
+		if (view.trueColor())
+			fillArea<PixelFormat::TrueColor>(view, color);
+		else
+			fillArea<PixelFormat::Palette>(view, color);
+	}
+
+	BGDEX_DECLARE_CC(void) fillRectangles(gdImagePtr img, const Rect* rects, size_t count, int color)
+	{
+		if (!img)
+			return;
+
+		if (storesDirectly(img, color))
+		{
+			if (img->trueColor)
+				fillClipped<PixelFormat::TrueColor>(img, rects, count, color);
+			else
+				fillClipped<PixelFormat::Palette>(img, rects, count, color);
+			return;
+		}
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			auto& rect = rects[i];
+			if (!rect.empty())
+				gdImageFilledRectangle(img, rect.x, rect.y, rect.right() - 1, rect.bottom() - 1, color);
+		}
+	}
+}
@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "gdex.hpp"
+#include "pixels/clip.hpp"
+#include "pixels/fill.hpp"
+#include <stdlib.h>
+#include <string.h>
+
+namespace gd
+{
+	namespace
+	{
+		bool near(int a, int b, int tolerance)
+		{
+			return abs(gdTrueColorGetRed(a) - gdTrueColorGetRed(b)) <= tolerance
+				&& abs(gdTrueColorGetGreen(a) - gdTrueColorGetGreen(b)) <= tolerance
+				&& abs(gdTrueColorGetBlue(a) - gdTrueColorGetBlue(b)) <= tolerance
+				&& abs(gdTrueColorGetAlpha(a) - gdTrueColorGetAlpha(b)) <= tolerance;
+		}
+
+		struct TrueColorMatch
+		{
+			int seed;
+			int tolerance;
+			bool operator()(int px) const { return px == seed || (tolerance && near(px, seed, tolerance)); }
+		};
+
+		struct PaletteMatch
+		{
+			bool table[gdMaxColors];
+			bool operator()(unsigned char px) const { return table[px]; }
+		};
+
+		void paintRun(int* dst, int count, int color) { pixels::fillSpan(dst, count, color); }
+		void paintRun(unsigned char* dst, int count, int color) { memset(dst, color, count); }
+
+		// Heckbert's seed fill: each stacked segment is a run already
+		// painted on row y, to be continued on row y + dy. Runs are
+		// found first and painted with one span fill each.
+		template <typename Pixel, typename Match>
+		class SeedFill
+		{
+			Pixel** rows;
+			int left, top, right, bottom; // inclusive, clip rectangle
+			int stride;                   // visited bits per row
+			Match match;
+			int color;
+			bool track;
+			FillStack& stack;
+
+			bool visited(int x, int y) const
+			{
+				size_t bit = (size_t)y * stride + x;
+				return (stack.visited[bit >> 5] >> (bit & 31)) & 1;
+			}
+
+			bool inside(int x, int y) const
+			{
+				return match(rows[y][x]) && !(track && visited(x, y));
+			}
+
+			void paint(int y, int from, int to)
+			{
+				paintRun(rows[y] + from, to - from + 1, color);
+				if (!track)
+					return;
+
+				for (size_t bit = (size_t)y * stride + from, end = bit + (to - from + 1); bit < end; ++bit)
+					stack.visited[bit >> 5] |= 1u << (bit & 31);
+			}
+
+			void push(int y, int from, int to, int dy)
+			{
+				if (y + dy >= top && y + dy <= bottom)
+					stack.segments.push_back({ y, from, to, dy });
+			}
+
+		public:
+			SeedFill(gdImagePtr img, const Rect& clip, const Match& match, int color, bool track, FillStack& stack)
+				: rows(reinterpret_cast<Pixel**>(img->trueColor ? (void*)img->tpixels : (void*)img->pixels))
+				, left(clip.x), top(clip.y), right(clip.right() - 1), bottom(clip.bottom() - 1)
+				, stride(img->sx)
+				, match(match)
+				, color(color)
+				, track(track)
+				, stack(stack)
+			{
+				stack.segments.clear();
+				stack.visited.clear();
+				if (track)
+					stack.visited.resize(((size_t)img->sx * img->sy + 31) / 32, 0);
+			}
+
+			void run(int x, int y)
+			{
+				push(y, x, x, 1);
+				push(y + 1, x, x, -1);
+
+				while (!stack.segments.empty())
+				{
+					auto seg = stack.segments.back();
+					stack.segments.pop_back();
+
+					int dy = seg.dy;
+					int x1 = seg.left;
+					int x2 = seg.right;
+					y = seg.y + dy;
+
+					int l;
+					x = x1;
+					while (x >= left && inside(x, y))
+						--x;
+
+					if (x < x1)
+					{
+						paint(y, x + 1, x1);
+						l = x + 1;
+						if (l < x1)
+							push(y, l, x1 - 1, -dy);
+						x = x1 + 1;
+					}
+					else
+					{
+						for (++x; x <= x2 && !inside(x, y); ++x);
+						l = x;
+						if (x > x2)
+							continue;
+					}
+
+					do
+					{
+						int start = x;
+						while (x <= right && inside(x, y))
+							++x;
+						if (x > start)
+							paint(y, start, x - 1);
+
+						push(y, l, x - 1, dy);
+						if (x > x2 + 1)
+							push(y, x2 + 1, x - 1, -dy);
+
+						for (++x; x <= x2 && !inside(x, y); ++x);
+						l = x;
+					} while (x <= x2);
+				}
+			}
+		};
+
+		template <typename Pixel, typename Match>
+		void seedFill(gdImagePtr img, const Rect& clip, const Match& match, int color, bool track, FillStack& stack, int x, int y)
+		{
+			SeedFill<Pixel, Match>{ img, clip, match, color, track, stack }.run(x, y);
+		}
+	}
+
+	BGDEX_DECLARE_CC(void) floodFill(gdImagePtr img, int x, int y, int color, int tolerance, FillStack& stack)
+	{
+		if (!img)
+			return;
+
+		// tiles, brushes and styles are left to libgd
+		if (color < 0)
+		{
+			gdImageFill(img, x, y, color);
+			return;
+		}
+
+		if (!img->trueColor && color >= img->colorsTotal)
+			return;
+
+		auto clip = pixels::clipRect(img);
+		if (x < clip.x || y < clip.y || x >= clip.right() || y >= clip.bottom())
+			return;
+
+		if (tolerance < 0)
+			tolerance = 0;
+
+		if (img->trueColor)
+		{
+			TrueColorMatch match{ img->tpixels[y][x], tolerance };
+			if (!tolerance && color == match.seed)
+				return;
+
+			// a color, which is itself part of the region, needs a
+			// separate record of painted pixels
+			seedFill<int>(img, clip, match, color, match(color), stack, x, y);
+			return;
+		}
+
+		int seed = img->pixels[y][x];
+		int seedColor = gdTrueColorAlpha(img->red[seed], img->green[seed], img->blue[seed], img->alpha[seed]);
+		PaletteMatch match;
+		for (int c = 0; c < gdMaxColors; ++c)
+		{
+			match.table[c] = c == seed || (tolerance && c < img->colorsTotal &&
+				near(gdTrueColorAlpha(img->red[c], img->green[c], img->blue[c], img->alpha[c]), seedColor, tolerance));
+		}
+
+		if (!tolerance && color == seed)
+			return;
+		seedFill<unsigned char>(img, clip, match, color, match.table[color], stack, x, y);
+	}
+}
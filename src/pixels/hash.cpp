@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "gdex.hpp"
+#include "pixels/luma.hpp"
+#include "pixels/palette.hpp"
+#include "pixels/parallel.hpp"
+#include <math.h>
+
+namespace gd
+{
+	namespace
+	{
+		// Area average of the luma into a small fixed grid, in a single
+		// pass: every source pixel adds to the cell it falls into
+		class Thumbnail
+		{
+			int width;
+			int height;
+			std::vector<float> cells;
+
+		public:
+			Thumbnail(const ImageView& view, int width, int height)
+				: width(width)
+				, height(height)
+				, cells((size_t)width * height)
+			{
+				// 64 bits: a cell of an image of a few gigapixels, or of
+				// a very thin one, outgrows 32
+				std::vector<uint64_t> sums(cells.size());
+				std::vector<int> column(view.width());
+				std::vector<uint64_t> counts(width);
+				for (int x = 0; x < view.width(); ++x)
+				{
+					column[x] = (int)((int64_t)x * width / view.width());
+					++counts[column[x]];
+				}
+
+				pixels::RowReader rows{ view };
+				std::vector<uint64_t> rowCounts(height);
+				for (int y = 0; y < view.height(); ++y)
+				{
+					int cy = (int)((int64_t)y * height / view.height());
+					++rowCounts[cy];
+
+					auto row = rows.row(y);
+					auto sum = &sums[cy * width];
+					for (int x = 0; x < view.width(); ++x)
+						sum[column[x]] += pixels::luma(row[x]);
+				}
+
+				// views smaller than the grid leave some cells empty
+				for (int cy = 0; cy < height; ++cy)
+				{
+					for (int cx = 0; cx < width; ++cx)
+					{
+						uint64_t count = counts[cx] * rowCounts[cy];
+						cells[cy * width + cx] = count ? (float)((double)sums[cy * width + cx] / count) : 0.0f;
+					}
+				}
+			}
+
+			float at(int x, int y) const { return cells[y * width + x]; }
+		};
+
+		// dHash: each bit tells whether a cell of a 9x8 thumbnail is
+		// darker than its right neighbour
+		uint64_t differenceHash(const ImageView& view)
+		{
+			Thumbnail thumb{ view, 9, 8 };
+			uint64_t hash = 0;
+			for (int y = 0; y < 8; ++y)
+			{
+				for (int x = 0; x < 8; ++x)
+					hash = hash << 1 | (thumb.at(x, y) < thumb.at(x + 1, y) ? 1 : 0);
+			}
+			return hash;
+		}
+
+		static const int dctSize = 32;
+		static const int dctKept = 8;
+
+		// DCT-II basis, only the rows of the kept frequencies
+		class CosineTable
+		{
+		public:
+			float basis[dctKept][dctSize];
+
+			CosineTable()
+			{
+				const double pi = 3.14159265358979323846;
+				for (int u = 0; u < dctKept; ++u)
+				{
+					for (int x = 0; x < dctSize; ++x)
+						basis[u][x] = (float)cos(pi * u * (2 * x + 1) / (2 * dctSize));
+				}
+			}
+		};
+
+		// built on first use
+		const CosineTable& cosineTable()
+		{
+			static const CosineTable table;
+			return table;
+		}
+
+		// pHash: the 8x8 lowest frequencies of the DCT of a 32x32
+		// thumbnail, each bit telling whether a coefficient is above
+		// their median
+		uint64_t dctHash(const ImageView& view)
+		{
+			Thumbnail thumb{ view, dctSize, dctSize };
+			auto& cosines = cosineTable();
+
+			// rows first, then columns, computing only what is kept
+			float rows[dctSize][dctKept];
+			for (int y = 0; y < dctSize; ++y)
+			{
+				for (int u = 0; u < dctKept; ++u)
+				{
+					float sum = 0.0f;
+					for (int x = 0; x < dctSize; ++x)
+						sum += cosines.basis[u][x] * thumb.at(x, y);
+					rows[y][u] = sum;
+				}
+			}
+
+			float coefficients[dctKept * dctKept];
+			for (int v = 0; v < dctKept; ++v)
+			{
+				for (int u = 0; u < dctKept; ++u)
+				{
+					float sum = 0.0f;
+					for (int y = 0; y < dctSize; ++y)
+						sum += cosines.basis[v][y] * rows[y][u];
+					coefficients[v * dctKept + u] = sum;
+				}
+			}
+
+			float sorted[dctKept * dctKept];
+			std::copy(coefficients, coefficients + dctKept * dctKept, sorted);
+			std::nth_element(sorted, sorted + dctKept * dctKept / 2, sorted + dctKept * dctKept);
+			float median = sorted[dctKept * dctKept / 2];
+
+			uint64_t hash = 0;
+			for (auto coefficient : coefficients)
+				hash = hash << 1 | (coefficient > median ? 1 : 0);
+			return hash;
+		}
+	}
+
+	BGDEX_DECLARE_CC(uint64_t) perceptualHash(const ImageView& view, HashKind kind)
+	{
+		if (!view)
+			return 0;
+
+		return kind == HashKind::Perceptual ? dctHash(view) : differenceHash(view);
+	}
+
+	BGDEX_DECLARE_CC(bool) perceptualHashes(const gdImage* const* images, size_t count, HashKind kind, uint64_t* hashes)
+	{
+		if (!count)
+			return true;
+
+		size_t pixels = 0;
+		for (size_t i = 0; i < count; ++i)
+			pixels += images[i] ? (size_t)images[i]->sx * images[i]->sy : 0;
+
+		// one image per "row", costed at the average size
+		pixels::parallelRows((int)count, pixels / count, 1, [&](int begin, int end) {
+			for (int i = begin; i < end; ++i)
+				hashes[i] = perceptualHash(ImageView{ images[i] }, kind);
+		});
+		return !cancelled();
+	}
+
+	BGDEX_DECLARE_CC(std::vector<size_t>) findSimilar(const uint64_t* hashes, size_t count, uint64_t hash, int maxDistance)
+	{
+		std::vector<size_t> found;
+		for (size_t i = 0; i < count; ++i)
+		{
+			if (hammingDistance(hashes[i], hash) <= maxDistance)
+				found.push_back(i);
+		}
+		return found;
+	}
+};
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __GDEX_PIXELS_IMAGE_HPP__
+#define __GDEX_PIXELS_IMAGE_HPP__
+
+#include <gd.h>
+#include <string.h>
+
+namespace gd { namespace pixels {
+
+	// New image of the same kind as src: pixel format, palette,
+	// transparent color and alpha flags are carried over
+	inline gdImagePtr createLike(const gdImage* src, int width, int height)
+	{
+		auto img = src->trueColor ? gdImageCreateTrueColor(width, height) : gdImageCreate(width, height);
+		if (!img)
+			return nullptr;
+
+		if (!src->trueColor)
+		{
+			img->colorsTotal = src->colorsTotal;
+			memcpy(img->red, src->red, sizeof(img->red));
+			memcpy(img->green, src->green, sizeof(img->green));
+			memcpy(img->blue, src->blue, sizeof(img->blue));
+			memcpy(img->alpha, src->alpha, sizeof(img->alpha));
+			memcpy(img->open, src->open, sizeof(img->open));
+		}
+
+		img->transparent = src->transparent;
+		img->alphaBlendingFlag = src->alphaBlendingFlag;
+		img->saveAlphaFlag = src->saveAlphaFlag;
+		return img;
+	}
+}}
+
+#endif // __GDEX_PIXELS_IMAGE_HPP__
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __GDEX_PIXELS_LUMA_HPP__
+#define __GDEX_PIXELS_LUMA_HPP__
+
+#include <gd.h>
+
+namespace gd { namespace pixels {
+
+	// Rec. 601 luma of the color over black, so coverage counts as well
+	inline int luma(int px)
+	{
+		int y = (77 * gdTrueColorGetRed(px) + 150 * gdTrueColorGetGreen(px) + 29 * gdTrueColorGetBlue(px) + 128) >> 8;
+		int alpha = gdTrueColorGetAlpha(px);
+		if (!alpha)
+			return y;
+		return (y * (gdAlphaMax - alpha) + gdAlphaMax / 2) / gdAlphaMax;
+	}
+}}
+
+#endif // __GDEX_PIXELS_LUMA_HPP__
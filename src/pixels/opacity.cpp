@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "gdex.hpp"
+#include "pixels/simd.hpp"
+
+namespace gd
+{
+	namespace
+	{
+		enum Class : unsigned char
+		{
+			Solid = 0,
+			Hole = 1,  // fully transparent or the transparent color
+			Partial = 2
+		};
+
+		Opacity opacityOf(int classes)
+		{
+			return classes & Partial ? Opacity::FullAlpha
+				: classes & Hole ? Opacity::BinaryAlpha
+				: Opacity::Opaque;
+		}
+
+		// Stops at the first translucent pixel, which settles the answer
+		Opacity trueColorOpacity(const ImageView& view)
+		{
+			static const int alphaBits = 0x7F000000;
+			// gd pixels never have the top bit set, so -1 matches nothing
+			int key = view.image()->transparent < 0 ? -1 : view.image()->transparent;
+			int classes = Solid;
+			for (int y = 0; y < view.height(); ++y)
+			{
+				auto row = view.row(y);
+				int x = 0, width = view.width();
+#ifdef GDEX_HAS_SSE2
+				auto alpha = _mm_set1_epi32(alphaBits);
+				auto keys = _mm_set1_epi32(key);
+				auto zero = _mm_setzero_si128();
+				auto holes = zero;
+				for (; x + 4 <= width; x += 4)
+				{
+					auto px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x));
+					auto a = _mm_and_si128(px, alpha);
+					auto hole = _mm_or_si128(_mm_cmpeq_epi32(a, alpha), _mm_cmpeq_epi32(px, keys));
+					auto settled = _mm_or_si128(hole, _mm_cmpeq_epi32(a, zero));
+					if (_mm_movemask_epi8(settled) != 0xFFFF)
+						return Opacity::FullAlpha;
+					holes = _mm_or_si128(holes, hole);
+				}
+				if (_mm_movemask_epi8(holes))
+					classes |= Hole;
+#endif
+				for (; x < width; ++x)
+				{
+					int px = row[x];
+					int a = gdTrueColorGetAlpha(px);
+					if (a == gdAlphaTransparent || px == key)
+						classes |= Hole;
+					else if (a != gdAlphaOpaque)
+						return Opacity::FullAlpha;
+				}
+			}
+			return opacityOf(classes);
+		}
+
+		struct PaletteClasses
+		{
+			unsigned char classes[gdMaxColors];
+			int all;
+
+			explicit PaletteClasses(const gdImage* img)
+				: all(Solid)
+			{
+				for (int c = 0; c < gdMaxColors; ++c)
+				{
+					classes[c] = c == img->transparent || img->alpha[c] == gdAlphaTransparent ? Hole
+						: img->alpha[c] != gdAlphaOpaque ? Partial
+						: Solid;
+					all |= classes[c];
+				}
+			}
+		};
+
+		Opacity paletteOpacity(const ImageView& view)
+		{
+			PaletteClasses palette{ view.image() };
+			// nothing to look for when no entry lets anything through
+			if (palette.all == Solid)
+				return Opacity::Opaque;
+
+			int classes = Solid;
+			for (int y = 0; y < view.height(); ++y)
+			{
+				auto row = view.indexRow(y);
+				for (int x = 0, width = view.width(); x < width; ++x)
+					classes |= palette.classes[row[x]];
+				if (classes & Partial)
+					break;
+			}
+			return opacityOf(classes);
+		}
+	}
+
+	BGDEX_DECLARE_CC(Opacity) opacity(const ImageView& view)
+	{
+		if (!view)
+			return Opacity::Opaque;
+
+		return view.trueColor() ? trueColorOpacity(view) : paletteOpacity(view);
+	}
+};
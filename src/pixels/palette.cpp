@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "gdex.hpp"
+#include "pixels/cpu.hpp"
+#include "pixels/palette.hpp"
+#include "pixels/parallel.hpp"
+#include "pixels/simd.hpp"
+#include <string.h>
+
+namespace gd
+{
+	namespace pixels
+	{
+		namespace
+		{
+			void expandRowScalar(int* out, const unsigned char* row, int count, const int* colors)
+			{
+				for (int x = 0; x < count; ++x)
+					out[x] = colors[row[x]];
+			}
+
+#ifdef GDEX_HAS_SSE2
+			// no gather before AVX2: four lookups per 16-byte store
+			void expandRowSSE2(int* out, const unsigned char* row, int count, const int* colors)
+			{
+				int x = 0;
+				for (; x + 4 <= count; x += 4)
+				{
+					auto px = _mm_setr_epi32(colors[row[x]], colors[row[x + 1]], colors[row[x + 2]], colors[row[x + 3]]);
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), px);
+				}
+				expandRowScalar(out + x, row + x, count - x, colors);
+			}
+#endif
+
+#ifdef GDEX_HAS_AVX2
+			// eight indices widened to dwords, then one gather
+			GDEX_TARGET_AVX2 void expandRowAVX2(int* out, const unsigned char* row, int count, const int* colors)
+			{
+				int x = 0;
+				for (; x + 8 <= count; x += 8)
+				{
+					auto indices = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(row + x)));
+					_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x), _mm256_i32gather_epi32(colors, indices, 4));
+				}
+				expandRowScalar(out + x, row + x, count - x, colors);
+			}
+#endif
+
+			typedef void (*ExpandRow)(int* out, const unsigned char* row, int count, const int* colors);
+			ExpandRow expandRowImpl()
+			{
+				static const ExpandRow impl = dispatch<ExpandRow>(expandRowScalar,
+					GDEX_SSE2_KERNEL(expandRowSSE2), GDEX_AVX2_KERNEL(expandRowAVX2));
+				return impl;
+			}
+		}
+
+		void expandRow(int* out, const unsigned char* row, int count, const int* colors)
+		{
+			expandRowImpl()(out, row, count, colors);
+		}
+	}
+
+	BGDEX_DECLARE_CC(gdImagePtr) toTrueColor(const gdImage* src)
+	{
+		if (!src)
+			return nullptr;
+
+		auto dst = gdImageCreateTrueColor(src->sx, src->sy);
+		if (!dst)
+			return nullptr;
+
+		if (src->trueColor)
+		{
+			pixels::parallelRows(src->sy, src->sx, 1, [&](int begin, int end) {
+				for (int y = begin; y < end; ++y)
+					memcpy(dst->tpixels[y], src->tpixels[y], src->sx * sizeof(int));
+			});
+			dst->transparent = src->transparent;
+			dst->saveAlphaFlag = src->saveAlphaFlag;
+		}
+		else
+		{
+			pixels::PaletteTable table{ src };
+			pixels::parallelRows(src->sy, src->sx, 1, [&](int begin, int end) {
+				for (int y = begin; y < end; ++y)
+					pixels::expandRow(dst->tpixels[y], src->pixels[y], src->sx, table);
+			});
+
+			// what was transparent through the palette now is through alpha
+			bool alpha = src->transparent >= 0 && src->transparent < gdMaxColors;
+			for (int c = 0; c < src->colorsTotal && !alpha; ++c)
+				alpha = src->alpha[c] != gdAlphaOpaque;
+			dst->saveAlphaFlag = alpha ? 1 : src->saveAlphaFlag;
+		}
+
+		// rows left out; not worth handing over
+		if (cancelled())
+		{
+			gdImageDestroy(dst);
+			return nullptr;
+		}
+		return dst;
+	}
+};
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __GDEX_PIXELS_PALETTE_HPP__
+#define __GDEX_PIXELS_PALETTE_HPP__
+
+#include <gdex_view.hpp>
+#include <string.h>
+#include <vector>
+
+namespace gd { namespace pixels {
+
+	// Truecolor value of every palette index, with the transparent
+	// index already turned fully transparent, so expanding a row is a
+	// plain lookup with no per-pixel test
+	struct PaletteTable
+	{
+		int colors[gdMaxColors];
+
+		explicit PaletteTable(const gdImage* img)
+		{
+			for (int c = 0; c < gdMaxColors; ++c)
+			{
+				colors[c] = c == img->transparent
+					? gdTrueColorAlpha(0, 0, 0, gdAlphaTransparent)
+					: gdTrueColorAlpha(img->red[c], img->green[c], img->blue[c], img->alpha[c]);
+			}
+		}
+	};
+
+	// out[x] = colors[row[x]]
+	void expandRow(int* out, const unsigned char* row, int count, const int* colors);
+
+	inline void expandRow(int* out, const unsigned char* row, int count, const PaletteTable& table)
+	{
+		expandRow(out, row, count, table.colors);
+	}
+
+	// RowReader with the pixel format fixed at compile time, for
+	// kernels instantiated once per format: the truecolor reader is
+	// a bare row lookup, the palette one always expands
+	template <PixelFormat Format>
+	class FormatRows;
+
+	template <>
+	class FormatRows<PixelFormat::TrueColor>
+	{
+		ImageView view;
+
+	public:
+		explicit FormatRows(const ImageView& view) : view(view) {}
+
+		const int* row(int y) { return view.row(y); }
+		void row(int y, int* out) { memcpy(out, view.row(y), sizeof(int) * view.width()); }
+	};
+
+	template <>
+	class FormatRows<PixelFormat::Palette>
+	{
+		ImageView view;
+		PaletteTable palette;
+		std::vector<int> expanded;
+
+	public:
+		explicit FormatRows(const ImageView& view)
+			: view(view)
+			, palette(view.image())
+			, expanded(view.width())
+		{
+		}
+
+		const int* row(int y)
+		{
+			expandRow(expanded.data(), view.indexRow(y), view.width(), palette);
+			return expanded.data();
+		}
+
+		// straight into the caller's row, skipping the buffer
+		void row(int y, int* out) { expandRow(out, view.indexRow(y), view.width(), palette); }
+	};
+
+	// Truecolor rows of a view, palette ones expanded into a buffer
+	// owned by the reader, so every thread needs a reader of its own
+	class RowReader
+	{
+		ImageView view;
+		PaletteTable palette;
+		std::vector<int> expanded;
+
+	public:
+		explicit RowReader(const ImageView& view)
+			: view(view)
+			, palette(view.image())
+			, expanded(view.trueColor() ? 0 : view.width())
+		{
+		}
+
+		const int* row(int y)
+		{
+			if (view.trueColor())
+				return view.row(y);
+
+			expandRow(expanded.data(), view.indexRow(y), view.width(), palette);
+			return expanded.data();
+		}
+	};
+}}
+
+#endif // __GDEX_PIXELS_PALETTE_HPP__
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __GDEX_PIXELS_PARALLEL_HPP__
+#define __GDEX_PIXELS_PARALLEL_HPP__
+
+#include "pixels/pool.hpp"
+#include <algorithm>
+
+namespace gd { namespace pixels {
+
+	// Below this many pixels handing work to other threads costs more
+	// than it saves
+	static const size_t minParallelWork = 1 << 18;
+	// Bands per thread; more than one lets a thread which got a cheap
+	// band, or started late, take over work from the others
+	static const size_t bandsPerThread = 4;
+
+	// How many threads rows * rowCost pixels of work is worth
+	inline size_t parallelThreads(int rows, size_t rowCost)
+	{
+		if (rows <= 0)
+			return 1;
+		auto threads = std::min(WorkPool::shared().size() + 1, (size_t)rows * rowCost / minParallelWork);
+		return std::max(threads, (size_t)1);
+	}
+
+	// Calls fn(begin, end) over bands of [0, rows) on the shared pool,
+	// the calling thread included, when the amount of work justifies
+	// it. Band boundaries are multiples of align, so blocked kernels
+	// never share a block between threads. Under a cancelToken(), no
+	// band starts once it is cancelled; work too small to share is
+	// then cut into bands anyway, to be checked between them.
+	template <typename Fn>
+	void parallelRows(int rows, size_t rowCost, int align, Fn fn)
+	{
+		auto token = cancelToken();
+		auto threads = parallelThreads(rows, rowCost);
+		auto blocks = (size_t)(rows + align - 1) / align;
+		auto bands = std::min(threads * bandsPerThread, blocks);
+		if (threads < 2 || bands < 2)
+		{
+			if (!token)
+			{
+				fn(0, rows);
+				return;
+			}
+
+			auto perBand = std::max(minParallelWork / bandsPerThread / std::max(rowCost, (size_t)1), (size_t)1);
+			int band = (int)std::min((perBand + align - 1) / align, blocks) * align;
+			for (int begin = 0; begin < rows && !token->cancelled(); begin += band)
+				fn(begin, std::min(rows, begin + band));
+			return;
+		}
+
+		int band = (int)((blocks + bands - 1) / bands) * align;
+		int count = (rows + band - 1) / band;
+		runParallel(count, [&](int index)
+		{
+			if (token && token->cancelled())
+				return;
+			fn(index * band, std::min(rows, (index + 1) * band));
+		});
+	}
+
+	// parallelRows for stencils which read rows around the ones they
+	// write: fn(begin, end, from, to) produces rows [begin, end) and
+	// may read [from, to), the band widened by halo rows on either side
+	// and clamped to [0, rows). Halo rows are computed by both bands
+	// next to them, so bands are kept well above the halo in height.
+	template <typename Fn>
+	void parallelBands(int rows, size_t rowCost, int halo, Fn fn)
+	{
+		// bands come in multiples of the alignment
+		int minBand = std::max(1, 8 * halo);
+		parallelRows(rows, rowCost, minBand, [&](int begin, int end)
+		{
+			fn(begin, end, std::max(0, begin - halo), std::min(rows, end + halo));
+		});
+	}
+}}
+
+#endif // __GDEX_PIXELS_PARALLEL_HPP__
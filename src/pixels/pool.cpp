@@ -0,0 +1,497 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pixels/pool.hpp"
+#include <algorithm>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#ifdef _MSC_VER
+#define GDEX_THREAD_LOCAL __declspec(thread)
+#else
+#define GDEX_THREAD_LOCAL __thread
+#endif
+
+namespace gd
+{
+	namespace
+	{
+		// index of the pool worker running on this thread, if any
+		GDEX_THREAD_LOCAL int currentWorker = -1;
+		// set on IoQueue threads
+		GDEX_THREAD_LOCAL bool ioThread = false;
+		// workPriority() of this thread
+		GDEX_THREAD_LOCAL int currentPriority = (int)Priority::Interactive;
+		// cancelToken() of this thread
+		GDEX_THREAD_LOCAL const CancelToken* currentToken = nullptr;
+
+		// The CPUs this process may run on, which under taskset, job
+		// objects or container limits is fewer than the machine has
+		std::vector<int> allowedCpus()
+		{
+			std::vector<int> cpus;
+#if defined(_WIN32)
+			// the first processor group only
+			DWORD_PTR process = 0, system = 0;
+			if (GetProcessAffinityMask(GetCurrentProcess(), &process, &system))
+			{
+				for (int cpu = 0; cpu < (int)sizeof(DWORD_PTR) * 8; ++cpu)
+				{
+					if (process & ((DWORD_PTR)1 << cpu))
+						cpus.push_back(cpu);
+				}
+			}
+#elif defined(__linux__)
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			if (!sched_getaffinity(0, sizeof(set), &set))
+			{
+				for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+				{
+					if (CPU_ISSET(cpu, &set))
+						cpus.push_back(cpu);
+				}
+			}
+#endif
+			if (cpus.empty())
+			{
+				for (int cpu = 0, count = (int)std::thread::hardware_concurrency(); cpu < count; ++cpu)
+					cpus.push_back(cpu);
+			}
+			return cpus;
+		}
+
+		size_t cores()
+		{
+			return std::max((size_t)1, allowedCpus().size());
+		}
+
+		void pin(std::thread& thread, int cpu)
+		{
+#if defined(_WIN32)
+			SetThreadAffinityMask(thread.native_handle(), (DWORD_PTR)1 << cpu);
+#elif defined(__linux__)
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			CPU_SET(cpu, &set);
+			pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#else
+			// no affinity API to speak of; workers stay unpinned
+			(void)thread;
+			(void)cpu;
+#endif
+		}
+
+		void runTask(const std::function<void()>& task, Priority priority)
+		{
+			struct Restore
+			{
+				int saved;
+				~Restore() { currentPriority = saved; }
+			} restore = { currentPriority };
+
+			currentPriority = (int)priority;
+			task();
+		}
+
+		// Hands the submitting thread's token on to the task; a copy, as
+		// the task may outlive the scope that set it
+		std::function<void()> withToken(std::function<void()> task)
+		{
+			if (!currentToken)
+				return task;
+
+			struct Scoped
+			{
+				std::function<void()> task;
+				CancelToken token;
+
+				void operator()() const
+				{
+					CancelScope scope{ token };
+					task();
+				}
+			};
+			Scoped scoped = { std::move(task), *currentToken };
+			return scoped;
+		}
+
+		// shared by the callers and the helper tasks, which may still be
+		// queued when the caller returns
+		struct Group
+		{
+			const std::function<void(int)>* body;
+			int count;
+			std::atomic<int> next;
+			std::atomic<int> left;
+			std::mutex lock;
+			std::condition_variable done;
+
+			Group(const std::function<void(int)>* body, int count)
+				: body(body), count(count), next(0), left(count)
+			{
+			}
+
+			// body is only touched for claimed indices, and the caller
+			// waits for those, so late helpers never see it dangling
+			void work()
+			{
+				for (;;)
+				{
+					int index = next++;
+					if (index >= count)
+						return;
+
+					(*body)(index);
+					if (--left == 0)
+					{
+						std::lock_guard<std::mutex> guard{ lock };
+						done.notify_all();
+					}
+				}
+			}
+		};
+	}
+
+	namespace pixels
+	{
+		// constructed with the library; no thread starts before submit
+		static WorkPool pool;
+		static IoQueue io;
+		// one configure() at a time
+		static std::mutex configuring;
+
+		WorkPool& WorkPool::shared()
+		{
+			return pool;
+		}
+
+		WorkPool::WorkPool()
+			: workers(cores() - 1)
+			, pinned(false)
+			, started(false)
+			, pending(0)
+			, next(0)
+			, stopping(false)
+		{
+		}
+
+		WorkPool::~WorkPool()
+		{
+			stop(0, false);
+		}
+
+		bool WorkPool::configure(const PoolOptions& options)
+		{
+			// stopping waits for every pool and I/O thread, this one too
+			if (currentWorker >= 0 || ioThread)
+				return false;
+
+			std::lock_guard<std::mutex> guard{ configuring };
+			stop(options.threads < 0 ? cores() - 1 : (size_t)options.threads, options.pinned);
+			io.configure(options);
+			return true;
+		}
+
+		// with state held
+		void WorkPool::start()
+		{
+			auto cpus = allowedCpus();
+			for (size_t i = 0; i < workers; ++i)
+				queues.emplace_back(new Queue);
+			for (size_t i = 0; i < workers; ++i)
+			{
+				threads.emplace_back(&WorkPool::run, this, i);
+				if (pinned && !cpus.empty())
+					pin(threads.back(), cpus[i % cpus.size()]);
+			}
+			started = true;
+		}
+
+		// Workers leave once nothing is queued, so everything submitted
+		// before, or by the tasks still running, gets done. The new size
+		// is set in the same critical section that lets them go: a
+		// submit in between either runs inline or starts the new pool.
+		void WorkPool::stop(size_t count, bool pin)
+		{
+			std::vector<std::thread> leaving;
+			{
+				std::lock_guard<std::mutex> guard{ state };
+				workers = count;
+				pinned = pin;
+				if (!started)
+					return;
+				leaving.swap(threads);
+				std::lock_guard<std::mutex> sleeping{ sleepLock };
+				stopping = true;
+			}
+			wake.notify_all();
+			for (auto& thread : leaving)
+				thread.join();
+
+			std::lock_guard<std::mutex> guard{ state };
+			queues.clear();
+			started = false;
+			stopping = false;
+		}
+
+		void WorkPool::submit(Task task, Priority priority)
+		{
+			task = withToken(std::move(task));
+			{
+				std::unique_lock<std::mutex> guard{ state };
+				if (workers && !stopping)
+				{
+					if (!started)
+						start();
+
+					auto index = currentWorker >= 0 && (size_t)currentWorker < queues.size()
+						? (size_t)currentWorker
+						: next++ % queues.size();
+					{
+						std::lock_guard<std::mutex> queued{ queues[index]->lock };
+						queues[index]->tasks[(int)priority].push_back(std::move(task));
+					}
+					{
+						std::lock_guard<std::mutex> sleeping{ sleepLock };
+						++pending;
+					}
+					guard.unlock();
+					wake.notify_one();
+					return;
+				}
+			}
+
+			// no workers, or they are on their way out
+			runTask(task, priority);
+		}
+
+		bool WorkPool::pop(size_t index, Task& task, Priority& priority)
+		{
+			auto count = queues.size();
+			for (int lane = 0; lane < lanes; ++lane)
+			{
+				for (size_t i = 0; i < count; ++i)
+				{
+					auto& queue = *queues[(index + i) % count];
+					std::lock_guard<std::mutex> guard{ queue.lock };
+					auto& tasks = queue.tasks[lane];
+					if (tasks.empty())
+						continue;
+
+					// own tasks newest first, stolen ones oldest first
+					if (i == 0)
+					{
+						task = std::move(tasks.back());
+						tasks.pop_back();
+					}
+					else
+					{
+						task = std::move(tasks.front());
+						tasks.pop_front();
+					}
+					priority = (Priority)lane;
+					--pending;
+					return true;
+				}
+			}
+			return false;
+		}
+
+		void WorkPool::run(size_t index)
+		{
+			currentWorker = (int)index;
+			for (;;)
+			{
+				Task task;
+				Priority priority;
+				if (pop(index, task, priority))
+				{
+					runTask(task, priority);
+					continue;
+				}
+
+				std::unique_lock<std::mutex> guard{ sleepLock };
+				wake.wait(guard, [&] { return stopping || pending > 0; });
+				if (stopping && pending <= 0)
+					return;
+			}
+		}
+
+		IoQueue& IoQueue::shared()
+		{
+			return io;
+		}
+
+		IoQueue::IoQueue()
+			: size(2)
+			, stopping(false)
+		{
+		}
+
+		IoQueue::~IoQueue()
+		{
+			stop(size);
+
+			// pool tasks finishing during unload read inline
+			std::lock_guard<std::mutex> guard{ lock };
+			stopping = true;
+		}
+
+		// called by WorkPool::configure, under its lock
+		void IoQueue::configure(const PoolOptions& options)
+		{
+			stop((size_t)std::max(1, options.ioThreads));
+		}
+
+		void IoQueue::submit(Task task, Priority priority)
+		{
+			task = withToken(std::move(task));
+			{
+				std::lock_guard<std::mutex> guard{ lock };
+				if (!stopping)
+				{
+					if (threads.empty())
+					{
+						for (size_t i = 0; i < size; ++i)
+							threads.emplace_back(&IoQueue::run, this);
+					}
+					tasks.emplace_back(std::move(task), priority);
+					wake.notify_one();
+					return;
+				}
+			}
+
+			// on the way out, same as WorkPool::submit
+			runTask(task, priority);
+		}
+
+		// Threads leave once the queue is empty, like WorkPool's, and
+		// the next submit starts count new ones
+		void IoQueue::stop(size_t count)
+		{
+			std::vector<std::thread> leaving;
+			{
+				std::lock_guard<std::mutex> guard{ lock };
+				size = count;
+				leaving.swap(threads);
+				stopping = true;
+			}
+			wake.notify_all();
+			for (auto& thread : leaving)
+				thread.join();
+
+			std::lock_guard<std::mutex> guard{ lock };
+			stopping = false;
+		}
+
+		void IoQueue::run()
+		{
+			ioThread = true;
+			std::unique_lock<std::mutex> guard{ lock };
+			for (;;)
+			{
+				wake.wait(guard, [&] { return stopping || !tasks.empty(); });
+				if (tasks.empty())
+					return;
+
+				auto next = std::move(tasks.front());
+				tasks.pop_front();
+				guard.unlock();
+				runTask(next.first, next.second);
+				guard.lock();
+			}
+		}
+
+		bool onPoolWorker()
+		{
+			return currentWorker >= 0;
+		}
+
+		bool onIoThread()
+		{
+			return ioThread;
+		}
+
+		void runParallel(int count, const std::function<void(int)>& body)
+		{
+			auto& workers = WorkPool::shared();
+			int helpers = count > 1 ? (int)std::min((size_t)count - 1, workers.size()) : 0;
+			if (helpers <= 0)
+			{
+				for (int i = 0; i < count; ++i)
+					body(i);
+				return;
+			}
+
+			auto group = std::make_shared<Group>(&body, count);
+			for (int i = 0; i < helpers; ++i)
+				workers.submit([group] { group->work(); }, (Priority)currentPriority);
+			group->work();
+
+			std::unique_lock<std::mutex> guard{ group->lock };
+			group->done.wait(guard, [&] { return group->left == 0; });
+		}
+	}
+
+	BGDEX_DECLARE_CC(bool) configurePool(const PoolOptions& options)
+	{
+		return pixels::WorkPool::shared().configure(options);
+	}
+
+	BGDEX_DECLARE_CC(int) poolThreads()
+	{
+		return (int)pixels::WorkPool::shared().size();
+	}
+
+	BGDEX_DECLARE_CC(void) post(Priority priority, const std::function<void()>& task)
+	{
+		pixels::WorkPool::shared().submit(task, priority);
+	}
+
+	BGDEX_DECLARE_CC(Priority) workPriority()
+	{
+		return (Priority)currentPriority;
+	}
+
+	BGDEX_DECLARE_CC(void) setWorkPriority(Priority priority)
+	{
+		currentPriority = (int)priority;
+	}
+
+	BGDEX_DECLARE_CC(const CancelToken*) cancelToken()
+	{
+		return currentToken;
+	}
+
+	BGDEX_DECLARE_CC(void) setCancelToken(const CancelToken* token)
+	{
+		currentToken = token;
+	}
+};
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __GDEX_PIXELS_POOL_HPP__
+#define __GDEX_PIXELS_POOL_HPP__
+
+#include "gdex.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gd { namespace pixels {
+
+	// Worker threads shared by every parallel kernel, started on first
+	// use. Each worker owns a deque per priority lane: tasks it submits
+	// itself go to the back and are taken from there, idle workers steal
+	// from the front of the others. Tasks from other threads are dealt
+	// round-robin. No bulk task is taken while an interactive one waits.
+	class WorkPool
+	{
+	public:
+		typedef std::function<void()> Task;
+
+		WorkPool();
+		~WorkPool();
+		WorkPool(const WorkPool&) = delete;
+		WorkPool& operator=(const WorkPool&) = delete;
+
+		static WorkPool& shared();
+
+		// worker threads; callers of runParallel make one more
+		size_t size() const { return workers; }
+		// false from a pool or I/O thread, which could not wait for itself
+		bool configure(const PoolOptions& options);
+		void submit(Task task, Priority priority);
+
+	private:
+		static const int lanes = 2;
+
+		struct Queue
+		{
+			std::mutex lock;
+			std::deque<Task> tasks[lanes];
+		};
+
+		std::atomic<size_t> workers;
+		bool pinned;
+		std::vector<std::unique_ptr<Queue>> queues;
+		std::vector<std::thread> threads;
+		// guards the three above and the started and stopping flags
+		std::mutex state;
+		bool started;
+
+		std::mutex sleepLock;
+		std::condition_variable wake;
+		std::atomic<int> pending;
+		std::atomic<size_t> next;
+		bool stopping;
+
+		void start();
+		void stop(size_t count, bool pin);
+		bool pop(size_t index, Task& task, Priority& priority);
+		void run(size_t index);
+	};
+
+	// Plain FIFO served by a few threads that are expected to block,
+	// reading files for the asynchronous API. Kept away from WorkPool so
+	// a slow disk never holds up a core.
+	class IoQueue
+	{
+	public:
+		typedef std::function<void()> Task;
+
+		IoQueue();
+		~IoQueue();
+		IoQueue(const IoQueue&) = delete;
+		IoQueue& operator=(const IoQueue&) = delete;
+
+		static IoQueue& shared();
+
+		void configure(const PoolOptions& options);
+		// task runs with the given workPriority()
+		void submit(Task task, Priority priority);
+
+	private:
+		size_t size;
+		std::vector<std::thread> threads;
+		std::deque<std::pair<Task, Priority>> tasks;
+		// guards everything above and stopping
+		std::mutex lock;
+		std::condition_variable wake;
+		bool stopping;
+
+		void stop(size_t count);
+		void run();
+	};
+
+	// whether the calling thread is one of WorkPool's, or IoQueue's
+	bool onPoolWorker();
+	bool onIoThread();
+
+	// Calls body(0) .. body(count - 1) on the pool and on the calling
+	// thread, which claims indices like any worker does, so a busy pool
+	// or a nested call never leaves it waiting on work nobody runs.
+	// Helpers queue in the caller's workPriority() lane. Returns once
+	// every call has returned.
+	void runParallel(int count, const std::function<void(int)>& body);
+}}
+
+#endif // __GDEX_PIXELS_POOL_HPP__
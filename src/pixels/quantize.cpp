@@ -0,0 +1,550 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "gdex.hpp"
+#include "pixels/palette.hpp"
+#include "pixels/parallel.hpp"
+#include "pixels/simd.hpp"
+#include <limits.h>
+
+namespace gd
+{
+	namespace
+	{
+		// Histogram cube: 5 bits of each color channel and the top 3
+		// bits of alpha. Fully transparent pixels all go to one extra
+		// cell, so they end up sharing a single transparent entry.
+		static const int cubeSize = 1 << 18;
+		static const int transparentCell = cubeSize;
+
+		inline int cellOf(int px)
+		{
+			if (gdTrueColorGetAlpha(px) == gdAlphaTransparent)
+				return transparentCell;
+
+			return ((px >> 28) & 7) << 15 | ((px >> 19) & 31) << 10 | ((px >> 11) & 31) << 5 | ((px >> 3) & 31);
+		}
+
+		// Pixels inside a cell differ only in the bits the cell drops,
+		// so only those are summed. A single-color image puts all of
+		// its pixels into one cell, and up to 2^31 of them times 15
+		// does not fit 32 bits, hence the wider sums.
+		struct Cell
+		{
+			uint32_t count;
+			uint64_t red;
+			uint64_t green;
+			uint64_t blue;
+			uint64_t alpha;
+		};
+
+		// Color with alpha doubled to 0..254, so all four channels
+		// weigh the same in distances
+		enum { Red, Green, Blue, Alpha };
+		struct Color
+		{
+			float c[4];
+		};
+
+		struct Entry
+		{
+			Color color;
+			uint32_t count;
+			int cell;
+		};
+
+		Color cellMean(int cell, const Cell& stats)
+		{
+			double scale = 1.0 / stats.count;
+			return{ {
+				((cell >> 10) & 31) * 8 + (float)(stats.red * scale),
+				((cell >> 5) & 31) * 8 + (float)(stats.green * scale),
+				(cell & 31) * 8 + (float)(stats.blue * scale),
+				(((cell >> 15) & 7) * 16 + (float)(stats.alpha * scale)) * 2
+			} };
+		}
+
+		Color cellCenter(int cell)
+		{
+			return{ {
+				((cell >> 10) & 31) * 8 + 3.5f,
+				((cell >> 5) & 31) * 8 + 3.5f,
+				(cell & 31) * 8 + 3.5f,
+				(((cell >> 15) & 7) * 16 + 7.5f) * 2
+			} };
+		}
+
+		class Histogram
+		{
+			std::vector<Cell> cells;
+			uint32_t transparent;
+
+		public:
+			explicit Histogram(const gdImage* src)
+				: cells(cubeSize)
+				, transparent(0)
+			{
+				// one pass on this thread, which stops between bands of
+				// rows once cancelled, as the parallel passes do
+				int band = (int)std::max(pixels::minParallelWork / pixels::bandsPerThread / (size_t)std::max(src->sx, 1), (size_t)1);
+				pixels::RowReader rows{ ImageView{ src } };
+				for (int y = 0; y < src->sy; ++y)
+				{
+					if (y % band == 0 && cancelled())
+						return;
+
+					auto row = rows.row(y);
+					for (int x = 0; x < src->sx; ++x)
+					{
+						int px = row[x];
+						int cell = cellOf(px);
+						if (cell == transparentCell)
+						{
+							++transparent;
+							continue;
+						}
+
+						auto& stats = cells[cell];
+						++stats.count;
+						stats.red += (px >> 16) & 7;
+						stats.green += (px >> 8) & 7;
+						stats.blue += px & 7;
+						stats.alpha += (px >> 24) & 15;
+					}
+				}
+			}
+
+			bool hasTransparent() const { return transparent != 0; }
+
+			std::vector<Entry> entries() const
+			{
+				std::vector<Entry> out;
+				for (int cell = 0; cell < cubeSize; ++cell)
+				{
+					if (cells[cell].count)
+						out.push_back({ cellMean(cell, cells[cell]), cells[cell].count, cell });
+				}
+				return out;
+			}
+
+		};
+
+		// Nearest palette entry by squared distance. Entries are kept as
+		// interleaved 16-bit (red, green) and (blue, alpha) pairs, so one
+		// _mm_madd_epi16 per pair scores four entries at once; the entry
+		// index rides in the low byte of the score, and the smallest
+		// score names the nearest entry, lowest index on ties.
+		class PaletteSearch
+		{
+			std::vector<int16_t> rg;
+			std::vector<int16_t> ba;
+			int count;
+
+		public:
+			explicit PaletteSearch(const std::vector<Color>& palette)
+				: count((int)palette.size())
+			{
+				// padded with copies of the last entry, which never win
+				int padded = (count + 3) & ~3;
+				rg.resize(padded * 2);
+				ba.resize(padded * 2);
+				for (int i = 0; i < padded; ++i)
+				{
+					auto& color = palette[std::min(i, count - 1)];
+					rg[i * 2] = (int16_t)(color.c[Red] + 0.5f);
+					rg[i * 2 + 1] = (int16_t)(color.c[Green] + 0.5f);
+					ba[i * 2] = (int16_t)(color.c[Blue] + 0.5f);
+					ba[i * 2 + 1] = (int16_t)(color.c[Alpha] + 0.5f);
+				}
+			}
+
+			int nearest(const Color& color) const
+			{
+				return nearest((int)(color.c[Red] + 0.5f), (int)(color.c[Green] + 0.5f),
+					(int)(color.c[Blue] + 0.5f), (int)(color.c[Alpha] + 0.5f));
+			}
+
+			int nearest(int r, int g, int b, int a) const
+			{
+				int i = 0;
+				int best = INT_MAX;
+#ifdef GDEX_HAS_SSE2
+				auto qrg = _mm_set1_epi32(g << 16 | r);
+				auto qba = _mm_set1_epi32(a << 16 | b);
+				auto index = _mm_setr_epi32(0, 1, 2, 3);
+				auto step = _mm_set1_epi32(4);
+				auto keys = _mm_set1_epi32(INT_MAX);
+				for (; i < count; i += 4)
+				{
+					auto d0 = _mm_sub_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&rg[i * 2])), qrg);
+					auto d1 = _mm_sub_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&ba[i * 2])), qba);
+					auto dist = _mm_add_epi32(_mm_madd_epi16(d0, d0), _mm_madd_epi16(d1, d1));
+					auto key = _mm_or_si128(_mm_slli_epi32(dist, 8), index);
+					auto less = _mm_cmplt_epi32(key, keys);
+					keys = _mm_or_si128(_mm_and_si128(less, key), _mm_andnot_si128(less, keys));
+					index = _mm_add_epi32(index, step);
+				}
+
+				int lanes[4];
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), keys);
+				for (int lane : lanes)
+					best = std::min(best, lane);
+#endif
+				for (; i < count; ++i)
+				{
+					int dr = rg[i * 2] - r, dg = rg[i * 2 + 1] - g;
+					int db = ba[i * 2] - b, da = ba[i * 2 + 1] - a;
+					best = std::min(best, (dr * dr + dg * dg + db * db + da * da) << 8 | i);
+				}
+				return best & 255;
+			}
+		};
+
+		struct Box
+		{
+			int begin;
+			int end;
+			double weight;
+			int channel;
+			float range;
+		};
+
+		Box measure(const std::vector<Entry>& entries, int begin, int end)
+		{
+			Box box{ begin, end, 0.0, 0, 0.0f };
+			float lo[4] = { 255.0f, 255.0f, 255.0f, 255.0f };
+			float hi[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			for (int i = begin; i < end; ++i)
+			{
+				box.weight += entries[i].count;
+				for (int ch = 0; ch < 4; ++ch)
+				{
+					lo[ch] = std::min(lo[ch], entries[i].color.c[ch]);
+					hi[ch] = std::max(hi[ch], entries[i].color.c[ch]);
+				}
+			}
+
+			for (int ch = 0; ch < 4; ++ch)
+			{
+				if (hi[ch] - lo[ch] > box.range)
+				{
+					box.range = hi[ch] - lo[ch];
+					box.channel = ch;
+				}
+			}
+			return box;
+		}
+
+		Color boxMean(const std::vector<Entry>& entries, const Box& box)
+		{
+			double sum[4] = {};
+			for (int i = box.begin; i < box.end; ++i)
+			{
+				for (int ch = 0; ch < 4; ++ch)
+					sum[ch] += (double)entries[i].color.c[ch] * entries[i].count;
+			}
+
+			Color out;
+			for (int ch = 0; ch < 4; ++ch)
+				out.c[ch] = (float)(sum[ch] / box.weight);
+			return out;
+		}
+
+		// Median cut over the occupied cells: the box with the most
+		// pixels times extent is split at the weighted median of its
+		// widest channel, until there are as many boxes as colors
+		std::vector<Color> medianCut(std::vector<Entry>& entries, int colors)
+		{
+			std::vector<Box> boxes;
+			boxes.push_back(measure(entries, 0, (int)entries.size()));
+
+			while ((int)boxes.size() < colors)
+			{
+				int pick = -1;
+				double score = 0.0;
+				for (size_t i = 0; i < boxes.size(); ++i)
+				{
+					double candidate = boxes[i].range * boxes[i].weight;
+					if (boxes[i].end - boxes[i].begin > 1 && candidate > score)
+					{
+						score = candidate;
+						pick = (int)i;
+					}
+				}
+				if (pick < 0)
+					break;
+
+				auto box = boxes[pick];
+				int ch = box.channel;
+				std::sort(entries.begin() + box.begin, entries.begin() + box.end, [ch](const Entry& lhs, const Entry& rhs) {
+					return lhs.color.c[ch] < rhs.color.c[ch];
+				});
+
+				double half = box.weight / 2, running = 0.0;
+				int split = box.begin + 1;
+				for (; split < box.end - 1; ++split)
+				{
+					running += entries[split - 1].count;
+					if (running >= half)
+						break;
+				}
+
+				boxes[pick] = measure(entries, box.begin, split);
+				boxes.push_back(measure(entries, split, box.end));
+			}
+
+			std::vector<Color> palette;
+			palette.reserve(boxes.size());
+			for (auto& box : boxes)
+				palette.push_back(boxMean(entries, box));
+			return palette;
+		}
+
+		// Lloyd iterations over the cells, weighted by pixel counts;
+		// an entry nothing maps to keeps its previous color
+		void refine(std::vector<Color>& palette, const std::vector<Entry>& entries, int iterations)
+		{
+			std::vector<double> sums(palette.size() * 5);
+			for (int pass = 0; pass < iterations; ++pass)
+			{
+				PaletteSearch search{ palette };
+				std::fill(sums.begin(), sums.end(), 0.0);
+				for (auto& entry : entries)
+				{
+					auto sum = &sums[search.nearest(entry.color) * 5];
+					for (int ch = 0; ch < 4; ++ch)
+						sum[ch] += (double)entry.color.c[ch] * entry.count;
+					sum[4] += entry.count;
+				}
+
+				for (size_t i = 0; i < palette.size(); ++i)
+				{
+					auto sum = &sums[i * 5];
+					if (!sum[4])
+						continue;
+					for (int ch = 0; ch < 4; ++ch)
+						palette[i].c[ch] = (float)(sum[ch] / sum[4]);
+				}
+			}
+		}
+
+		inline int clampChannel(int value, int max)
+		{
+			return std::max(0, std::min(max, value));
+		}
+
+		class Mapper
+		{
+			const gdImage* src;
+			gdImagePtr dst;
+			const PaletteSearch& search;
+			int transparentIndex;
+			// nearest entry per cell, -1 until asked for
+			std::vector<int16_t> nearest;
+
+		public:
+			Mapper(const gdImage* src, gdImagePtr dst, const PaletteSearch& search, int transparentIndex)
+				: src(src)
+				, dst(dst)
+				, search(search)
+				, transparentIndex(transparentIndex)
+				, nearest(cubeSize + 1, -1)
+			{
+				nearest[transparentCell] = (int16_t)transparentIndex;
+			}
+
+			// Every cell a source pixel falls into is looked up up front,
+			// which leaves the table read-only and the rows independent
+			void map(const std::vector<Entry>& entries)
+			{
+				for (auto& entry : entries)
+					nearest[entry.cell] = (int16_t)search.nearest(entry.color);
+
+				pixels::parallelRows(src->sy, src->sx, 1, [&](int begin, int end) {
+					pixels::RowReader rows{ ImageView{ src } };
+					for (int y = begin; y < end; ++y)
+					{
+						auto in = rows.row(y);
+						auto out = dst->pixels[y];
+						for (int x = 0; x < src->sx; ++x)
+							out[x] = (unsigned char)nearest[cellOf(in[x])];
+					}
+				});
+			}
+
+			// Serpentine Floyd-Steinberg; each row takes the error of the
+			// one above, so this pass stays on one thread
+			void dither()
+			{
+				int width = src->sx;
+				// per channel, in 1/16 units, one pixel of padding each side
+				std::vector<int> errors((width + 2) * 8, 0);
+				int* current = errors.data();
+				int* next = errors.data() + (width + 2) * 4;
+				pixels::RowReader rows{ ImageView{ src } };
+				// local copies, which the stores below cannot alias
+				int red[gdMaxColors], green[gdMaxColors], blue[gdMaxColors], alpha[gdMaxColors];
+				std::copy(dst->red, dst->red + gdMaxColors, red);
+				std::copy(dst->green, dst->green + gdMaxColors, green);
+				std::copy(dst->blue, dst->blue + gdMaxColors, blue);
+				std::copy(dst->alpha, dst->alpha + gdMaxColors, alpha);
+
+				for (int y = 0; y < src->sy && !cancelled(); ++y)
+				{
+					auto in = rows.row(y);
+					auto out = dst->pixels[y];
+					bool reverse = (y & 1) != 0;
+					int dir = reverse ? -1 : 1;
+					std::fill(next, next + (width + 2) * 4, 0);
+					// error pushed to the next pixel in the row, kept out
+					// of memory to shorten the pixel to pixel dependency
+					int carry[4] = {};
+
+					for (int i = 0; i < width; ++i)
+					{
+						int x = reverse ? width - 1 - i : i;
+						int px = in[x];
+						if (gdTrueColorGetAlpha(px) == gdAlphaTransparent)
+						{
+							out[x] = (unsigned char)transparentIndex;
+							carry[Red] = carry[Green] = carry[Blue] = carry[Alpha] = 0;
+							continue;
+						}
+
+						auto err = current + (x + 1) * 4;
+						int value[4] = {
+							clampChannel(gdTrueColorGetRed(px) + ((err[Red] + carry[Red] + 8) >> 4), 255),
+							clampChannel(gdTrueColorGetGreen(px) + ((err[Green] + carry[Green] + 8) >> 4), 255),
+							clampChannel(gdTrueColorGetBlue(px) + ((err[Blue] + carry[Blue] + 8) >> 4), 255),
+							clampChannel(gdTrueColorGetAlpha(px) + ((err[Alpha] + carry[Alpha] + 8) >> 4), gdAlphaTransparent - 1)
+						};
+
+						int index = lookup(gdTrueColorAlpha(value[Red], value[Green], value[Blue], value[Alpha]));
+						out[x] = (unsigned char)index;
+
+						int chosen[4] = { red[index], green[index], blue[index], alpha[index] };
+						auto below = next + (x + 1) * 4;
+						for (int ch = 0; ch < 4; ++ch)
+						{
+							int diff = value[ch] - chosen[ch];
+							carry[ch] = diff * 7;
+							below[ch - dir * 4] += diff * 3;
+							below[ch] += diff * 5;
+							below[ch + dir * 4] += diff;
+						}
+					}
+					std::swap(current, next);
+				}
+			}
+
+		private:
+			int lookup(int px)
+			{
+				int cell = cellOf(px);
+				if (nearest[cell] < 0)
+					nearest[cell] = (int16_t)search.nearest(cellCenter(cell));
+				return nearest[cell];
+			}
+		};
+	}
+
+	BGDEX_DECLARE_CC(gdImagePtr) quantize(const gdImage* src, const QuantizeOptions& options)
+	{
+		if (!src)
+			return nullptr;
+
+		auto dst = gdImageCreate(src->sx, src->sy);
+		if (!dst)
+			return nullptr;
+
+		int colors = std::max(2, std::min(gdMaxColors, options.colors));
+
+		Histogram histogram{ src };
+		if (cancelled())
+		{
+			gdImageDestroy(dst);
+			return nullptr;
+		}
+
+		auto entries = histogram.entries();
+		int opaque = histogram.hasTransparent() ? colors - 1 : colors;
+
+		std::vector<Color> palette;
+		if ((int)entries.size() <= opaque)
+		{
+			// few enough cells to give each one its own entry
+			for (auto& entry : entries)
+				palette.push_back(entry.color);
+		}
+		else
+		{
+			palette = medianCut(entries, opaque);
+			refine(palette, entries, options.iterations);
+		}
+
+		if (palette.empty())
+			palette.push_back({ { 0.0f, 0.0f, 0.0f, 0.0f } });
+
+		int transparentIndex = -1;
+		if (histogram.hasTransparent())
+		{
+			transparentIndex = (int)palette.size();
+			palette.push_back({ { 0.0f, 0.0f, 0.0f, 2.0f * gdAlphaTransparent } });
+		}
+
+		dst->colorsTotal = (int)palette.size();
+		for (int i = 0; i < dst->colorsTotal; ++i)
+		{
+			dst->red[i] = clampChannel((int)(palette[i].c[Red] + 0.5f), 255);
+			dst->green[i] = clampChannel((int)(palette[i].c[Green] + 0.5f), 255);
+			dst->blue[i] = clampChannel((int)(palette[i].c[Blue] + 0.5f), 255);
+			dst->alpha[i] = clampChannel((int)(palette[i].c[Alpha] * 0.5f + 0.5f), gdAlphaTransparent);
+			dst->open[i] = 0;
+		}
+		dst->transparent = transparentIndex;
+		dst->saveAlphaFlag = src->saveAlphaFlag;
+
+		// map and dither against what the palette actually stores; the
+		// transparent entry is only ever picked for transparent pixels
+		if (transparentIndex >= 0)
+			palette.pop_back();
+		for (size_t i = 0; i < palette.size(); ++i)
+			palette[i] = { { (float)dst->red[i], (float)dst->green[i], (float)dst->blue[i], dst->alpha[i] * 2.0f } };
+
+		PaletteSearch search{ palette };
+		Mapper mapper{ src, dst, search, transparentIndex };
+		if (options.dither)
+			mapper.dither();
+		else
+			mapper.map(entries);
+
+		// rows left unmapped; not worth handing over
+		if (cancelled())
+		{
+			gdImageDestroy(dst);
+			return nullptr;
+		}
+		return dst;
+	}
+};
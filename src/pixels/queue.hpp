@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __GDEX_PIXELS_QUEUE_HPP__
+#define __GDEX_PIXELS_QUEUE_HPP__
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <thread>
+
+namespace gd { namespace pixels {
+
+	// Bounded multi-producer, multi-consumer ring after Dmitry Vyukov's:
+	// every cell carries a sequence number telling whose turn it is, so
+	// push and pop each claim a slot with one compare-and-swap and never
+	// take a lock. Capacity is rounded up to a power of two.
+	template <typename T>
+	class BoundedQueue
+	{
+		struct Cell
+		{
+			std::atomic<size_t> sequence;
+			T value;
+		};
+
+		std::unique_ptr<Cell[]> cells;
+		size_t mask;
+		// keeps producers and consumers off each other's cache line
+		char pad0[64];
+		std::atomic<size_t> tail;
+		char pad1[64];
+		std::atomic<size_t> head;
+		char pad2[64];
+
+	public:
+		explicit BoundedQueue(size_t capacity)
+			: tail(0)
+			, head(0)
+		{
+			size_t size = 2;
+			while (size < capacity)
+				size <<= 1;
+
+			cells.reset(new Cell[size]);
+			mask = size - 1;
+			for (size_t i = 0; i < size; ++i)
+				cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+
+		BoundedQueue(const BoundedQueue&) = delete;
+		BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+		// false, with value untouched, when the queue is full
+		bool tryPush(T& value)
+		{
+			auto pos = tail.load(std::memory_order_relaxed);
+			for (;;)
+			{
+				auto& cell = cells[pos & mask];
+				auto seq = cell.sequence.load(std::memory_order_acquire);
+				auto diff = (ptrdiff_t)seq - (ptrdiff_t)pos;
+				if (diff == 0)
+				{
+					if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					{
+						cell.value = std::move(value);
+						cell.sequence.store(pos + 1, std::memory_order_release);
+						return true;
+					}
+				}
+				else if (diff < 0)
+					return false;
+				else
+					pos = tail.load(std::memory_order_relaxed);
+			}
+		}
+
+		// false when the queue is empty
+		bool tryPop(T& value)
+		{
+			auto pos = head.load(std::memory_order_relaxed);
+			for (;;)
+			{
+				auto& cell = cells[pos & mask];
+				auto seq = cell.sequence.load(std::memory_order_acquire);
+				auto diff = (ptrdiff_t)seq - (ptrdiff_t)(pos + 1);
+				if (diff == 0)
+				{
+					if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					{
+						value = std::move(cell.value);
+						cell.sequence.store(pos + mask + 1, std::memory_order_release);
+						return true;
+					}
+				}
+				else if (diff < 0)
+					return false;
+				else
+					pos = head.load(std::memory_order_relaxed);
+			}
+		}
+	};
+
+	// Waiting on a BoundedQueue: spin briefly, then yield, then sleep
+	// for longer and longer up to a millisecond. Stages in a pipeline
+	// run for milliseconds per item, so the extra latency is noise.
+	class Backoff
+	{
+		int rounds;
+
+	public:
+		Backoff() : rounds(0) {}
+
+		void reset() { rounds = 0; }
+
+		void wait()
+		{
+			if (rounds >= 32)
+				std::this_thread::sleep_for(std::chrono::microseconds(std::min(1000, 10 << std::min(rounds - 32, 7))));
+			else if (rounds >= 16)
+				std::this_thread::yield();
+			++rounds;
+		}
+	};
+}}
+
+#endif // __GDEX_PIXELS_QUEUE_HPP__
@@ -0,0 +1,420 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "gdex.hpp"
+#include "pixels/cpu.hpp"
+#include "pixels/palette.hpp"
+#include "pixels/parallel.hpp"
+#include "pixels/simd.hpp"
+#include <math.h>
+
+namespace gd
+{
+	namespace
+	{
+		// Premultiplied pixel, coverage in 0..1
+		struct Pixel4
+		{
+			float b, g, r, a;
+		};
+
+		// out[i] += in[i] * weight; no fused multiply-add in any variant,
+		// so every instruction set rounds the same way
+		void accumulateScalar(float* out, const float* in, float weight, int count)
+		{
+			for (int i = 0; i < count; ++i)
+				out[i] += in[i] * weight;
+		}
+
+#ifdef GDEX_HAS_SSE2
+		void accumulateSSE2(float* out, const float* in, float weight, int count)
+		{
+			auto w = _mm_set1_ps(weight);
+			int i = 0;
+			for (; i + 4 <= count; i += 4)
+				_mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), _mm_mul_ps(_mm_loadu_ps(in + i), w)));
+			accumulateScalar(out + i, in + i, weight, count - i);
+		}
+#endif
+
+#ifdef GDEX_HAS_AVX2
+		GDEX_TARGET_AVX2 void accumulateAVX2(float* out, const float* in, float weight, int count)
+		{
+			auto w = _mm256_set1_ps(weight);
+			int i = 0;
+			for (; i + 8 <= count; i += 8)
+				_mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(out + i), _mm256_mul_ps(_mm256_loadu_ps(in + i), w)));
+			accumulateScalar(out + i, in + i, weight, count - i);
+		}
+#endif
+
+		typedef void (*Accumulate)(float* out, const float* in, float weight, int count);
+		Accumulate accumulateImpl()
+		{
+			static const Accumulate impl = pixels::dispatch<Accumulate>(accumulateScalar,
+				GDEX_SSE2_KERNEL(accumulateSSE2), GDEX_AVX2_KERNEL(accumulateAVX2));
+			return impl;
+		}
+
+		inline int channel(float value, float scale)
+		{
+			int c = (int)(value * scale + 0.5f);
+			return c > 255 ? 255 : c;
+		}
+
+		inline int coverageAlpha(float cov)
+		{
+			int alpha = gdAlphaMax - (int)(cov * gdAlphaMax + 0.5f);
+			return alpha < 0 ? 0 : alpha;
+		}
+
+		// Averages the stored sRGB values directly, as libgd does
+		struct GammaValues
+		{
+			static Pixel4 premultiply(int px)
+			{
+				float cov = (gdAlphaMax - gdTrueColorGetAlpha(px)) * (1.0f / gdAlphaMax);
+				return{ gdTrueColorGetBlue(px) * cov, gdTrueColorGetGreen(px) * cov, gdTrueColorGetRed(px) * cov, cov };
+			}
+
+			static int unpremultiply(const Pixel4& px)
+			{
+				if (px.a <= 0.0f)
+					return gdTrueColorAlpha(0, 0, 0, gdAlphaTransparent);
+
+				float scale = 1.0f / px.a;
+				return gdTrueColorAlpha(channel(px.r, scale), channel(px.g, scale), channel(px.b, scale), coverageAlpha(px.a));
+			}
+		};
+
+		// For sources known to be opaque: coverage is always 1, so there
+		// is nothing to multiply or divide by
+		struct OpaqueValues
+		{
+			static Pixel4 premultiply(int px)
+			{
+				return{ (float)gdTrueColorGetBlue(px), (float)gdTrueColorGetGreen(px), (float)gdTrueColorGetRed(px), 1.0f };
+			}
+
+			static int unpremultiply(const Pixel4& px)
+			{
+				return gdTrueColor(channel(px.r, 1.0f), channel(px.g, 1.0f), channel(px.b, 1.0f));
+			}
+		};
+
+		// sRGB <-> linear light through tables instead of pow(): 8-bit
+		// values expand to 16-bit linear, and linear values come back
+		// through a 2^13 entry table, fine enough to reach every dark
+		// sRGB level
+		class GammaTables
+		{
+		public:
+			static const int inverseBits = 13;
+			static const int inverseSize = 1 << inverseBits;
+
+			uint16_t toLinear[256];
+			unsigned char fromLinear[inverseSize];
+
+			GammaTables()
+			{
+				for (int i = 0; i < 256; ++i)
+				{
+					double c = i / 255.0;
+					double lin = c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4);
+					toLinear[i] = (uint16_t)(lin * 65535.0 + 0.5);
+				}
+
+				for (int i = 0; i < inverseSize; ++i)
+				{
+					double lin = (double)i / (inverseSize - 1);
+					double c = lin <= 0.0031308 ? lin * 12.92 : 1.055 * pow(lin, 1.0 / 2.4) - 0.055;
+					fromLinear[i] = (unsigned char)(c * 255.0 + 0.5);
+				}
+			}
+		};
+
+		// built on first use
+		const GammaTables& gammaTables()
+		{
+			static const GammaTables tables;
+			return tables;
+		}
+
+		struct LinearLight
+		{
+			static Pixel4 premultiply(int px)
+			{
+				float cov = (gdAlphaMax - gdTrueColorGetAlpha(px)) * (1.0f / gdAlphaMax);
+				// 16-bit linear values on the same 0..255 scale as sRGB ones
+				float scale = cov * (1.0f / 257.0f);
+				auto& gamma = gammaTables();
+				return{
+					gamma.toLinear[gdTrueColorGetBlue(px)] * scale,
+					gamma.toLinear[gdTrueColorGetGreen(px)] * scale,
+					gamma.toLinear[gdTrueColorGetRed(px)] * scale,
+					cov
+				};
+			}
+
+			static int encode(float value, float scale)
+			{
+				int index = (int)(value * scale + 0.5f);
+				return gammaTables().fromLinear[index >= GammaTables::inverseSize ? GammaTables::inverseSize - 1 : index];
+			}
+
+			static int unpremultiply(const Pixel4& px)
+			{
+				if (px.a <= 0.0f)
+					return gdTrueColorAlpha(0, 0, 0, gdAlphaTransparent);
+
+				float scale = (GammaTables::inverseSize - 1) / (255.0f * px.a);
+				return gdTrueColorAlpha(encode(px.r, scale), encode(px.g, scale), encode(px.b, scale), coverageAlpha(px.a));
+			}
+		};
+
+		// Area-average weights, the same box gdImageCopyResampled uses:
+		// each output pixel covers [i * scale, (i + 1) * scale) of the
+		// input and every input pixel counts by its overlap with it
+		struct Filter
+		{
+			std::vector<int> first;
+			std::vector<int> count;
+			std::vector<float> weights; // maxTaps per output pixel
+			int maxTaps;
+
+			Filter(int srcSize, int dstSize)
+				: first(dstSize), count(dstSize), maxTaps(1)
+			{
+				double scale = (double)srcSize / dstSize;
+				maxTaps = (int)ceil(scale) + 1;
+				weights.resize((size_t)dstSize * maxTaps);
+
+				for (int i = 0; i < dstSize; ++i)
+				{
+					double lo = i * scale;
+					double hi = (i + 1) * scale;
+					int from = (int)floor(lo);
+					int to = std::min((int)ceil(hi), srcSize);
+
+					first[i] = from;
+					count[i] = to - from;
+					auto w = &weights[(size_t)i * maxTaps];
+					for (int j = from; j < to; ++j)
+						w[j - from] = (float)((std::min(hi, j + 1.0) - std::max(lo, (double)j)) / scale);
+				}
+			}
+
+			const float* at(int i) const { return &weights[(size_t)i * maxTaps]; }
+		};
+
+		template <typename Encoding, PixelFormat Format>
+		// Produces one band of output rows; the filters are shared
+		// between bands, the row caches are per band
+		class Resampler
+		{
+			gdImagePtr dst;
+			const Filter& horz;
+			const Filter& vert;
+			float sharpen;
+
+			// horizontally filtered source rows, slot = row % ring size
+			std::vector<Pixel4> cache;
+			std::vector<int> cached;
+			pixels::FormatRows<Format> source;
+
+			// last three output rows, for the sharpening stencil
+			std::vector<Pixel4> produced;
+
+			int width() const { return dst->sx; }
+
+			const Pixel4* filtered(int y)
+			{
+				auto slot = y % vert.maxTaps;
+				auto row = &cache[(size_t)slot * width()];
+				if (cached[slot] == y)
+					return row;
+
+				cached[slot] = y;
+				auto px = source.row(y);
+				for (int x = 0, w = width(); x < w; ++x)
+				{
+					auto taps = horz.count[x];
+					auto weights = horz.at(x);
+					auto in = px + horz.first[x];
+
+					Pixel4 acc = { 0, 0, 0, 0 };
+					for (int i = 0; i < taps; ++i)
+					{
+						auto p = Encoding::premultiply(in[i]);
+						acc.b += p.b * weights[i];
+						acc.g += p.g * weights[i];
+						acc.r += p.r * weights[i];
+						acc.a += p.a * weights[i];
+					}
+					row[x] = acc;
+				}
+				return row;
+			}
+
+			Pixel4* output(int y) { return &produced[(size_t)(y % 3) * width()]; }
+
+			void filterColumns(int y)
+			{
+				auto out = output(y);
+				auto w = width();
+				for (int x = 0; x < w; ++x)
+					out[x] = Pixel4{ 0, 0, 0, 0 };
+
+				// Pixel4 rows are plain float arrays, four per pixel
+				auto weights = vert.at(y);
+				auto accumulate = accumulateImpl();
+				for (int i = 0, taps = vert.count[y]; i < taps; ++i)
+					accumulate(&out[0].b, &filtered(vert.first[y] + i)[0].b, weights[i], w * 4);
+			}
+
+			void store(int y, const Pixel4* row)
+			{
+				auto out = dst->tpixels[y];
+				for (int x = 0, w = width(); x < w; ++x)
+					out[x] = Encoding::unpremultiply(row[x]);
+			}
+
+			static float sharpened(float mid, float sum, float amount, float limit)
+			{
+				float value = mid * (1.0f + 4.0f * amount) - sum * amount;
+				return value < 0.0f ? 0.0f : value > limit ? limit : value;
+			}
+
+			// Laplacian unsharp mask on the premultiplied colors of
+			// row y; coverage is left alone, so edges do not ring
+			void storeSharpened(int y)
+			{
+				auto last = dst->sy - 1;
+				auto up = output(y > 0 ? y - 1 : y);
+				auto mid = output(y);
+				auto down = output(y < last ? y + 1 : y);
+				auto out = dst->tpixels[y];
+
+				for (int x = 0, w = width(); x < w; ++x)
+				{
+					auto& left = mid[x > 0 ? x - 1 : x];
+					auto& right = mid[x < w - 1 ? x + 1 : x];
+					auto& c = mid[x];
+					Pixel4 px = {
+						sharpened(c.b, up[x].b + down[x].b + left.b + right.b, sharpen, c.a * 255.0f),
+						sharpened(c.g, up[x].g + down[x].g + left.g + right.g, sharpen, c.a * 255.0f),
+						sharpened(c.r, up[x].r + down[x].r + left.r + right.r, sharpen, c.a * 255.0f),
+						c.a
+					};
+					out[x] = Encoding::unpremultiply(px);
+				}
+			}
+
+		public:
+			Resampler(const gdImage* src, gdImagePtr dst, const Filter& horz, const Filter& vert, float sharpen)
+				: dst(dst)
+				, horz(horz)
+				, vert(vert)
+				, sharpen(sharpen)
+				, cache((size_t)vert.maxTaps * dst->sx)
+				, cached(vert.maxTaps, -1)
+				, source(ImageView{ src })
+				, produced((size_t)3 * dst->sx)
+			{
+			}
+
+			// Output rows [begin, end); sharpening also filters the
+			// halo rows [from, begin) and [end, to) for its stencil
+			void run(int begin, int end, int from, int to)
+			{
+				if (!sharpen)
+				{
+					for (int y = begin; y < end; ++y)
+					{
+						filterColumns(y);
+						store(y, output(y));
+					}
+					return;
+				}
+
+				for (int y = from; y < to; ++y)
+				{
+					filterColumns(y);
+					if (y > from && y - 1 >= begin && y - 1 < end)
+						storeSharpened(y - 1);
+				}
+
+				// the last image row has no row below to wait for
+				if (to - 1 >= begin && to - 1 < end)
+					storeSharpened(to - 1);
+			}
+		};
+
+		template <PixelFormat Format>
+		void resampleFrom(const gdImage* src, gdImagePtr dst, const ResampleOptions& options)
+		{
+			Filter horz{ src->sx, dst->sx };
+			Filter vert{ src->sy, dst->sy };
+			float sharpen = options.sharpen > 0.0f ? options.sharpen : 0.0f;
+
+			// source pixels feeding one output row, plus the row itself
+			size_t rowCost = (size_t)src->sx * src->sy / dst->sy + dst->sx;
+			pixels::parallelBands(dst->sy, rowCost, sharpen ? 1 : 0, [&](int begin, int end, int from, int to)
+			{
+				if (options.linear)
+					Resampler<LinearLight, Format>{ src, dst, horz, vert, sharpen }.run(begin, end, from, to);
+				else if (options.opacity == Opacity::Opaque)
+					Resampler<OpaqueValues, Format>{ src, dst, horz, vert, sharpen }.run(begin, end, from, to);
+				else
+					Resampler<GammaValues, Format>{ src, dst, horz, vert, sharpen }.run(begin, end, from, to);
+			});
+		}
+	}
+
+	BGDEX_DECLARE_CC(gdImagePtr) resample(const gdImage* src, int w, int h, const ResampleOptions& options)
+	{
+		if (!src || w <= 0 || h <= 0 || src->sx <= 0 || src->sy <= 0)
+			return nullptr;
+
+		auto dst = gdImageCreateTrueColor(w, h);
+		if (!dst)
+			return nullptr;
+
+		bool opaque = options.opacity == Opacity::Opaque;
+		gdImageSaveAlpha(dst, opaque ? 0 : 1);
+
+		if (src->trueColor)
+			resampleFrom<PixelFormat::TrueColor>(src, dst, options);
+		else
+			resampleFrom<PixelFormat::Palette>(src, dst, options);
+
+		// bands left out; not worth handing over
+		if (cancelled())
+		{
+			gdImageDestroy(dst);
+			return nullptr;
+		}
+		return dst;
+	}
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __GDEX_PIXELS_SIMD_HPP__
+#define __GDEX_PIXELS_SIMD_HPP__
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GDEX_HAS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// AVX2 kernels are compiled into every x86 build and only picked at
+// run time, see pixels/cpu.hpp; GCC and Clang need the target attribute
+// on each function using the intrinsics, MSVC accepts them anywhere.
+#if defined(_M_X64) || (defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)))
+#define GDEX_HAS_AVX2 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define GDEX_TARGET_AVX2
+#else
+#define GDEX_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+// kernel variant or nullptr, for pixels::dispatch
+#ifdef GDEX_HAS_SSE2
+#define GDEX_SSE2_KERNEL(fn) fn
+#else
+#define GDEX_SSE2_KERNEL(fn) nullptr
+#endif
+#ifdef GDEX_HAS_AVX2
+#define GDEX_AVX2_KERNEL(fn) fn
+#else
+#define GDEX_AVX2_KERNEL(fn) nullptr
+#endif
+
+#endif // __GDEX_PIXELS_SIMD_HPP__
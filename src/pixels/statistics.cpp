@@ -0,0 +1,228 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "gdex.hpp"
+#include "pixels/palette.hpp"
+#include "pixels/parallel.hpp"
+#include "pixels/simd.hpp"
+#include <mutex>
+#include <string.h>
+
+namespace gd
+{
+	namespace
+	{
+		// 4 bits of each color channel
+		static const int cubeBits = 4;
+		static const int cubeSize = 1 << (3 * cubeBits);
+
+		inline int bucketOf(int px)
+		{
+			return ((px >> 20) & 15) << 8 | ((px >> 12) & 15) << 4 | ((px >> 4) & 15);
+		}
+
+		// Colors summed weighted by coverage (127 - alpha)
+		struct Bucket
+		{
+			uint64_t weight;
+			uint64_t red;
+			uint64_t green;
+			uint64_t blue;
+		};
+
+		// What one band of rows adds up to
+		struct Tally
+		{
+			uint32_t red[256];
+			uint32_t green[256];
+			uint32_t blue[256];
+			uint32_t alpha[gdAlphaMax + 1];
+			std::vector<Bucket> cube;
+
+			Tally() : red(), green(), blue(), alpha(), cube(cubeSize) {}
+
+			// Opaque views skip the transparent runs and the alpha
+			// tests; every pixel weighs the same
+			template <bool Opaque>
+			void add(const int* row, int count)
+			{
+				if (Opaque)
+				{
+					alpha[gdAlphaOpaque] += count;
+					for (int x = 0; x < count; ++x)
+						addColor(row[x], gdAlphaTransparent);
+					return;
+				}
+
+				int x = 0;
+				while (x < count)
+				{
+#ifdef GDEX_HAS_SSE2
+					// transparent margins only ever count towards alpha
+					int run = x;
+					auto mask = _mm_set1_epi32(0x7F000000);
+					for (; run + 4 <= count; run += 4)
+					{
+						auto px = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + run)), mask);
+						if (_mm_movemask_epi8(_mm_cmpeq_epi32(px, mask)) != 0xFFFF)
+							break;
+					}
+					alpha[gdAlphaTransparent] += run - x;
+					x = run;
+					if (x == count)
+						break;
+#endif
+					add(row[x++]);
+				}
+			}
+
+			void add(int px)
+			{
+				int a = gdTrueColorGetAlpha(px);
+				++alpha[a];
+				if (a != gdAlphaTransparent)
+					addColor(px, gdAlphaTransparent - a);
+			}
+
+			void addColor(int px, uint32_t w)
+			{
+				int r = gdTrueColorGetRed(px);
+				int g = gdTrueColorGetGreen(px);
+				int b = gdTrueColorGetBlue(px);
+				++red[r];
+				++green[g];
+				++blue[b];
+
+				auto& bucket = cube[bucketOf(px)];
+				bucket.weight += w;
+				bucket.red += r * w;
+				bucket.green += g * w;
+				bucket.blue += b * w;
+			}
+
+			void merge(const Tally& oth)
+			{
+				for (int i = 0; i < 256; ++i)
+				{
+					red[i] += oth.red[i];
+					green[i] += oth.green[i];
+					blue[i] += oth.blue[i];
+				}
+				for (int i = 0; i <= gdAlphaMax; ++i)
+					alpha[i] += oth.alpha[i];
+				for (int i = 0; i < cubeSize; ++i)
+				{
+					cube[i].weight += oth.cube[i].weight;
+					cube[i].red += oth.cube[i].red;
+					cube[i].green += oth.cube[i].green;
+					cube[i].blue += oth.cube[i].blue;
+				}
+			}
+		};
+
+		template <PixelFormat Format, bool Opaque>
+		void tallyRows(Tally& tally, const ImageView& view, int begin, int end)
+		{
+			pixels::FormatRows<Format> rows{ view };
+			for (int y = begin; y < end; ++y)
+				tally.add<Opaque>(rows.row(y), view.width());
+		}
+
+		int meanColor(uint64_t weight, uint64_t red, uint64_t green, uint64_t blue)
+		{
+			if (!weight)
+				return gdTrueColor(0, 0, 0);
+			return gdTrueColor((int)((red + weight / 2) / weight), (int)((green + weight / 2) / weight), (int)((blue + weight / 2) / weight));
+		}
+	}
+
+	BGDEX_DECLARE_CC(ImageStatistics) statistics(const ImageView& view, const StatisticsOptions& options)
+	{
+		ImageStatistics stats;
+		if (!view)
+			return stats;
+
+		// picked once; the bands only run the loop
+		typedef void (*Work)(Tally& tally, const ImageView& view, int begin, int end);
+		bool opaque = options.opacity == Opacity::Opaque;
+		Work work;
+		if (view.trueColor())
+			work = opaque ? &tallyRows<PixelFormat::TrueColor, true> : &tallyRows<PixelFormat::TrueColor, false>;
+		else
+			work = opaque ? &tallyRows<PixelFormat::Palette, true> : &tallyRows<PixelFormat::Palette, false>;
+
+		// one tally per band, merged once the bands are done
+		Tally total;
+		if (options.parallel)
+		{
+			std::mutex lock;
+			pixels::parallelRows(view.height(), view.width(), 1, [&](int begin, int end) {
+				Tally band;
+				work(band, view, begin, end);
+				std::lock_guard<std::mutex> guard{ lock };
+				total.merge(band);
+			});
+		}
+		else
+			work(total, view, 0, view.height());
+		if (cancelled())
+			return stats;
+
+		memcpy(stats.red, total.red, sizeof(stats.red));
+		memcpy(stats.green, total.green, sizeof(stats.green));
+		memcpy(stats.blue, total.blue, sizeof(stats.blue));
+		memcpy(stats.alpha, total.alpha, sizeof(stats.alpha));
+		stats.pixels = (uint32_t)view.width() * view.height();
+
+		Bucket sum{};
+		std::vector<int> order;
+		for (int i = 0; i < cubeSize; ++i)
+		{
+			auto& bucket = total.cube[i];
+			if (!bucket.weight)
+				continue;
+			sum.weight += bucket.weight;
+			sum.red += bucket.red;
+			sum.green += bucket.green;
+			sum.blue += bucket.blue;
+			order.push_back(i);
+		}
+		stats.mean = meanColor(sum.weight, sum.red, sum.green, sum.blue);
+
+		size_t dominant = std::min(order.size(), (size_t)std::max(0, options.dominant));
+		std::partial_sort(order.begin(), order.begin() + dominant, order.end(), [&](int lhs, int rhs) {
+			return total.cube[lhs].weight > total.cube[rhs].weight;
+		});
+		for (size_t i = 0; i < dominant; ++i)
+		{
+			auto& bucket = total.cube[order[i]];
+			stats.dominant.push_back({
+				meanColor(bucket.weight, bucket.red, bucket.green, bucket.blue),
+				(float)bucket.weight / sum.weight
+			});
+		}
+
+		return stats;
+	}
+};
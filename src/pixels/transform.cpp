@@ -0,0 +1,270 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "gdex.hpp"
+#include "pixels/image.hpp"
+#include "pixels/parallel.hpp"
+#include "pixels/simd.hpp"
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+namespace gd
+{
+	namespace
+	{
+		// 32x32 ints is 4KiB on either side, both tiles stay in L1
+		static const int tileSize = 32;
+
+		enum class Layout
+		{
+			Transpose,
+			Rotate90,
+			Rotate180,
+			Rotate270
+		};
+
+		int** rowsOf(const gdImage* img, int*) { return img->tpixels; }
+		unsigned char** rowsOf(const gdImage* img, unsigned char*) { return img->pixels; }
+
+		template <typename Pixel>
+		Pixel** rowsOf(const gdImage* img) { return rowsOf(img, (Pixel*)nullptr); }
+
+		void reverseRow(unsigned char* row, int width)
+		{
+			std::reverse(row, row + width);
+		}
+
+		void reverseRow(int* row, int width)
+		{
+			auto lo = row;
+			auto hi = row + width;
+#ifdef GDEX_HAS_SSE2
+			for (; hi - lo >= 8; lo += 4)
+			{
+				hi -= 4;
+				auto left = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lo));
+				auto right = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hi));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(lo), _mm_shuffle_epi32(right, _MM_SHUFFLE(0, 1, 2, 3)));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(hi), _mm_shuffle_epi32(left, _MM_SHUFFLE(0, 1, 2, 3)));
+			}
+#endif
+			std::reverse(lo, hi);
+		}
+
+		void reverseCopy(unsigned char* dst, const unsigned char* src, int width)
+		{
+			std::reverse_copy(src, src + width, dst);
+		}
+
+		void reverseCopy(int* dst, const int* src, int width)
+		{
+			int x = 0;
+#ifdef GDEX_HAS_SSE2
+			for (; x + 4 <= width; x += 4)
+			{
+				auto px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + width - x - 4));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm_shuffle_epi32(px, _MM_SHUFFLE(0, 1, 2, 3)));
+			}
+#endif
+			for (; x < width; ++x)
+				dst[x] = src[width - x - 1];
+		}
+
+		template <typename Pixel>
+		void transposeTile(Pixel* const* src, Pixel* const* dst, int x0, int y0, int x1, int y1)
+		{
+			for (int y = y0; y < y1; ++y)
+			{
+				auto row = src[y];
+				for (int x = x0; x < x1; ++x)
+					dst[x][y] = row[x];
+			}
+		}
+
+		void transposeTile(int* const* src, int* const* dst, int x0, int y0, int x1, int y1)
+		{
+			int y = y0;
+#ifdef GDEX_HAS_SSE2
+			for (; y + 4 <= y1; y += 4)
+			{
+				int x = x0;
+				for (; x + 4 <= x1; x += 4)
+				{
+					auto r0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src[y] + x));
+					auto r1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src[y + 1] + x));
+					auto r2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src[y + 2] + x));
+					auto r3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src[y + 3] + x));
+
+					auto t0 = _mm_unpacklo_epi32(r0, r1);
+					auto t1 = _mm_unpacklo_epi32(r2, r3);
+					auto t2 = _mm_unpackhi_epi32(r0, r1);
+					auto t3 = _mm_unpackhi_epi32(r2, r3);
+
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dst[x] + y), _mm_unpacklo_epi64(t0, t1));
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dst[x + 1] + y), _mm_unpackhi_epi64(t0, t1));
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dst[x + 2] + y), _mm_unpacklo_epi64(t2, t3));
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dst[x + 3] + y), _mm_unpackhi_epi64(t2, t3));
+				}
+				for (; x < x1; ++x)
+				{
+					for (int i = 0; i < 4; ++i)
+						dst[x][y + i] = src[y + i][x];
+				}
+			}
+#endif
+			for (; y < y1; ++y)
+			{
+				auto row = src[y];
+				for (int x = x0; x < x1; ++x)
+					dst[x][y] = row[x];
+			}
+		}
+
+		// dst[x][y] = src[y][x], walked tile by tile; bands of source rows
+		// write disjoint columns of dst, so they run in parallel
+		template <typename Pixel>
+		void transpose(Pixel* const* src, Pixel* const* dst, int width, int height)
+		{
+			pixels::parallelRows(height, width, tileSize, [=](int begin, int end)
+			{
+				for (int ty = begin; ty < end; ty += tileSize)
+				{
+					int ty1 = std::min(ty + tileSize, end);
+					for (int tx = 0; tx < width; tx += tileSize)
+						transposeTile(src, dst, tx, ty, std::min(tx + tileSize, width), ty1);
+				}
+			});
+		}
+
+		template <typename Pixel>
+		gdImagePtr relayout(const gdImage* img, Layout layout)
+		{
+			int width = img->sx;
+			int height = img->sy;
+			bool swapAxes = layout != Layout::Rotate180;
+
+			auto out = pixels::createLike(img, swapAxes ? height : width, swapAxes ? width : height);
+			if (!out)
+				return nullptr;
+
+			auto src = rowsOf<Pixel>(img);
+			auto dst = rowsOf<Pixel>(out);
+
+			// Rotations are transpositions of a vertically flipped image
+			// (90) or into one (270); flipping only reverses row tables
+			std::vector<Pixel*> flipped;
+			switch (layout)
+			{
+			case Layout::Transpose:
+				transpose(src, dst, width, height);
+				break;
+			case Layout::Rotate90:
+				flipped.assign(std::reverse_iterator<Pixel**>(src + height), std::reverse_iterator<Pixel**>(src));
+				transpose(flipped.data(), dst, width, height);
+				break;
+			case Layout::Rotate270:
+				flipped.assign(std::reverse_iterator<Pixel**>(dst + width), std::reverse_iterator<Pixel**>(dst));
+				transpose(src, flipped.data(), width, height);
+				break;
+			case Layout::Rotate180:
+				pixels::parallelRows(height, width, 1, [=](int begin, int end)
+				{
+					for (int y = begin; y < end; ++y)
+						reverseCopy(dst[height - y - 1], src[y], width);
+				});
+				break;
+			}
+
+			// bands left out; not worth handing over
+			if (cancelled())
+			{
+				gdImageDestroy(out);
+				return nullptr;
+			}
+			return out;
+		}
+
+		gdImagePtr relayout(const gdImage* img, Layout layout)
+		{
+			if (!img)
+				return nullptr;
+
+			if (img->trueColor)
+				return relayout<int>(img, layout);
+			return relayout<unsigned char>(img, layout);
+		}
+
+		template <typename Pixel>
+		void flipHorizontal(const gdImage* img)
+		{
+			auto rows = rowsOf<Pixel>(img);
+			int width = img->sx;
+			pixels::parallelRows(img->sy, width, 1, [=](int begin, int end)
+			{
+				for (int y = begin; y < end; ++y)
+					reverseRow(rows[y], width);
+			});
+		}
+	}
+
+	BGDEX_DECLARE_CC(void) flipVertical(gdImagePtr img)
+	{
+		if (!img)
+			return;
+
+		// every row is a separate allocation, so only the table moves
+		if (img->trueColor)
+			std::reverse(img->tpixels, img->tpixels + img->sy);
+		else
+			std::reverse(img->pixels, img->pixels + img->sy);
+	}
+
+	BGDEX_DECLARE_CC(void) flipHorizontal(gdImagePtr img)
+	{
+		if (!img)
+			return;
+
+		if (img->trueColor)
+			flipHorizontal<int>(img);
+		else
+			flipHorizontal<unsigned char>(img);
+	}
+
+	BGDEX_DECLARE_CC(gdImagePtr) rotate(const gdImage* img, Rotation rotation)
+	{
+		switch (rotation)
+		{
+		case Rotation::Rotate90: return relayout(img, Layout::Rotate90);
+		case Rotation::Rotate180: return relayout(img, Layout::Rotate180);
+		case Rotation::Rotate270: return relayout(img, Layout::Rotate270);
+		}
+		return nullptr;
+	}
+
+	BGDEX_DECLARE_CC(gdImagePtr) transpose(const gdImage* img)
+	{
+		return relayout(img, Layout::Transpose);
+	}
+}
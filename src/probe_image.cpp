@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "gdex.hpp"
+#include <string.h>
+
+namespace gd
+{
+	namespace
+	{
+		unsigned be16(const unsigned char* p) { return (p[0] << 8) | p[1]; }
+		unsigned le16(const unsigned char* p) { return p[0] | (p[1] << 8); }
+		uint32_t be32(const unsigned char* p) { return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3]; }
+
+		bool probePng(const unsigned char* data, size_t size, ImageHeader& header)
+		{
+			static const unsigned char signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+			// signature, then IHDR: length, type, width, height, depth, color type
+			if (size < 26 || memcmp(data, signature, sizeof(signature)) || memcmp(data + 12, "IHDR", 4))
+				return false;
+
+			auto width = be32(data + 16);
+			auto height = be32(data + 20);
+			if (!width || !height || width > INT32_MAX || height > INT32_MAX)
+				return false;
+
+			// libgd keeps palette and plain grayscale images as palette ones
+			auto colorType = data[25];
+			header.format = ImageFormat::Png;
+			header.width = (int)width;
+			header.height = (int)height;
+			header.trueColor = colorType == 2 || colorType == 4 || colorType == 6;
+			return true;
+		}
+
+		bool probeJpeg(const unsigned char* data, size_t size, ImageHeader& header)
+		{
+			if (size < 4 || data[0] != 0xFF || data[1] != 0xD8)
+				return false;
+
+			size_t pos = 2;
+			while (pos + 4 <= size)
+			{
+				if (data[pos] != 0xFF)
+					return false;
+
+				auto marker = data[pos + 1];
+				// fill bytes, and markers standing alone
+				if (marker == 0xFF)
+				{
+					++pos;
+					continue;
+				}
+				if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7))
+				{
+					pos += 2;
+					continue;
+				}
+
+				auto length = be16(data + pos + 2);
+				if (length < 2)
+					return false;
+
+				// SOF0 to SOF15, less DHT, JPG and DAC
+				if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+				{
+					if (pos + 9 > size)
+						return false;
+
+					header.format = ImageFormat::Jpeg;
+					header.height = (int)be16(data + pos + 5);
+					header.width = (int)be16(data + pos + 7);
+					header.trueColor = true;
+					return header.width > 0 && header.height > 0;
+				}
+
+				// entropy-coded data follows SOS; no frame header before it
+				if (marker == 0xDA)
+					return false;
+				pos += 2 + length;
+			}
+			return false;
+		}
+
+		bool probeGif(const unsigned char* data, size_t size, ImageHeader& header)
+		{
+			if (size < 10 || (memcmp(data, "GIF87a", 6) && memcmp(data, "GIF89a", 6)))
+				return false;
+
+			// libgd makes the image the size of the logical screen
+			header.format = ImageFormat::Gif;
+			header.width = (int)le16(data + 6);
+			header.height = (int)le16(data + 8);
+			header.trueColor = false;
+			return header.width > 0 && header.height > 0;
+		}
+
+		size_t footprint(int width, int height, bool trueColor)
+		{
+			size_t pixel = trueColor ? sizeof(int) : sizeof(unsigned char);
+			uint64_t bytes = sizeof(gdImage) + (uint64_t)height * (sizeof(void*) + (uint64_t)width * pixel);
+			return bytes > SIZE_MAX ? SIZE_MAX : (size_t)bytes;
+		}
+	}
+
+	BGDEX_DECLARE_CC(bool) probeImage(const void* data, size_t size, ImageHeader& header)
+	{
+		auto bytes = static_cast<const unsigned char*>(data);
+		if (!bytes)
+			return false;
+
+		return probePng(bytes, size, header)
+			|| probeJpeg(bytes, size, header)
+			|| probeGif(bytes, size, header);
+	}
+
+	BGDEX_DECLARE_CC(size_t) decodedSize(const ImageHeader& header, const LoadOptions& options)
+	{
+		auto bytes = footprint(header.width, header.height, header.trueColor);
+		if (!header.trueColor && options.trueColor)
+		{
+			auto expanded = footprint(header.width, header.height, true);
+			bytes = bytes > SIZE_MAX - expanded ? SIZE_MAX : bytes + expanded;
+		}
+		return bytes;
+	}
+
+	BGDEX_DECLARE_CC(size_t) decodedSize(const void* data, size_t size, const LoadOptions& options)
+	{
+		ImageHeader header;
+		return probeImage(data, size, header) ? decodedSize(header, options) : 0;
+	}
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "gdex.hpp"
+
+namespace gd
+{
+	BGDEX_DECLARE_CC(bool) encodeImage(const gdImage* img, const EncodeOptions& options, std::vector<unsigned char>& out)
+	{
+		out.clear();
+		if (!img)
+			return false;
+
+		// libgd's encoders only read the image, but are not declared so
+		auto im = const_cast<gdImagePtr>(img);
+		int size = 0;
+		void* data = nullptr;
+		switch (options.format)
+		{
+		case ImageFormat::Png:
+			data = gdImagePngPtr(im, &size);
+			break;
+		case ImageFormat::Jpeg:
+			data = gdImageJpegPtr(im, &size, options.quality);
+			break;
+		case ImageFormat::Gif:
+			data = gdImageGifPtr(im, &size);
+			break;
+		}
+
+		if (!data)
+			return false;
+
+		auto bytes = static_cast<const unsigned char*>(data);
+		out.assign(bytes, bytes + size);
+		gdFree(data);
+		return size > 0;
+	}
+}
@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <gdex.hpp>
+#include <gdex_algorithm.hpp>
+#include <atomic>
+#include <vector>
+
+namespace
+{
+	gd::GdImage noise(int w, int h, unsigned seed)
+	{
+		gd::GdImage img{ gdImageCreateTrueColor(w, h) };
+		auto view = img.mutableView();
+		for (int y = 0; y < h; ++y)
+			for (int x = 0; x < w; ++x)
+			{
+				seed = seed * 1103515245u + 12345u;
+				view.row(y)[x] = (int)(seed >> 8) & 0x7FFFFFFF;
+			}
+		return img;
+	}
+
+	const gd::Execution policies[] = { gd::Execution::Sequential, gd::Execution::Vectorized, gd::Execution::Parallel };
+}
+
+TEST(Algorithm, RowsOfPaletteImagesAreEmpty)
+{
+	gd::GdImage palette{ gdImageCreate(16, 4) };
+	int rows = 0;
+	for (auto row : palette.mutableRows())
+	{
+		(void)row;
+		++rows;
+	}
+	EXPECT_EQ(0, rows);
+	EXPECT_TRUE(palette.rows().begin() == palette.rows().end());
+
+	gd::GdImage truecolor{ gdImageCreateTrueColor(16, 4) };
+	for (auto row : truecolor.mutableRows())
+	{
+		EXPECT_EQ(16, row.width);
+		for (auto& px : row)
+			px = row.y;
+	}
+	for (auto row : truecolor.rows())
+	{
+		++rows;
+		for (auto px : row)
+			EXPECT_EQ(row.y, px);
+	}
+	EXPECT_EQ(4, rows);
+}
+
+TEST(Algorithm, ForEachPixelVisitsEveryPixelOnce)
+{
+	auto img = noise(301, 257, 1);
+	auto view = img.view({ 5, 9, 280, 200 });
+	for (auto policy : policies)
+	{
+		std::vector<std::atomic<int>> seen(280 * 200);
+		for (auto& count : seen)
+			count = 0;
+		std::atomic<bool> right{ true };
+		gd::forEachPixel(view, policy, [&](int x, int y, int px) {
+			++seen[y * 280 + x];
+			if (px != view.row(y)[x])
+				right = false;
+		});
+		EXPECT_TRUE(right);
+		for (auto& count : seen)
+			ASSERT_EQ(1, count.load());
+	}
+}
+
+TEST(Algorithm, ParallelReduceMatchesSequential)
+{
+	auto img = noise(1024, 700, 2);
+	auto red = [](int px) { return (long long)gdTrueColorGetRed(px); };
+	auto sum = [](long long a, long long b) { return a + b; };
+
+	long long expected = 0;
+	for (int y = 0; y < 700; ++y)
+		for (int x = 0; x < 1024; ++x)
+			expected += gdTrueColorGetRed(img.view().row(y)[x]);
+
+	for (auto policy : policies)
+		EXPECT_EQ(expected, gd::reduce(img.view(), policy, 0ll, red, sum));
+
+	// combined in band order, so order-sensitive combines agree too
+	auto first = [](int px) { return std::vector<int>{ px }; };
+	auto append = [](std::vector<int> a, const std::vector<int>& b) { a.insert(a.end(), b.begin(), b.end()); return a; };
+	auto small = img.view({ 0, 0, 64, 300 });
+	EXPECT_EQ(gd::reduce(small, gd::Execution::Sequential, std::vector<int>{}, first, append),
+		gd::reduce(small, gd::Execution::Parallel, std::vector<int>{}, first, append));
+}
+
+TEST(Algorithm, TransformMapsPixelsOrPalette)
+{
+	auto invert = [](int px) { return px ^ 0xFFFFFF; };
+	for (auto policy : policies)
+	{
+		auto img = noise(131, 97, 3);
+		auto original = noise(131, 97, 3);
+		gd::transform(img.mutableView({ 1, 2, 100, 90 }), policy, invert);
+		for (int y = 0; y < 97; ++y)
+			for (int x = 0; x < 131; ++x)
+			{
+				bool inside = x >= 1 && x < 101 && y >= 2 && y < 92;
+				int px = original.view().row(y)[x];
+				ASSERT_EQ(inside ? invert(px) : px, img.view().row(y)[x]) << x << "," << y;
+			}
+	}
+
+	gd::GdImage palette{ gdImageCreate(8, 8) };
+	gdImageColorAllocate(palette.get(), 10, 20, 30);
+	gdImageColorAllocate(palette.get(), 40, 50, 60);
+	gdImageColorTransparent(palette.get(), 1);
+	gd::transform(palette.mutableView(), gd::Execution::Parallel, invert);
+	auto raw = palette.view().image();
+	EXPECT_EQ(245, raw->red[0]);
+	EXPECT_EQ(225, raw->blue[0]);
+	EXPECT_EQ(40, raw->red[1]);
+	EXPECT_EQ(60, raw->blue[1]);
+}
+
+TEST(Algorithm, ForEachTileCoversTheViewOnce)
+{
+	auto img = noise(100, 70, 4);
+	for (auto policy : policies)
+	{
+		std::vector<std::atomic<int>> seen(100 * 70);
+		for (auto& count : seen)
+			count = 0;
+		std::atomic<int> tiles{ 0 };
+		gd::forEachTile(img.view(), 32, 16, policy, [&](const gd::ImageView& tile) {
+			++tiles;
+			EXPECT_LE(tile.width(), 32);
+			EXPECT_LE(tile.height(), 16);
+			for (int y = 0; y < tile.height(); ++y)
+				for (int x = 0; x < tile.width(); ++x)
+					++seen[(tile.crop().y + y) * 100 + tile.crop().x + x];
+		});
+		EXPECT_EQ(4 * 5, tiles.load());
+		for (auto& count : seen)
+			ASSERT_EQ(1, count.load());
+	}
+}
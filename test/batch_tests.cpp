@@ -0,0 +1,259 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <gtest/gtest.h>
+#include <gdex_batch.hpp>
+#include "pixels/queue.hpp"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	// PNG i + 1 pixels wide, so every output tells which input it was
+	std::vector<std::vector<unsigned char>> inputs(int count)
+	{
+		std::vector<std::vector<unsigned char>> files(count);
+		for (int i = 0; i < count; ++i)
+		{
+			gd::GdImage img{ gdImageCreateTrueColor(i + 1, 3) };
+			EXPECT_TRUE(gd::encodeImage(img.view().image(), gd::EncodeOptions{}, files[i]));
+		}
+		return files;
+	}
+
+	int widthOf(std::vector<unsigned char>& file)
+	{
+		gd::GdImage img{ gd::loadImage((int)file.size(), file.data()) };
+		return img ? (int)img.width() : -1;
+	}
+
+	gd::BatchSource from(const std::vector<std::vector<unsigned char>>& files)
+	{
+		auto next = std::make_shared<size_t>(0);
+		return [&files, next](gd::BatchInput& input) {
+			if (*next == files.size())
+				return false;
+			input.data = files[(*next)++];
+			return true;
+		};
+	}
+
+	gd::BatchOptions threaded(bool ordered)
+	{
+		gd::BatchOptions options;
+		options.decoders = 3;
+		options.transformers = 3;
+		options.encoders = 2;
+		options.queueDepth = 2;
+		options.ordered = ordered;
+		return options;
+	}
+
+	// later inputs finish sooner, so they overtake earlier ones
+	void stagger(gd::GdImage& img)
+	{
+		std::this_thread::sleep_for(std::chrono::microseconds(2000 / (int)img.width()));
+	}
+}
+
+TEST(BoundedQueue, FullAndEmpty)
+{
+	gd::pixels::BoundedQueue<int> queue{ 3 };
+	int value = 0;
+	EXPECT_FALSE(queue.tryPop(value));
+
+	// rounded up to 4
+	for (int i = 0; i < 4; ++i)
+	{
+		value = i;
+		ASSERT_TRUE(queue.tryPush(value));
+	}
+	value = 4;
+	EXPECT_FALSE(queue.tryPush(value));
+
+	for (int i = 0; i < 4; ++i)
+	{
+		ASSERT_TRUE(queue.tryPop(value));
+		EXPECT_EQ(i, value);
+	}
+	EXPECT_FALSE(queue.tryPop(value));
+}
+
+TEST(BoundedQueue, ManyProducersManyConsumers)
+{
+	const int producers = 4, consumers = 4, each = 20000;
+	gd::pixels::BoundedQueue<int> queue{ 64 };
+	std::vector<std::atomic<int>> seen(producers * each);
+	for (auto& count : seen)
+		count = 0;
+	std::atomic<int> left{ producers * each };
+
+	std::vector<std::thread> threads;
+	for (int p = 0; p < producers; ++p)
+	{
+		threads.emplace_back([&, p] {
+			for (int i = 0; i < each; ++i)
+			{
+				int value = p * each + i;
+				while (!queue.tryPush(value))
+					std::this_thread::yield();
+			}
+		});
+	}
+	for (int c = 0; c < consumers; ++c)
+	{
+		threads.emplace_back([&] {
+			int value;
+			while (left > 0)
+			{
+				if (queue.tryPop(value))
+				{
+					++seen[value];
+					--left;
+				}
+				else
+					std::this_thread::yield();
+			}
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
+
+	for (size_t i = 0; i < seen.size(); ++i)
+		ASSERT_EQ(1, seen[i].load()) << i;
+}
+
+TEST(Batch, OrderedDeliveryFollowsInput)
+{
+	auto files = inputs(40);
+	std::vector<size_t> order;
+	auto count = gd::processBatch(from(files), stagger, [&](gd::BatchResult result) {
+		EXPECT_TRUE(result.ok);
+		EXPECT_EQ((int)result.index + 1, widthOf(result.data));
+		order.push_back(result.index);
+	}, threaded(true));
+
+	EXPECT_EQ(files.size(), count);
+	ASSERT_EQ(files.size(), order.size());
+	for (size_t i = 0; i < order.size(); ++i)
+		EXPECT_EQ(i, order[i]);
+}
+
+TEST(Batch, UnorderedDeliversEachOnce)
+{
+	auto files = inputs(40);
+	std::vector<int> seen(files.size());
+	auto count = gd::processBatch(from(files), stagger, [&](gd::BatchResult result) {
+		EXPECT_TRUE(result.ok);
+		EXPECT_EQ((int)result.index + 1, widthOf(result.data));
+		++seen.at(result.index);
+	}, threaded(false));
+
+	EXPECT_EQ(files.size(), count);
+	for (auto times : seen)
+		EXPECT_EQ(1, times);
+}
+
+TEST(Batch, BadInputsFailAlone)
+{
+	auto files = inputs(10);
+	files[3] = std::vector<unsigned char>(100, 0x42);
+	files[7].clear();
+
+	std::vector<int> ok(files.size(), -1);
+	gd::processBatch(from(files), nullptr, [&](gd::BatchResult result) {
+		ok[result.index] = result.ok;
+		EXPECT_EQ(result.ok, !result.data.empty());
+	}, threaded(true));
+
+	for (size_t i = 0; i < ok.size(); ++i)
+		EXPECT_EQ(i != 3 && i != 7, ok[i] == 1) << i;
+}
+
+TEST(Batch, ThrowingTransformFailsItsItem)
+{
+	auto files = inputs(20);
+	std::vector<int> ok(files.size(), -1);
+	gd::processBatch(from(files), [](gd::GdImage& img) {
+		if (img.width() % 5 == 0)
+			throw std::runtime_error("no multiples of five");
+	}, [&](gd::BatchResult result) {
+		ok[result.index] = result.ok;
+	}, threaded(false));
+
+	for (size_t i = 0; i < ok.size(); ++i)
+		EXPECT_EQ((i + 1) % 5 != 0, ok[i] == 1) << i;
+}
+
+TEST(Batch, ThrowingSourceEndsTheInput)
+{
+	auto files = inputs(20);
+	size_t next = 0;
+	std::vector<int> ok;
+	auto count = gd::processBatch([&](gd::BatchInput& input) {
+		if (next == 6)
+			throw std::runtime_error("source gone");
+		input.data = files[next++];
+		return true;
+	}, nullptr, [&](gd::BatchResult result) {
+		ok.push_back(result.ok);
+	}, threaded(true));
+
+	EXPECT_EQ(7u, count);
+	ASSERT_EQ(7u, ok.size());
+	for (size_t i = 0; i < 6; ++i)
+		EXPECT_TRUE(ok[i] == 1) << i;
+	EXPECT_FALSE(ok[6] == 1);
+}
+
+TEST(Batch, ThrowingSinkDoesNotStopTheBatch)
+{
+	auto files = inputs(20);
+	int calls = 0;
+	auto count = gd::processBatch(from(files), nullptr, [&](gd::BatchResult) {
+		++calls;
+		throw std::runtime_error("sink full");
+	}, threaded(true));
+
+	EXPECT_EQ(files.size(), count);
+	EXPECT_EQ(20, calls);
+}
+
+TEST(Batch, CancelledBeforeStartTakesNothing)
+{
+	auto files = inputs(5);
+	gd::CancelToken token;
+	token.cancel();
+	gd::CancelScope scope{ token };
+
+	int calls = 0;
+	auto count = gd::processBatch(from(files), nullptr, [&](gd::BatchResult) { ++calls; }, threaded(false));
+	EXPECT_EQ(0u, count);
+	EXPECT_EQ(0, calls);
+}
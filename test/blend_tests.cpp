@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <gdex.hpp>
+#include "pixels/blend.hpp"
+#include <vector>
+
+namespace
+{
+	int next(unsigned& seed)
+	{
+		seed = seed * 1103515245u + 12345u;
+		return (int)(seed >> 8) & 0x7FFFFFFF;
+	}
+
+	gd::GdImage noise(int w, int h, unsigned seed)
+	{
+		gd::GdImage img{ gdImageCreateTrueColor(w, h) };
+		auto view = img.mutableView();
+		for (int y = 0; y < h; ++y)
+			for (int x = 0; x < w; ++x)
+				view.row(y)[x] = next(seed);
+		return img;
+	}
+}
+
+TEST(Blend, RowMatchesGdAlphaBlend)
+{
+	// every pair of alphas, with colors from the whole range; an odd
+	// length leaves a tail for the scalar path
+	std::vector<int> dst, src;
+	unsigned seed = 7;
+	for (int a = 0; a <= gdAlphaMax; ++a)
+		for (int b = 0; b <= gdAlphaMax; ++b)
+			for (int i = 0; i < 3; ++i)
+			{
+				dst.push_back((a << 24) | (next(seed) & 0xFFFFFF));
+				src.push_back((b << 24) | (next(seed) & 0xFFFFFF));
+			}
+	dst.push_back(0x40FFFFFF);
+	src.push_back(0x40000000);
+
+	auto blended = dst;
+	gd::pixels::blendRow(blended.data(), src.data(), (int)blended.size());
+	for (size_t i = 0; i < dst.size(); ++i)
+	{
+		int expected = gdAlphaBlend(dst[i], src[i]);
+		ASSERT_EQ(expected, blended[i]) << std::hex << dst[i] << " " << src[i];
+		ASSERT_EQ(expected, gd::pixels::alphaBlend(dst[i], src[i])) << std::hex << dst[i] << " " << src[i];
+	}
+}
+
+TEST(Blend, CopyMatchesGdImageCopy)
+{
+	auto src = noise(77, 45, 8);
+	auto expected = noise(64, 64, 9);
+	auto actual = noise(64, 64, 9);
+	gdImageAlphaBlending(expected.get(), 1);
+	gdImageAlphaBlending(actual.get(), 1);
+
+	// partly off the destination on two sides
+	gdImageCopy(expected.get(), src.get(), -5, 30, 3, 2, 70, 40);
+	gd::copy(actual.get(), src.view().image(), -5, 30, 3, 2, 70, 40);
+
+	for (int y = 0; y < 64; ++y)
+		for (int x = 0; x < 64; ++x)
+			ASSERT_EQ(expected.view().row(y)[x], actual.view().row(y)[x]) << x << "," << y;
+}
+
+TEST(Blend, CopyPastTheSourceMatchesGdImageCopy)
+{
+	gd::GdImage palette{ gdImageCreate(10, 10) };
+	gdImageColorAllocate(palette.get(), 0, 255, 0);
+	gdImageColorAllocateAlpha(palette.get(), 255, 0, 0, 60);
+	gdImageFilledRectangle(palette.get(), 2, 2, 7, 7, 1);
+
+	auto truecolor = noise(10, 10, 10);
+	const gd::GdImage* sources[] = { &palette, &truecolor };
+	for (auto src : sources)
+		for (int blending = 0; blending < 2; ++blending)
+		{
+			auto expected = noise(16, 16, 11);
+			auto actual = noise(16, 16, 11);
+			gdImageAlphaBlending(expected.get(), blending);
+			gdImageAlphaBlending(actual.get(), blending);
+
+			gdImageCopy(expected.get(), const_cast<gdImagePtr>(src->view().image()), 0, 0, 5, 5, 10, 10);
+			gd::copy(actual.get(), src->view().image(), 0, 0, 5, 5, 10, 10);
+			gdImageCopy(expected.get(), const_cast<gdImagePtr>(src->view().image()), 9, 9, -3, -2, 6, 6);
+			gd::copy(actual.get(), src->view().image(), 9, 9, -3, -2, 6, 6);
+
+			for (int y = 0; y < 16; ++y)
+				for (int x = 0; x < 16; ++x)
+					ASSERT_EQ(expected.view().row(y)[x], actual.view().row(y)[x]) << x << "," << y;
+		}
+
+	// the wrapper defaults to the whole source size from any corner
+	auto expected = noise(16, 16, 12);
+	auto actual = noise(16, 16, 12);
+	gdImageCopy(expected.get(), truecolor.get(), 1, 1, 4, 3, 10, 10);
+	actual.copy(truecolor, 1, 1, 4, 3);
+	for (int y = 0; y < 16; ++y)
+		for (int x = 0; x < 16; ++x)
+			ASSERT_EQ(expected.view().row(y)[x], actual.view().row(y)[x]) << x << "," << y;
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <gtest/gtest.h>
+#include <gdex.hpp>
+#include <limits>
+
+namespace
+{
+	gd::GdImage dot(int size)
+	{
+		gd::GdImage img{ gdImageCreateTrueColor(size, size) };
+		img.mutableView().row(size / 2)[size / 2] = gdTrueColorAlpha(255, 255, 255, 0);
+		return img;
+	}
+}
+
+TEST(Blur, RejectsSigmasItCannotHonor)
+{
+	float bad[] = {
+		0.0f, -1.0f,
+		std::numeric_limits<float>::quiet_NaN(),
+		std::numeric_limits<float>::infinity(),
+		-std::numeric_limits<float>::infinity()
+	};
+
+	for (float sigma : bad)
+	{
+		auto img = dot(9);
+		EXPECT_FALSE(gd::blur(img.get(), sigma)) << sigma;
+		EXPECT_EQ(0, gd::blurExtent(sigma)) << sigma;
+		EXPECT_EQ(gdTrueColorAlpha(255, 255, 255, 0), img.view().row(4)[4]) << sigma;
+	}
+}
+
+TEST(Blur, ShadowOfNonFiniteSigmaIsNull)
+{
+	auto img = dot(9);
+	EXPECT_EQ(nullptr, gd::dropShadow(img.get(), std::numeric_limits<float>::quiet_NaN(), 0));
+	EXPECT_EQ(nullptr, gd::dropShadow(img.get(), std::numeric_limits<float>::infinity(), 0));
+
+	gd::GdImage sharp{ gd::dropShadow(img.get(), 0.0f, 0) };
+	ASSERT_TRUE(static_cast<bool>(sharp));
+	EXPECT_EQ(gdImageSX(img.get()), gdImageSX(sharp.get()));
+	EXPECT_EQ(gdImageSY(img.get()), gdImageSY(sharp.get()));
+}
+
+TEST(Blur, HugeSigmaStaysBounded)
+{
+	int cap = gd::blurExtent(16384.0f);
+	EXPECT_GT(cap, 0);
+	EXPECT_EQ(cap, gd::blurExtent(1e30f));
+
+	auto img = dot(9);
+	EXPECT_TRUE(gd::blur(img.get(), 1e30f));
+	// padded by cap on each side, more pixels than a gdImage holds
+	EXPECT_EQ(nullptr, gd::dropShadow(img.get(), 1e30f, 0));
+}
@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <gdex.hpp>
+#include <algorithm>
+
+namespace
+{
+	unsigned next(unsigned& seed)
+	{
+		seed = seed * 1103515245u + 12345u;
+		return seed >> 8;
+	}
+
+	bool empty(const gdImage* img, int x, int y)
+	{
+		if (img->trueColor)
+		{
+			int px = img->tpixels[y][x];
+			return gdTrueColorGetAlpha(px) == gdAlphaTransparent || (img->transparent >= 0 && px == img->transparent);
+		}
+		int c = img->pixels[y][x];
+		return c == img->transparent || img->alpha[c] == gdAlphaTransparent;
+	}
+
+	// Every pixel looked at
+	gd::Rect reference(const gd::ImageView& view)
+	{
+		auto img = view.image();
+		auto& crop = view.crop();
+		int left = crop.right(), top = crop.bottom(), right = crop.x, bottom = crop.y;
+		for (int y = crop.y; y < crop.bottom(); ++y)
+			for (int x = crop.x; x < crop.right(); ++x)
+				if (!empty(img, x, y))
+				{
+					left = std::min(left, x);
+					top = std::min(top, y);
+					right = std::max(right, x + 1);
+					bottom = std::max(bottom, y + 1);
+				}
+		if (left >= right)
+			return{ crop.x, crop.y, 0, 0 };
+		return{ left, top, right - left, bottom - top };
+	}
+
+	void expectBounds(const gd::Rect& expected, const gd::Rect& actual)
+	{
+		EXPECT_EQ(expected.x, actual.x);
+		EXPECT_EQ(expected.y, actual.y);
+		EXPECT_EQ(expected.width, actual.width);
+		EXPECT_EQ(expected.height, actual.height);
+	}
+
+	// A few content pixels scattered over transparency
+	gd::GdImage sparse(bool trueColor, int w, int h, unsigned& seed)
+	{
+		gd::GdImage img{ trueColor ? gdImageCreateTrueColor(w, h) : gdImageCreate(w, h) };
+		auto raw = img.get();
+		if (!trueColor)
+		{
+			gdImageColorAllocate(raw, 0, 0, 0);
+			gdImageColorAllocateAlpha(raw, 10, 10, 10, gdAlphaTransparent);
+			gdImageColorAllocate(raw, 200, 0, 0);
+			gdImageColorTransparent(raw, 0);
+		}
+		else
+			gd::fill(img.mutableView(), gdTrueColorAlpha(5, 5, 5, gdAlphaTransparent));
+
+		int dots = next(seed) % 4;
+		for (int i = 0; i < dots; ++i)
+		{
+			int x = next(seed) % w, y = next(seed) % h;
+			if (trueColor)
+				raw->tpixels[y][x] = gdTrueColorAlpha(200, 0, 0, next(seed) % gdAlphaTransparent);
+			else
+				raw->pixels[y][x] = 2;
+		}
+		return img;
+	}
+}
+
+TEST(Bounds, EmptyAndFullImages)
+{
+	gd::GdImage clear{ gdImageCreateTrueColor(20, 10) };
+	gd::fill(clear.mutableView(), gdTrueColorAlpha(0, 0, 0, gdAlphaTransparent));
+	EXPECT_TRUE(clear.contentBounds().empty());
+	EXPECT_TRUE(clear.trim());
+	EXPECT_EQ(20u, clear.width());
+
+	gd::GdImage opaque{ gdImageCreateTrueColor(20, 10) };
+	expectBounds({ 0, 0, 20, 10 }, opaque.contentBounds());
+	EXPECT_TRUE(opaque.trim());
+	EXPECT_EQ(20u, opaque.width());
+	EXPECT_EQ(10u, opaque.height());
+}
+
+TEST(Bounds, TrueColorKeyCountsAsEmpty)
+{
+	gd::GdImage img{ gdImageCreateTrueColor(30, 20) };
+	gd::fill(img.mutableView(), gdTrueColor(0, 255, 0));
+	img.get()->tpixels[4][7] = gdTrueColor(1, 2, 3);
+	img.get()->tpixels[15][22] = gdTrueColor(1, 2, 3);
+	expectBounds({ 0, 0, 30, 20 }, img.contentBounds());
+
+	gdImageColorTransparent(img.get(), gdTrueColor(0, 255, 0));
+	expectBounds({ 7, 4, 16, 12 }, img.contentBounds());
+	ASSERT_TRUE(img.trim());
+	EXPECT_EQ(16u, img.width());
+	EXPECT_EQ(12u, img.height());
+	EXPECT_EQ(gdTrueColor(1, 2, 3), img.view().row(0)[0]);
+	EXPECT_EQ(gdTrueColor(1, 2, 3), img.view().row(11)[15]);
+}
+
+TEST(Bounds, PaletteTransparencyCountsAsEmpty)
+{
+	gd::GdImage img{ gdImageCreate(30, 20) };
+	gdImageColorAllocate(img.get(), 0, 0, 0);
+	gdImageColorAllocateAlpha(img.get(), 10, 10, 10, gdAlphaTransparent);
+	gdImageColorAllocate(img.get(), 200, 0, 0);
+	gdImageColorTransparent(img.get(), 0);
+	for (int x = 0; x < 30; ++x)
+		img.get()->pixels[2][x] = 1;
+	img.get()->pixels[3][5] = 2;
+	img.get()->pixels[9][25] = 2;
+
+	expectBounds({ 5, 3, 21, 7 }, img.contentBounds());
+	ASSERT_TRUE(img.trim());
+	EXPECT_EQ(21u, img.width());
+	EXPECT_EQ(7u, img.height());
+	EXPECT_EQ(2, img.view().image()->pixels[0][0]);
+	EXPECT_EQ(0, img.view().image()->transparent);
+}
+
+TEST(Bounds, MatchReferenceInCroppedViews)
+{
+	unsigned seed = 23;
+	for (int i = 0; i < 400; ++i)
+	{
+		bool trueColor = i % 2 == 0;
+		int w = 1 + next(seed) % 45, h = 1 + next(seed) % 20;
+		auto img = sparse(trueColor, w, h, seed);
+
+		expectBounds(reference(img.view()), img.contentBounds());
+
+		int x = next(seed) % w, y = next(seed) % h;
+		gd::Rect crop{ x, y, 1 + (int)(next(seed) % (w - x)), 1 + (int)(next(seed) % (h - y)) };
+		auto view = img.view(crop);
+		expectBounds(reference(view), gd::contentBounds(view));
+		if (HasFailure())
+			return;
+	}
+}
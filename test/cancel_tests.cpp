@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <gtest/gtest.h>
+#include <gdex.hpp>
+#include <gdex_async.hpp>
+#include <gdex_io.hpp>
+#include <stdio.h>
+#include <math.h>
+
+namespace
+{
+	gd::GdImage noise(int w, int h, unsigned seed)
+	{
+		gd::GdImage img{ gdImageCreateTrueColor(w, h) };
+		auto view = img.mutableView();
+		for (int y = 0; y < h; ++y)
+			for (int x = 0; x < w; ++x)
+			{
+				seed = seed * 1103515245u + 12345u;
+				view.row(y)[x] = (int)(seed >> 8) & 0x7FFFFFFF;
+			}
+		return img;
+	}
+
+	gd::CancelToken raised()
+	{
+		gd::CancelToken token;
+		token.cancel();
+		return token;
+	}
+
+	// Passes reads on to inner and cancels token once limit bytes
+	// went through
+	struct CancelAfter : gdIOCtx
+	{
+		gdIOCtx* inner;
+		gd::CancelToken token;
+		int limit;
+		int read;
+
+		CancelAfter(gdIOCtx* inner, const gd::CancelToken& token, int limit)
+			: gdIOCtx(), inner(inner), token(token), limit(limit), read(0)
+		{
+			getC = [](gdIOCtx* ctx) {
+				auto self = static_cast<CancelAfter*>(ctx);
+				int c = self->inner->getC(self->inner);
+				self->count(c == EOF ? 0 : 1);
+				return c;
+			};
+			getBuf = [](gdIOCtx* ctx, void* buf, int size) {
+				auto self = static_cast<CancelAfter*>(ctx);
+				int got = self->inner->getBuf(self->inner, buf, size);
+				self->count(got > 0 ? got : 0);
+				return got;
+			};
+			seek = [](gdIOCtx* ctx, const int offset) { auto self = static_cast<CancelAfter*>(ctx); return self->inner->seek(self->inner, offset); };
+			tell = [](gdIOCtx* ctx) { auto self = static_cast<CancelAfter*>(ctx); return self->inner->tell(self->inner); };
+		}
+
+		void count(int bytes)
+		{
+			read += bytes;
+			if (read >= limit)
+				token.cancel();
+		}
+	};
+}
+
+TEST(Cancel, AnalysesReportCancellation)
+{
+	auto lhs = noise(200, 150, 1);
+	auto rhs = noise(200, 150, 1);
+	ASSERT_TRUE(gd::equal(lhs.view(), rhs.view()));
+
+	gd::CancelScope scope{ raised() };
+	EXPECT_FALSE(gd::equal(lhs.view(), rhs.view()));
+	EXPECT_EQ(255, gd::difference(lhs.view(), rhs.view()).maxChannel);
+	EXPECT_TRUE(std::isnan(gd::ssim(lhs.view(), rhs.view())));
+
+	const gdImage* images[] = { lhs.view().image(), rhs.view().image() };
+	uint64_t hashes[2];
+	EXPECT_FALSE(gd::perceptualHashes(images, 2, gd::HashKind::Difference, hashes));
+
+	auto sum = gd::reduce(lhs.view(), gd::Execution::Parallel, 0ll,
+		[](int px) { return (long long)gdTrueColorGetRed(px); },
+		[](long long a, long long b) { return a + b; });
+	EXPECT_EQ(0, sum);
+
+	EXPECT_EQ(0u, gd::statistics(lhs.view(), gd::StatisticsOptions{}).pixels);
+}
+
+TEST(Cancel, CompositeReportsCancellation)
+{
+	auto dst = noise(100, 100, 2);
+	auto src = noise(50, 50, 3);
+	gd::CancelScope scope{ raised() };
+	EXPECT_FALSE(gd::composite(dst.get(), src.view(), gd::CompositeOp::Over, 10, 10, 1.0f));
+}
+
+TEST(Cancel, TransformsLeaveTheImageAlone)
+{
+	auto img = noise(120, 80, 5);
+	gd::QuantizeOptions dithered;
+	dithered.dither = true;
+
+	gd::CancelScope scope{ raised() };
+	EXPECT_EQ(nullptr, gd::quantize(img.view().image(), gd::QuantizeOptions{}));
+	EXPECT_EQ(nullptr, gd::quantize(img.view().image(), dithered));
+	EXPECT_FALSE(img.quantize());
+	EXPECT_FALSE(img.resample(60, 40));
+	EXPECT_FALSE(img.rotate(gd::Rotation::Rotate90));
+	EXPECT_FALSE(img.transpose());
+	EXPECT_EQ(120u, img.width());
+	EXPECT_TRUE(img.view().image()->trueColor != 0);
+
+	gd::GdImage palette{ gdImageCreate(30, 20) };
+	gdImageColorAllocate(palette.get(), 10, 20, 30);
+	EXPECT_FALSE(palette.toTrueColor());
+	EXPECT_FALSE(palette.view().image()->trueColor != 0);
+	// nothing to crop is not a failure
+	EXPECT_TRUE(palette.trim());
+}
+
+TEST(Cancel, AsyncResampleHandsBackNothing)
+{
+	auto img = noise(120, 80, 6);
+	std::future<gd::GdImage> result;
+	{
+		gd::CancelScope scope{ raised() };
+		result = gd::resampleAsync(std::move(img), 60, 40);
+	}
+	EXPECT_FALSE(static_cast<bool>(result.get()));
+
+	auto resampled = gd::resampleAsync(noise(120, 80, 6), 60, 40).get();
+	ASSERT_TRUE(static_cast<bool>(resampled));
+	EXPECT_EQ(60u, resampled.width());
+}
+
+TEST(Cancel, UncancelledTokenChangesNothing)
+{
+	auto lhs = noise(200, 150, 1);
+	auto rhs = noise(200, 150, 1);
+	gd::CancelScope scope{ gd::CancelToken{} };
+	EXPECT_TRUE(gd::equal(lhs.view(), rhs.view()));
+	EXPECT_DOUBLE_EQ(1.0, gd::ssim(lhs.view(), rhs.view()));
+	EXPECT_EQ(200u * 150u, gd::statistics(lhs.view(), gd::StatisticsOptions{}).pixels);
+	EXPECT_TRUE(gd::composite(lhs.get(), rhs.view(), gd::CompositeOp::Over, 0, 0, 1.0f));
+}
+
+TEST(Cancel, CancelledTokenStopsADecode)
+{
+	auto img = noise(300, 200, 4);
+	std::vector<unsigned char> file;
+	ASSERT_TRUE(gd::encodeImage(img.view().image(), gd::EncodeOptions{}, file));
+
+	{
+		gd::CancelScope scope{ gd::CancelToken{} };
+		gd::GdImage full{ gd::loadImage((int)file.size(), file.data()) };
+		EXPECT_TRUE(static_cast<bool>(full));
+	}
+
+	gd::CancelScope scope{ raised() };
+	gd::GdImage cut{ gd::loadImage((int)file.size(), file.data()) };
+	EXPECT_FALSE(static_cast<bool>(cut));
+}
+
+TEST(Cancel, ReadsFailOnceCancelledMidDecode)
+{
+	auto img = noise(300, 200, 5);
+	std::vector<unsigned char> file;
+	ASSERT_TRUE(gd::encodeImage(img.view().image(), gd::EncodeOptions{}, file));
+
+	gd::CancelToken token;
+	auto memory = gd::IOCtx::createFromReadOnlyMemory((int)file.size(), file.data());
+	CancelAfter counting{ memory.get(), token, (int)file.size() / 4 };
+	gd::IOCtx reader{ gd::newCancellableCtx(&counting, token) };
+	ASSERT_TRUE(static_cast<bool>(reader));
+
+	gd::GdImage cut{ gdImageCreateFromPngCtx(reader.get()) };
+	EXPECT_FALSE(static_cast<bool>(cut));
+	EXPECT_TRUE(token.cancelled());
+	// nothing read past the first chunk that crossed the limit
+	EXPECT_LT(counting.read, (int)file.size());
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <gtest/gtest.h>
+#include <gdex.hpp>
+#include <algorithm>
+#include <math.h>
+
+namespace
+{
+	gd::GdImage filled(int w, int h, int color)
+	{
+		gd::GdImage img{ gdImageCreateTrueColor(w, h) };
+		auto view = img.mutableView();
+		for (int y = 0; y < h; ++y)
+			std::fill(view.row(y), view.row(y) + w, color);
+		return img;
+	}
+
+	gd::GdImage noise(int w, int h, unsigned seed)
+	{
+		gd::GdImage img{ gdImageCreateTrueColor(w, h) };
+		auto view = img.mutableView();
+		for (int y = 0; y < h; ++y)
+			for (int x = 0; x < w; ++x)
+			{
+				seed = seed * 1103515245u + 12345u;
+				view.row(y)[x] = (int)(seed >> 8) & 0x7FFFFFFF;
+			}
+		return img;
+	}
+
+	// SSIM of two flat images, where only the luminance term is left
+	double flatSsim(double lhs, double rhs)
+	{
+		double c1 = (0.01 * 255) * (0.01 * 255);
+		return (2 * lhs * rhs + c1) / (lhs * lhs + rhs * rhs + c1);
+	}
+}
+
+TEST(Compare, IdenticalImages)
+{
+	auto lhs = noise(123, 45, 1);
+	auto rhs = noise(123, 45, 1);
+	EXPECT_TRUE(gd::equal(lhs.view(), rhs.view()));
+
+	auto diff = gd::difference(lhs.view(), rhs.view());
+	EXPECT_EQ(0, diff.maxChannel);
+	EXPECT_EQ(0.0, diff.mse);
+	EXPECT_TRUE(std::isinf(diff.psnr));
+	EXPECT_DOUBLE_EQ(1.0, gd::ssim(lhs.view(), rhs.view()));
+}
+
+TEST(Compare, KnownErrors)
+{
+	auto lhs = filled(64, 48, gdTrueColorAlpha(0, 0, 0, 0));
+	auto rhs = filled(64, 48, gdTrueColorAlpha(10, 10, 10, 0));
+	EXPECT_FALSE(gd::equal(lhs.view(), rhs.view()));
+
+	// three channels off by 10, alpha the same
+	auto diff = gd::difference(lhs.view(), rhs.view());
+	EXPECT_EQ(10, diff.maxChannel);
+	EXPECT_DOUBLE_EQ(75.0, diff.mse);
+	EXPECT_NEAR(10.0 * log10(255.0 * 255.0 / 75.0), diff.psnr, 1e-9);
+	EXPECT_NEAR(flatSsim(0, 10), gd::ssim(lhs.view(), rhs.view()), 1e-9);
+
+	// alpha counts double
+	auto faded = filled(64, 48, gdTrueColorAlpha(0, 0, 0, 5));
+	diff = gd::difference(lhs.view(), faded.view());
+	EXPECT_EQ(10, diff.maxChannel);
+	EXPECT_DOUBLE_EQ(25.0, diff.mse);
+}
+
+TEST(Compare, DifferentSizes)
+{
+	auto lhs = filled(10, 10, 0);
+	auto rhs = filled(10, 11, 0);
+	EXPECT_FALSE(gd::equal(lhs.view(), rhs.view()));
+	EXPECT_EQ(0.0, gd::ssim(lhs.view(), rhs.view()));
+	EXPECT_EQ(255, gd::difference(lhs.view(), rhs.view()).maxChannel);
+}
+
+TEST(Compare, SsimFallsWithNoise)
+{
+	auto clean = filled(96, 96, gdTrueColorAlpha(128, 128, 128, 0));
+	auto noisy = noise(96, 96, 7);
+	auto lightly = filled(96, 96, gdTrueColorAlpha(128, 128, 128, 0));
+	auto view = lightly.mutableView();
+	for (int y = 0; y < 96; y += 3)
+		view.row(y)[y] = gdTrueColorAlpha(140, 128, 128, 0);
+
+	double light = gd::ssim(clean.view(), lightly.view());
+	double heavy = gd::ssim(clean.view(), noisy.view());
+	EXPECT_LT(light, 1.0);
+	EXPECT_GT(light, 0.9);
+	EXPECT_LT(heavy, light);
+}
+
+// Too thin for a window, so the strip is a single one, summed over
+// more pixels than 32-bit moments hold
+TEST(Compare, SsimOfThinStrips)
+{
+	auto lhs = filled(10000, 7, gdTrueColorAlpha(255, 255, 255, 0));
+	auto rhs = filled(10000, 7, gdTrueColorAlpha(255, 255, 255, 0));
+	EXPECT_DOUBLE_EQ(1.0, gd::ssim(lhs.view(), rhs.view()));
+
+	auto grey = filled(7, 10000, gdTrueColorAlpha(200, 200, 200, 0));
+	auto white = filled(7, 10000, gdTrueColorAlpha(255, 255, 255, 0));
+	EXPECT_NEAR(flatSsim(200, 255), gd::ssim(grey.view(), white.view()), 1e-6);
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <gdex.hpp>
+#include <algorithm>
+#include <limits>
+#include <math.h>
+
+namespace
+{
+	int pattern(int x, int y)
+	{
+		return gdTrueColorAlpha((x * 37) & 255, (y * 59) & 255, (x * y) & 255, (x + 3 * y) % (gdAlphaMax + 1));
+	}
+
+	gd::GdImage patterned(int w, int h, int seed)
+	{
+		gd::GdImage img{ gdImageCreateTrueColor(w, h) };
+		auto view = img.mutableView();
+		for (int y = 0; y < h; ++y)
+			for (int x = 0; x < w; ++x)
+				view.row(y)[x] = pattern(x + seed, y + 2 * seed);
+		return img;
+	}
+
+	// Porter-Duff in double precision: Fa and Fb per operator, colors
+	// weighted by coverage, as the kernels are documented to do
+	int reference(gd::CompositeOp op, int d, int s, double opacity)
+	{
+		double as = (gdAlphaMax - gdTrueColorGetAlpha(s)) / (double)gdAlphaMax * opacity;
+		double ad = (gdAlphaMax - gdTrueColorGetAlpha(d)) / (double)gdAlphaMax;
+		double fa = 0, fb = 0;
+		switch (op)
+		{
+		case gd::CompositeOp::Clear:           fa = 0; fb = 0; break;
+		case gd::CompositeOp::Source:          fa = 1; fb = 0; break;
+		case gd::CompositeOp::Over:            fa = 1; fb = 1 - as; break;
+		case gd::CompositeOp::In:              fa = ad; fb = 0; break;
+		case gd::CompositeOp::Out:             fa = 1 - ad; fb = 0; break;
+		case gd::CompositeOp::Atop:            fa = ad; fb = 1 - as; break;
+		case gd::CompositeOp::DestinationOver: fa = 1 - ad; fb = 1; break;
+		case gd::CompositeOp::DestinationIn:   fa = 0; fb = as; break;
+		case gd::CompositeOp::DestinationOut:  fa = 0; fb = 1 - as; break;
+		case gd::CompositeOp::Xor:             fa = 1 - ad; fb = 1 - as; break;
+		}
+
+		double ws = as * fa;
+		double wd = ad * fb;
+		double ar = ws + wd;
+		if (ar <= 1e-6)
+			return -1; // color undefined, only alpha is checked
+
+		int r = (int)((gdTrueColorGetRed(s) * ws + gdTrueColorGetRed(d) * wd) / ar + 0.5);
+		int g = (int)((gdTrueColorGetGreen(s) * ws + gdTrueColorGetGreen(d) * wd) / ar + 0.5);
+		int b = (int)((gdTrueColorGetBlue(s) * ws + gdTrueColorGetBlue(d) * wd) / ar + 0.5);
+		return gdTrueColorAlpha(r, g, b, gdAlphaMax - (int)(ar * gdAlphaMax + 0.5));
+	}
+
+	bool near(int expected, int actual)
+	{
+		if (expected < 0)
+			return gdTrueColorGetAlpha(actual) == gdAlphaTransparent;
+		return abs(gdTrueColorGetRed(expected) - gdTrueColorGetRed(actual)) <= 1
+			&& abs(gdTrueColorGetGreen(expected) - gdTrueColorGetGreen(actual)) <= 1
+			&& abs(gdTrueColorGetBlue(expected) - gdTrueColorGetBlue(actual)) <= 1
+			&& abs(gdTrueColorGetAlpha(expected) - gdTrueColorGetAlpha(actual)) <= 1;
+	}
+}
+
+TEST(Composite, OperatorsMatchPorterDuff)
+{
+	const int w = 37, h = 29;
+	auto src = patterned(w, h, 5);
+	for (int op = (int)gd::CompositeOp::Clear; op <= (int)gd::CompositeOp::Xor; ++op)
+	{
+		for (float opacity : { 1.0f, 0.6f })
+		{
+			auto dst = patterned(w, h, 11);
+			auto before = patterned(w, h, 11);
+			ASSERT_TRUE(gd::composite(dst.get(), src.view(), (gd::CompositeOp)op, 0, 0, opacity));
+
+			for (int y = 0; y < h; ++y)
+			{
+				for (int x = 0; x < w; ++x)
+				{
+					auto expected = reference((gd::CompositeOp)op, before.view().pixel(x, y), src.view().pixel(x, y), opacity);
+					ASSERT_TRUE(near(expected, dst.view().pixel(x, y))) << "op " << op << " opacity " << opacity << " at " << x << "," << y;
+				}
+			}
+		}
+	}
+}
+
+TEST(Composite, OverlappingSelfReadsTheOriginal)
+{
+	const int w = 300, h = 1200;
+	for (int dy : { -7, 7 })
+	{
+		auto img = patterned(w, h, 3);
+		auto expected = patterned(w, h, 3);
+		auto copy = patterned(w, h, 3);
+
+		ASSERT_TRUE(gd::composite(expected.get(), copy.view(), gd::CompositeOp::Over, 5, dy, 0.8f));
+		ASSERT_TRUE(gd::composite(img.get(), img.view(), gd::CompositeOp::Over, 5, dy, 0.8f));
+		EXPECT_TRUE(gd::equal(expected.view(), img.view())) << "dy " << dy;
+	}
+}
+
+// 11 pixels: the vector kernels take the first 8, the scalar tail the
+// rest, and a barely visible source must come out the same in both
+TEST(Composite, SimdAndScalarAgreeOnTinyCoverage)
+{
+	for (float opacity : { 1e-7f, 1e-5f, 0.001f })
+	{
+		gd::GdImage dst{ gdImageCreateTrueColor(11, 1) };
+		gd::GdImage src{ gdImageCreateTrueColor(11, 1) };
+		std::fill(dst.mutableView().row(0), dst.mutableView().row(0) + 11, gdTrueColorAlpha(0, 0, 0, gdAlphaTransparent));
+		std::fill(src.mutableView().row(0), src.mutableView().row(0) + 11, gdTrueColorAlpha(200, 100, 50, 0));
+
+		ASSERT_TRUE(gd::composite(dst.get(), src.view(), gd::CompositeOp::Over, 0, 0, opacity));
+		auto row = dst.view().row(0);
+		for (int x = 1; x < 11; ++x)
+			EXPECT_EQ(row[0], row[x]) << "opacity " << opacity << " at " << x;
+	}
+}
+
+TEST(Composite, RejectsWhatItCannotDo)
+{
+	auto src = patterned(8, 8, 1);
+	gd::GdImage palette{ gdImageCreate(8, 8) };
+	auto dst = patterned(8, 8, 2);
+
+	EXPECT_FALSE(gd::composite(palette.get(), src.view(), gd::CompositeOp::Over, 0, 0, 1.0f));
+	EXPECT_FALSE(gd::composite(dst.get(), src.view(), (gd::CompositeOp)42, 0, 0, 1.0f));
+
+	auto before = patterned(8, 8, 2);
+	float bad[] = {
+		std::numeric_limits<float>::quiet_NaN(),
+		std::numeric_limits<float>::infinity(),
+		-std::numeric_limits<float>::infinity()
+	};
+	for (float opacity : bad)
+	{
+		EXPECT_FALSE(gd::composite(dst.get(), src.view(), gd::CompositeOp::Over, 0, 0, opacity)) << opacity;
+		EXPECT_TRUE(dst.equals(before)) << opacity;
+	}
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <gdex.hpp>
+#include <stdlib.h>
+#include <string>
+
+namespace
+{
+	// nullptr unsets it
+	void setSimd(const char* value)
+	{
+#ifdef _WIN32
+		_putenv_s("GDEX_SIMD", value ? value : "");
+#else
+		if (value)
+			setenv("GDEX_SIMD", value, 1);
+		else
+			unsetenv("GDEX_SIMD");
+#endif
+	}
+}
+
+TEST(Cpu, LevelIsFixedOnFirstUse)
+{
+	auto level = gd::simdLevel();
+	auto previous = getenv("GDEX_SIMD");
+	std::string restore = previous ? previous : "";
+
+	setSimd(level == gd::SimdLevel::Scalar ? "avx2" : "scalar");
+	EXPECT_EQ(level, gd::simdLevel());
+
+	setSimd(previous ? restore.c_str() : nullptr);
+}
@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <gdex.hpp>
+#include <stdlib.h>
+#include <deque>
+#include <vector>
+
+namespace
+{
+	unsigned next(unsigned& seed)
+	{
+		seed = seed * 1103515245u + 12345u;
+		return seed >> 8;
+	}
+
+	bool near(int a, int b, int tolerance)
+	{
+		return abs(gdTrueColorGetRed(a) - gdTrueColorGetRed(b)) <= tolerance
+			&& abs(gdTrueColorGetGreen(a) - gdTrueColorGetGreen(b)) <= tolerance
+			&& abs(gdTrueColorGetBlue(a) - gdTrueColorGetBlue(b)) <= tolerance
+			&& abs(gdTrueColorGetAlpha(a) - gdTrueColorGetAlpha(b)) <= tolerance;
+	}
+
+	int colorAt(const gdImage* img, int x, int y)
+	{
+		if (img->trueColor)
+			return img->tpixels[y][x];
+		int c = img->pixels[y][x];
+		return gdTrueColorAlpha(img->red[c], img->green[c], img->blue[c], img->alpha[c]);
+	}
+
+	// Breadth first over the 4-connected neighbours inside the clip
+	// rectangle, painting only once the region is known
+	void referenceFill(gdImagePtr img, int x, int y, int color, int tolerance)
+	{
+		if (x < img->cx1 || y < img->cy1 || x > img->cx2 || y > img->cy2)
+			return;
+
+		int seed = colorAt(img, x, y);
+		std::vector<char> region((size_t)img->sx * img->sy, 0);
+		std::deque<std::pair<int, int>> queue{ { x, y } };
+		region[(size_t)y * img->sx + x] = 1;
+		while (!queue.empty())
+		{
+			auto at = queue.front();
+			queue.pop_front();
+			const int dx[] = { -1, 1, 0, 0 }, dy[] = { 0, 0, -1, 1 };
+			for (int i = 0; i < 4; ++i)
+			{
+				int nx = at.first + dx[i], ny = at.second + dy[i];
+				if (nx < img->cx1 || ny < img->cy1 || nx > img->cx2 || ny > img->cy2)
+					continue;
+				auto& seen = region[(size_t)ny * img->sx + nx];
+				if (seen || !near(colorAt(img, nx, ny), seed, tolerance))
+					continue;
+				seen = 1;
+				queue.push_back({ nx, ny });
+			}
+		}
+
+		for (int py = 0; py < img->sy; ++py)
+			for (int px = 0; px < img->sx; ++px)
+				if (region[(size_t)py * img->sx + px])
+				{
+					if (img->trueColor)
+						img->tpixels[py][px] = color;
+					else
+						img->pixels[py][px] = (unsigned char)color;
+				}
+	}
+
+	// Blotches of a few close and a few distant colors
+	const int shades[] = {
+		gdTrueColor(10, 10, 10), gdTrueColor(14, 12, 10), gdTrueColor(200, 40, 40), gdTrueColorAlpha(10, 10, 10, 60)
+	};
+
+	gd::GdImage blotches(bool trueColor, int w, int h, unsigned& seed)
+	{
+		gd::GdImage img{ trueColor ? gdImageCreateTrueColor(w, h) : gdImageCreate(w, h) };
+		if (!trueColor)
+		{
+			for (int shade : shades)
+				gdImageColorAllocateAlpha(img.get(), gdTrueColorGetRed(shade), gdTrueColorGetGreen(shade),
+					gdTrueColorGetBlue(shade), gdTrueColorGetAlpha(shade));
+		}
+
+		for (int y = 0; y < h; ++y)
+			for (int x = 0; x < w; ++x)
+			{
+				// mostly the neighbour's color, so regions grow ragged
+				int pick = next(seed) % 4;
+				if (x > 0 && next(seed) % 3)
+					pick = trueColor ? -1 : img.get()->pixels[y][x - 1];
+				if (trueColor)
+					img.get()->tpixels[y][x] = pick < 0 ? img.get()->tpixels[y][x - 1] : shades[pick];
+				else
+					img.get()->pixels[y][x] = (unsigned char)pick;
+			}
+		return img;
+	}
+
+	void expectSame(const gdImage* expected, const gdImage* actual)
+	{
+		for (int y = 0; y < expected->sy; ++y)
+			for (int x = 0; x < expected->sx; ++x)
+				ASSERT_EQ(colorAt(expected, x, y), colorAt(actual, x, y)) << x << "," << y;
+	}
+
+	void compareFills(bool trueColor, int tolerance, bool clipped)
+	{
+		unsigned seed = 17 + tolerance;
+		gd::FillStack stack;
+		for (int i = 0; i < 200; ++i)
+		{
+			int w = 1 + next(seed) % 40, h = 1 + next(seed) % 30;
+			auto expected = blotches(trueColor, w, h, seed);
+			gd::GdImage actual{ gd::crop(expected.view()) };
+
+			if (clipped)
+			{
+				int x1 = next(seed) % w, y1 = next(seed) % h;
+				int x2 = x1 + next(seed) % (w - x1), y2 = y1 + next(seed) % (h - y1);
+				gdImageSetClip(expected.get(), x1, y1, x2, y2);
+				gdImageSetClip(actual.get(), x1, y1, x2, y2);
+			}
+
+			int x = next(seed) % w, y = next(seed) % h;
+			// sometimes one of the region's own colors
+			int pick = next(seed) % 4;
+			int color = trueColor ? shades[pick] : pick;
+
+			referenceFill(expected.get(), x, y, color, tolerance);
+			gd::floodFill(actual.get(), x, y, color, tolerance, stack);
+			expectSame(expected.get(), actual.get());
+			if (::testing::Test::HasFatalFailure())
+				return;
+		}
+	}
+}
+
+TEST(FloodFill, MatchesReferenceFill)
+{
+	compareFills(true, 0, false);
+	compareFills(false, 0, false);
+}
+
+TEST(FloodFill, ToleranceTakesInNearColors)
+{
+	compareFills(true, 5, false);
+	compareFills(false, 5, false);
+
+	// the two dark shades are 4 apart
+	for (int tolerance = 3; tolerance <= 4; ++tolerance)
+	{
+		gd::GdImage img{ gdImageCreateTrueColor(4, 1) };
+		img.get()->tpixels[0][0] = shades[0];
+		img.get()->tpixels[0][1] = shades[1];
+		img.get()->tpixels[0][2] = shades[0];
+		img.get()->tpixels[0][3] = shades[2];
+		gd::FillStack stack;
+		gd::floodFill(img.get(), 0, 0, 0xFFFFFF, tolerance, stack);
+
+		bool joined = tolerance >= 4;
+		EXPECT_EQ(joined ? 0xFFFFFF : shades[1], img.view().row(0)[1]) << tolerance;
+		EXPECT_EQ(joined ? 0xFFFFFF : shades[0], img.view().row(0)[2]) << tolerance;
+		EXPECT_EQ(shades[2], img.view().row(0)[3]) << tolerance;
+	}
+}
+
+TEST(FloodFill, StaysWithinTheClipRectangle)
+{
+	compareFills(true, 0, true);
+	compareFills(false, 5, true);
+
+	gd::GdImage img{ gdImageCreateTrueColor(10, 10) };
+	gdImageSetClip(img.get(), 2, 2, 5, 5);
+	gd::FillStack stack;
+	gd::floodFill(img.get(), 0, 0, 0xFF0000, 0, stack);
+	EXPECT_EQ(0, img.view().row(0)[0]);
+	gd::floodFill(img.get(), 3, 3, 0xFF0000, 0, stack);
+	EXPECT_EQ(0xFF0000, img.view().row(2)[2]);
+	EXPECT_EQ(0xFF0000, img.view().row(5)[5]);
+	EXPECT_EQ(0, img.view().row(6)[5]);
+	EXPECT_EQ(0, img.view().row(1)[3]);
+}
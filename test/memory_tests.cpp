@@ -0,0 +1,276 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <gtest/gtest.h>
+#include <gdex_async.hpp>
+#include <gdex_batch.hpp>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <stdio.h>
+#include <thread>
+
+namespace
+{
+	class Memory : public ::testing::Test
+	{
+	protected:
+		void TearDown() override
+		{
+			gd::configureMemoryBudget(gd::MemoryBudget{});
+			gd::configurePool(gd::PoolOptions{});
+			remove(path());
+		}
+
+		static const char* path() { return "gdex_memory_test.png"; }
+
+		// a 300x200 truecolor PNG, about 240 kB once decoded
+		static std::vector<unsigned char> png()
+		{
+			gd::GdImage img{ gdImageCreateTrueColor(300, 200) };
+			std::vector<unsigned char> file;
+			EXPECT_TRUE(gd::encodeImage(img.view().image(), gd::EncodeOptions{}, file));
+			return file;
+		}
+
+		static void save(const std::vector<unsigned char>& file)
+		{
+			auto f = fopen(path(), "wb");
+			ASSERT_TRUE(f != nullptr);
+			fwrite(file.data(), 1, file.size(), f);
+			fclose(f);
+		}
+	};
+}
+
+TEST_F(Memory, RejectWhenFull)
+{
+	gd::configureMemoryBudget(gd::MemoryBudget{ 1000, gd::Admission::Reject });
+
+	bool counted = false;
+	EXPECT_FALSE(gd::reserveMemory(1001, counted));
+	EXPECT_FALSE(counted);
+
+	ASSERT_TRUE(gd::reserveMemory(600, counted));
+	EXPECT_TRUE(counted);
+	EXPECT_EQ(600u, gd::memoryInUse());
+	EXPECT_FALSE(gd::reserveMemory(600, counted));
+
+	gd::releaseMemory(600);
+	EXPECT_EQ(0u, gd::memoryInUse());
+	EXPECT_TRUE(gd::reserveMemory(600, counted));
+	gd::releaseMemory(600);
+}
+
+TEST_F(Memory, WaitUntilReleased)
+{
+	gd::configureMemoryBudget(gd::MemoryBudget{ 1000 });
+
+	gd::MemoryReservation first{ 800 };
+	ASSERT_TRUE(static_cast<bool>(first));
+
+	std::atomic<bool> admitted{ false };
+	std::thread waiter{ [&] {
+		gd::MemoryReservation second{ 500 };
+		admitted = static_cast<bool>(second);
+	} };
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	EXPECT_FALSE(admitted);
+	first.reset();
+	waiter.join();
+	EXPECT_TRUE(admitted);
+	EXPECT_EQ(0u, gd::memoryInUse());
+}
+
+TEST_F(Memory, CancelledWaitGivesUp)
+{
+	gd::configureMemoryBudget(gd::MemoryBudget{ 1000 });
+	gd::MemoryReservation first{ 800 };
+
+	gd::CancelToken token;
+	std::atomic<bool> admitted{ true };
+	std::thread waiter{ [&] {
+		gd::CancelScope scope{ token };
+		gd::MemoryReservation second{ 500 };
+		admitted = static_cast<bool>(second);
+	} };
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	token.cancel();
+	waiter.join();
+	EXPECT_FALSE(admitted);
+	EXPECT_EQ(800u, gd::memoryInUse());
+}
+
+TEST_F(Memory, LoadedImagesCarryTheirCharge)
+{
+	auto file = png();
+	gd::configureMemoryBudget(gd::MemoryBudget{ 1 << 20, gd::Admission::Reject });
+
+	{
+		gd::GdImage img{ gd::loadImage((int)file.size(), file.data()) };
+		ASSERT_TRUE(static_cast<bool>(img));
+		EXPECT_EQ(gd::imageFootprint(img.view().image()), gd::memoryInUse());
+	}
+	EXPECT_EQ(0u, gd::memoryInUse());
+
+	gd::configureMemoryBudget(gd::MemoryBudget{ 100 * 1024, gd::Admission::Reject });
+	EXPECT_EQ(nullptr, gd::loadImage((int)file.size(), file.data()));
+	EXPECT_EQ(0u, gd::memoryInUse());
+}
+
+TEST_F(Memory, FilesAreReservedBeforeReading)
+{
+	auto file = png();
+	save(file);
+
+	gd::configureMemoryBudget(gd::MemoryBudget{ 100 * 1024, gd::Admission::Reject });
+	std::vector<unsigned char> bytes;
+	gd::MemoryReservation reserved;
+	EXPECT_FALSE(gd::readFile(path(), bytes, gd::LoadOptions{}, reserved));
+	EXPECT_TRUE(bytes.empty());
+	EXPECT_EQ(nullptr, gd::loadImage(path()));
+
+	auto rejected = gd::loadImageAsync(path());
+	EXPECT_FALSE(static_cast<bool>(rejected.get()));
+	EXPECT_EQ(0u, gd::memoryInUse());
+
+	gd::configureMemoryBudget(gd::MemoryBudget{ 1 << 20, gd::Admission::Reject });
+	ASSERT_TRUE(gd::readFile(path(), bytes, gd::LoadOptions{}, reserved));
+	EXPECT_EQ(file, bytes);
+	EXPECT_GE(gd::memoryInUse(), file.size() + 300 * 200 * 4);
+
+	gd::Opacity opacity;
+	gd::GdImage img{ gd::loadImage((int)bytes.size(), bytes.data(), gd::LoadOptions{}, opacity, reserved) };
+	ASSERT_TRUE(static_cast<bool>(img));
+	EXPECT_EQ(gd::imageFootprint(img.view().image()), gd::memoryInUse());
+}
+
+TEST_F(Memory, BatchUnderATightBudget)
+{
+	save(png());
+
+	// room for about two images at a time, against more threads
+	// than that wanting one each
+	gd::configureMemoryBudget(gd::MemoryBudget{ 600 * 1024 });
+	gd::BatchOptions options;
+	options.readers = 3;
+	options.decoders = 3;
+	options.encoders = 2;
+	options.queueDepth = 2;
+
+	std::vector<std::string> paths(30, path());
+	int ok = 0;
+	gd::processBatch(paths, nullptr, [&](gd::BatchResult result) { ok += result.ok; }, options);
+	EXPECT_EQ(30, ok);
+	EXPECT_EQ(0u, gd::memoryInUse());
+}
+
+// Every worker busy in a task that loads under a full budget, and the
+// memory they would wait for is freed by a task queued behind them
+TEST_F(Memory, PoolWorkersAreNotParkedOnTheBudget)
+{
+	auto file = png();
+	gd::PoolOptions pool;
+	pool.threads = 2;
+	ASSERT_TRUE(gd::configurePool(pool));
+	gd::configureMemoryBudget(gd::MemoryBudget{ 300 * 1024 });
+
+	gd::MemoryReservation hog{ 200 * 1024 };
+	std::vector<std::promise<bool>> loaded(2);
+	for (auto& result : loaded)
+	{
+		auto promise = &result;
+		gd::post(gd::Priority::Bulk, [&file, promise] {
+			gd::GdImage img{ gd::loadImage((int)file.size(), file.data()) };
+			promise->set_value(static_cast<bool>(img));
+		});
+	}
+	std::promise<void> freed;
+	gd::post(gd::Priority::Bulk, [&] {
+		hog.reset();
+		freed.set_value();
+	});
+
+	auto done = freed.get_future();
+	ASSERT_EQ(std::future_status::ready, done.wait_for(std::chrono::seconds(20)));
+	for (auto& result : loaded)
+	{
+		auto future = result.get_future();
+		ASSERT_EQ(std::future_status::ready, future.wait_for(std::chrono::seconds(20)));
+	}
+}
+
+TEST_F(Memory, AsyncDecodesWaitOffThePool)
+{
+	auto file = png();
+	gd::PoolOptions pool;
+	pool.threads = 1;
+	ASSERT_TRUE(gd::configurePool(pool));
+	// room for one decoded image at a time
+	gd::configureMemoryBudget(gd::MemoryBudget{ 300 * 1024 });
+
+	const int count = 6;
+	std::atomic<int> left{ count }, ok{ 0 };
+	std::promise<void> finished;
+	for (int i = 0; i < count; ++i)
+	{
+		gd::decodeImageAsync(file, gd::LoadOptions{}, [&](gd::GdImage img) {
+			ok += static_cast<bool>(img);
+			img.reset(nullptr);
+			if (--left == 0)
+				finished.set_value();
+		});
+	}
+
+	auto done = finished.get_future();
+	ASSERT_EQ(std::future_status::ready, done.wait_for(std::chrono::seconds(20)));
+	EXPECT_EQ(count, ok.load());
+	EXPECT_EQ(0u, gd::memoryInUse());
+}
+
+// What an image freed with gdImageDestroy leaves behind, seen from the
+// next image to get its address
+TEST_F(Memory, StaleChargesAreReplaced)
+{
+	::testing::FLAGS_gtest_death_test_style = "threadsafe";
+	gd::configureMemoryBudget(gd::MemoryBudget{ 1 << 20, gd::Admission::Reject });
+
+	gd::GdImage img{ gdImageCreateTrueColor(10, 10) };
+	auto raw = img.view().image();
+	bool counted = false;
+	ASSERT_TRUE(gd::reserveMemory(100, counted));
+	gd::chargeImage(raw, 100);
+
+	EXPECT_DEBUG_DEATH({
+		gd::reserveMemory(100, counted);
+		gd::chargeImage(raw, 100);
+	}, "without destroyImage");
+	EXPECT_EQ(gd::imageFootprint(raw), gd::memoryInUse());
+
+	img.reset(nullptr);
+	EXPECT_EQ(0u, gd::memoryInUse());
+}
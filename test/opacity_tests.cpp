@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <gtest/gtest.h>
+#include <gdex.hpp>
+#include <thread>
+
+TEST(Opacity, Classifies)
+{
+	gd::GdImage img{ gdImageCreateTrueColor(40, 30) };
+	img.fillRectangle(gdTrueColorAlpha(10, 20, 30, 0));
+	EXPECT_EQ(gd::Opacity::Opaque, img.opacity());
+
+	img.mutableView().row(7)[3] = gdTrueColorAlpha(10, 20, 30, gdAlphaTransparent);
+	EXPECT_EQ(gd::Opacity::BinaryAlpha, img.opacity());
+
+	img.mutableView().row(8)[3] = gdTrueColorAlpha(10, 20, 30, 64);
+	EXPECT_EQ(gd::Opacity::FullAlpha, img.opacity());
+}
+
+TEST(Opacity, CachedFromManyThreads)
+{
+	gd::GdImage img{ gdImageCreateTrueColor(300, 300) };
+	img.fillRectangle(gdTrueColorAlpha(10, 20, 30, 0));
+	const gd::GdImage& shared = img;
+
+	gd::Opacity seen[4];
+	std::thread threads[4];
+	for (int i = 0; i < 4; ++i)
+		threads[i] = std::thread{ [&, i] { seen[i] = shared.opacity(); } };
+	for (auto& thread : threads)
+		thread.join();
+
+	for (auto opacity : seen)
+		EXPECT_EQ(gd::Opacity::Opaque, opacity);
+	EXPECT_EQ(gd::Opacity::Opaque, shared.opacity());
+}
+
+TEST(Opacity, MoveCarriesTheCache)
+{
+	gd::GdImage img{ gdImageCreateTrueColor(4, 4), gd::Opacity::Opaque };
+	gd::GdImage moved{ std::move(img) };
+	EXPECT_FALSE(static_cast<bool>(img));
+	EXPECT_EQ(gd::Opacity::Opaque, moved.opacity());
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <gdex.hpp>
+#include <gdex_algorithm.hpp>
+
+namespace
+{
+	// Every index in use, including ones past colorsTotal, which read
+	// as whatever the palette arrays hold
+	gd::GdImage indexed(int w, int h, int colors, int transparent)
+	{
+		gd::GdImage img{ gdImageCreate(w, h) };
+		for (int c = 0; c < colors; ++c)
+			gdImageColorAllocateAlpha(img.get(), (c * 47) & 255, (c * 91) & 255, 255 - c, c % (gdAlphaMax + 1));
+		gdImageColorTransparent(img.get(), transparent);
+
+		unsigned seed = (unsigned)(w * 31 + h);
+		for (int y = 0; y < h; ++y)
+			for (int x = 0; x < w; ++x)
+			{
+				seed = seed * 1103515245u + 12345u;
+				img.get()->pixels[y][x] = (unsigned char)(seed >> 16);
+			}
+		return img;
+	}
+
+	void expectExpanded(gd::GdImage& src)
+	{
+		gd::GdImage expanded{ gd::toTrueColor(src.view().image()) };
+		ASSERT_TRUE(static_cast<bool>(expanded));
+		ASSERT_TRUE(expanded.view().image()->trueColor != 0);
+		ASSERT_EQ(src.width(), expanded.width());
+		ASSERT_EQ(src.height(), expanded.height());
+
+		// the transparent index keeps its color in gdImageGetTrueColorPixel;
+		// like gdImagePaletteToTrueColor, toTrueColor makes it black
+		auto raw = src.get();
+		for (int y = 0; y < gdImageSY(raw); ++y)
+			for (int x = 0; x < gdImageSX(raw); ++x)
+			{
+				int expected = gdImageGetTrueColorPixel(raw, x, y);
+				if (raw->pixels[y][x] == raw->transparent)
+					expected = gdTrueColorAlpha(0, 0, 0, gdAlphaTransparent);
+				ASSERT_EQ(expected, expanded.view().row(y)[x]) << x << "," << y;
+			}
+	}
+}
+
+TEST(Palette, ToTrueColorMatchesGetTrueColorPixel)
+{
+	// widths around the 8 indices an AVX2 gather takes, and a size
+	// split into bands
+	const int sizes[][2] = { { 1, 1 }, { 7, 3 }, { 8, 2 }, { 9, 5 }, { 17, 4 }, { 301, 257 } };
+	for (auto& size : sizes)
+	{
+		auto img = indexed(size[0], size[1], gdMaxColors, 3);
+		expectExpanded(img);
+		if (HasFatalFailure())
+			return;
+	}
+
+	auto few = indexed(33, 9, 12, 0);
+	expectExpanded(few);
+	auto opaque = indexed(33, 9, gdMaxColors, -1);
+	expectExpanded(opaque);
+}
+
+TEST(Palette, ExpansionSavesAlphaWhenTransparent)
+{
+	gd::GdImage keyed{ gdImageCreate(4, 4) };
+	gdImageColorAllocate(keyed.get(), 0, 0, 0);
+	gdImageColorAllocate(keyed.get(), 255, 0, 0);
+	gdImageColorTransparent(keyed.get(), 1);
+	gd::GdImage expanded{ gd::toTrueColor(keyed.view().image()) };
+	EXPECT_EQ(1, expanded.view().image()->saveAlphaFlag);
+
+	gd::GdImage plain{ gdImageCreate(4, 4) };
+	gdImageColorAllocate(plain.get(), 0, 0, 0);
+	gd::GdImage opaque{ gd::toTrueColor(plain.view().image()) };
+	EXPECT_EQ(0, opaque.view().image()->saveAlphaFlag);
+}
+
+TEST(Palette, PixelRowsExpandLikeToTrueColor)
+{
+	auto img = indexed(29, 6, gdMaxColors, 200);
+	gd::GdImage expanded{ gd::toTrueColor(img.view().image()) };
+	gd::PixelRows rows{ img.view() };
+	for (int y = 0; y < 6; ++y)
+	{
+		auto row = rows.row(y);
+		for (int x = 0; x < 29; ++x)
+			ASSERT_EQ(expanded.view().row(y)[x], row[x]) << x << "," << y;
+	}
+}
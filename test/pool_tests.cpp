@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <gtest/gtest.h>
+#include <gdex.hpp>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	class Pool : public ::testing::Test
+	{
+	protected:
+		void SetUp() override
+		{
+			resize(3);
+		}
+
+		void TearDown() override
+		{
+			gd::configurePool(gd::PoolOptions{});
+		}
+
+		static void resize(int threads)
+		{
+			gd::PoolOptions options;
+			options.threads = threads;
+			ASSERT_TRUE(gd::configurePool(options));
+		}
+
+		// a deadlock fails the test instead of hanging it
+		template <typename T>
+		static bool ready(std::future<T>& future)
+		{
+			return future.wait_for(std::chrono::seconds(20)) == std::future_status::ready;
+		}
+	};
+}
+
+TEST_F(Pool, ForEachBandCoversEveryRowOnce)
+{
+	const int rows = 5000;
+	std::vector<int> hits(rows);
+	std::atomic<int> bands{ 0 };
+	gd::forEachBand(rows, 1 << 20, gd::Execution::Parallel, [&](int begin, int end) {
+		++bands;
+		for (int y = begin; y < end; ++y)
+			++hits[y];
+	});
+
+	EXPECT_GT(bands.load(), 1);
+	for (int y = 0; y < rows; ++y)
+		ASSERT_EQ(1, hits[y]) << "row " << y;
+}
+
+TEST_F(Pool, NestedParallelWorkFinishes)
+{
+	// every worker blocks in a parallel call of its own; the callers
+	// work through their bands themselves instead of waiting on a
+	// pool that has nobody left
+	const int tasks = 12;
+	std::vector<std::promise<long long>> sums(tasks);
+	for (int i = 0; i < tasks; ++i)
+	{
+		auto sum = &sums[i];
+		gd::post(gd::Priority::Bulk, [sum] {
+			std::atomic<long long> total{ 0 };
+			gd::forEachBand(1000, 1 << 20, gd::Execution::Parallel, [&](int begin, int end) {
+				long long band = 0;
+				for (int y = begin; y < end; ++y)
+					band += y;
+				total += band;
+			});
+			sum->set_value(total);
+		});
+	}
+
+	for (auto& sum : sums)
+	{
+		auto future = sum.get_future();
+		ASSERT_TRUE(ready(future));
+		EXPECT_EQ(999 * 1000 / 2, future.get());
+	}
+}
+
+TEST_F(Pool, InteractiveBeforeBulk)
+{
+	resize(1);
+
+	std::promise<void> release;
+	auto gate = release.get_future().share();
+	std::promise<void> blocked;
+	gd::post(gd::Priority::Bulk, [gate, &blocked] {
+		blocked.set_value();
+		gate.wait();
+	});
+	blocked.get_future().wait();
+
+	std::mutex lock;
+	std::vector<gd::Priority> order;
+	std::vector<std::promise<void>> done(6);
+	for (int i = 0; i < 6; ++i)
+	{
+		auto priority = i % 2 ? gd::Priority::Interactive : gd::Priority::Bulk;
+		auto finished = &done[i];
+		gd::post(priority, [&, finished] {
+			{
+				std::lock_guard<std::mutex> guard{ lock };
+				order.push_back(gd::workPriority());
+			}
+			finished->set_value();
+		});
+	}
+	release.set_value();
+
+	for (auto& finished : done)
+	{
+		auto future = finished.get_future();
+		ASSERT_TRUE(ready(future));
+	}
+	ASSERT_EQ(6u, order.size());
+	for (int i = 0; i < 3; ++i)
+		EXPECT_EQ(gd::Priority::Interactive, order[i]) << i;
+	for (int i = 3; i < 6; ++i)
+		EXPECT_EQ(gd::Priority::Bulk, order[i]) << i;
+}
+
+TEST_F(Pool, ConfigureFromAWorkerIsRefused)
+{
+	std::promise<bool> result;
+	gd::post(gd::Priority::Interactive, [&] {
+		gd::PoolOptions options;
+		options.threads = 1;
+		result.set_value(gd::configurePool(options));
+	});
+
+	auto future = result.get_future();
+	ASSERT_TRUE(ready(future));
+	EXPECT_FALSE(future.get());
+	EXPECT_EQ(3, gd::poolThreads());
+}
+
+TEST_F(Pool, ResizeWhileSubmitting)
+{
+	std::atomic<bool> running{ true };
+	std::atomic<int> posted{ 0 }, ran{ 0 };
+	std::thread submitter{ [&] {
+		while (running)
+		{
+			++posted;
+			gd::post(gd::Priority::Bulk, [&] { ++ran; });
+		}
+	} };
+
+	for (int i = 0; i < 20; ++i)
+		resize(i % 2 ? 1 : 3);
+	resize(2);
+	running = false;
+	submitter.join();
+
+	// resizing drains the old workers, so this waits for every task
+	resize(2);
+	EXPECT_EQ(posted.load(), ran.load());
+	EXPECT_EQ(2, gd::poolThreads());
+}
+
+TEST_F(Pool, NoWorkersRunsInline)
+{
+	resize(0);
+	auto caller = std::this_thread::get_id();
+	std::thread::id ranOn;
+	gd::post(gd::Priority::Bulk, [&] { ranOn = std::this_thread::get_id(); });
+	EXPECT_EQ(caller, ranOn);
+}
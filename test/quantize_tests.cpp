@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <gtest/gtest.h>
+#include <gdex.hpp>
+
+namespace
+{
+	gd::GdImage gradient(int w, int h)
+	{
+		gd::GdImage img{ gdImageCreateTrueColor(w, h) };
+		auto view = img.mutableView();
+		for (int y = 0; y < h; ++y)
+			for (int x = 0; x < w; ++x)
+				view.row(y)[x] = gdTrueColorAlpha(x * 255 / (w - 1), y * 255 / (h - 1), (x + y) * 255 / (w + h - 2), (x / 8) % 4 * 20);
+		return img;
+	}
+
+	gd::ImageDifference quantized(const gd::GdImage& img, const gd::QuantizeOptions& options)
+	{
+		gd::GdImage palette{ gd::quantize(img.view().image(), options) };
+		EXPECT_TRUE(static_cast<bool>(palette));
+		if (!palette)
+			return{};
+		EXPECT_FALSE(gdImageTrueColor(palette.view().image()));
+		return gd::difference(img.view(), palette.view());
+	}
+}
+
+TEST(Quantize, FewColorsComeBackExactly)
+{
+	gd::GdImage img{ gdImageCreateTrueColor(64, 64) };
+	auto view = img.mutableView();
+	for (int y = 0; y < 64; ++y)
+		for (int x = 0; x < 64; ++x)
+		{
+			int i = (x / 16) + (y / 16) * 4;
+			view.row(y)[x] = gdTrueColorAlpha(i * 16, 255 - i * 16, (i * 40) & 255, (i % 3) * 30);
+		}
+
+	gd::QuantizeOptions options;
+	auto diff = quantized(img, options);
+	EXPECT_EQ(0, diff.maxChannel);
+	EXPECT_EQ(0.0, diff.mse);
+}
+
+TEST(Quantize, ErrorShrinksWithPaletteSize)
+{
+	auto img = gradient(256, 256);
+
+	double previous = 1e9;
+	for (int colors : { 16, 64, 256 })
+	{
+		gd::QuantizeOptions options;
+		options.colors = colors;
+		auto diff = quantized(img, options);
+		EXPECT_LT(diff.mse, previous) << colors;
+		previous = diff.mse;
+	}
+	// four channels of gradient into 256 entries: a bit over 32 dB
+	EXPECT_LT(previous, 40.0);
+}
+
+TEST(Quantize, DitheringKeepsTheMeanError)
+{
+	auto img = gradient(200, 120);
+
+	gd::QuantizeOptions options;
+	options.colors = 32;
+	auto plain = quantized(img, options);
+	options.dither = true;
+	auto dithered = quantized(img, options);
+
+	// diffusion trades a slightly larger per-pixel error for a
+	// correct local average; it must not run away
+	EXPECT_LT(dithered.mse, plain.mse * 2.0);
+	EXPECT_GT(dithered.psnr, 18.0);
+}
+
+TEST(Quantize, OneColorImage)
+{
+	gd::GdImage img{ gdImageCreateTrueColor(1500, 1500) };
+	auto color = gdTrueColorAlpha(0x57, 0xA3, 0x0F, 0x4F);
+	img.fillRectangle(color);
+
+	gd::QuantizeOptions options;
+	options.colors = 2;
+	auto diff = quantized(img, options);
+	EXPECT_EQ(0, diff.maxChannel);
+}
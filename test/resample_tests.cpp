@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <gdex.hpp>
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+#include <vector>
+
+namespace
+{
+	gd::GdImage noise(int w, int h, unsigned seed, bool opaque = false)
+	{
+		gd::GdImage img{ gdImageCreateTrueColor(w, h) };
+		auto view = img.mutableView();
+		for (int y = 0; y < h; ++y)
+			for (int x = 0; x < w; ++x)
+			{
+				seed = seed * 1103515245u + 12345u;
+				int px = (int)(seed >> 8) & 0x7FFFFFFF;
+				view.row(y)[x] = opaque ? px & 0xFFFFFF : px;
+			}
+		return img;
+	}
+
+	struct Premultiplied
+	{
+		double b, g, r, a;
+	};
+
+	// What the resampler reads: the transparent palette index is fully
+	// transparent
+	int colorAt(const gdImage* img, int x, int y)
+	{
+		if (img->trueColor)
+			return img->tpixels[y][x];
+		int c = img->pixels[y][x];
+		if (c == img->transparent)
+			return gdTrueColorAlpha(0, 0, 0, gdAlphaTransparent);
+		return gdTrueColorAlpha(img->red[c], img->green[c], img->blue[c], img->alpha[c]);
+	}
+
+	// Overlap of output pixel i with input pixel j, as a share of i
+	double overlap(int i, int j, int srcSize, int dstSize)
+	{
+		double scale = (double)srcSize / dstSize;
+		double lo = i * scale, hi = (i + 1) * scale;
+		return std::max(0.0, std::min(hi, j + 1.0) - std::max(lo, (double)j)) / scale;
+	}
+
+	// Straight area average in double precision, with the same
+	// sharpening stencil, edges repeated
+	std::vector<int> reference(const gdImage* src, int w, int h, double sharpen = 0.0)
+	{
+		std::vector<Premultiplied> avg((size_t)w * h);
+		for (int y = 0; y < h; ++y)
+			for (int x = 0; x < w; ++x)
+			{
+				Premultiplied sum = { 0, 0, 0, 0 };
+				for (int sy = 0; sy < src->sy; ++sy)
+				{
+					double wy = overlap(y, sy, src->sy, h);
+					if (!wy)
+						continue;
+					for (int sx = 0; sx < src->sx; ++sx)
+					{
+						double weight = wy * overlap(x, sx, src->sx, w);
+						if (!weight)
+							continue;
+						int px = colorAt(src, sx, sy);
+						double cov = (gdAlphaMax - gdTrueColorGetAlpha(px)) / (double)gdAlphaMax;
+						sum.b += weight * cov * gdTrueColorGetBlue(px);
+						sum.g += weight * cov * gdTrueColorGetGreen(px);
+						sum.r += weight * cov * gdTrueColorGetRed(px);
+						sum.a += weight * cov;
+					}
+				}
+				avg[(size_t)y * w + x] = sum;
+			}
+
+		auto at = [&](int x, int y) -> const Premultiplied& {
+			return avg[(size_t)std::min(std::max(y, 0), h - 1) * w + std::min(std::max(x, 0), w - 1)];
+		};
+		auto sharpened = [&](double Premultiplied::*c, int x, int y) {
+			double mid = at(x, y).*c;
+			if (!sharpen)
+				return mid;
+			double around = at(x - 1, y).*c + at(x + 1, y).*c + at(x, y - 1).*c + at(x, y + 1).*c;
+			return std::min(std::max(mid * (1 + 4 * sharpen) - around * sharpen, 0.0), at(x, y).a * 255);
+		};
+
+		std::vector<int> out((size_t)w * h);
+		for (int y = 0; y < h; ++y)
+			for (int x = 0; x < w; ++x)
+			{
+				double a = at(x, y).a;
+				if (a <= 0)
+				{
+					out[(size_t)y * w + x] = gdTrueColorAlpha(0, 0, 0, gdAlphaTransparent);
+					continue;
+				}
+				auto channel = [&](double Premultiplied::*c) { return std::min(255, (int)(sharpened(c, x, y) / a + 0.5)); };
+				out[(size_t)y * w + x] = gdTrueColorAlpha(channel(&Premultiplied::r), channel(&Premultiplied::g),
+					channel(&Premultiplied::b), std::max(0, gdAlphaMax - (int)(a * gdAlphaMax + 0.5)));
+			}
+		return out;
+	}
+
+	// float accumulation may land a rounding step away
+	void expectClose(const std::vector<int>& expected, const gdImage* actual)
+	{
+		ASSERT_TRUE(actual != nullptr);
+		for (int y = 0; y < actual->sy; ++y)
+			for (int x = 0; x < actual->sx; ++x)
+			{
+				int e = expected[(size_t)y * actual->sx + x];
+				int a = actual->tpixels[y][x];
+				int shifts[] = { 0, 8, 16, 24 };
+				for (int shift : shifts)
+					ASSERT_LE(abs(((e >> shift) & 0xFF) - ((a >> shift) & 0xFF)), 1)
+						<< x << "," << y << " " << std::hex << e << " " << a;
+			}
+	}
+
+	void expectResampled(const gd::GdImage& src, int w, int h, float sharpen = 0.0f)
+	{
+		gd::ResampleOptions options;
+		options.sharpen = sharpen;
+		gd::GdImage out{ gd::resample(src.view().image(), w, h, options) };
+		ASSERT_TRUE(static_cast<bool>(out));
+		ASSERT_EQ((size_t)w, out.width());
+		ASSERT_EQ((size_t)h, out.height());
+		expectClose(reference(src.view().image(), w, h, sharpen), out.view().image());
+	}
+}
+
+TEST(Resample, DownscaleIsAnAreaAverage)
+{
+	expectResampled(noise(97, 61, 1), 31, 17);
+	expectResampled(noise(64, 64, 2), 32, 32);
+	// enough rows to be split into bands
+	expectResampled(noise(300, 400, 3), 120, 260);
+}
+
+TEST(Resample, UpscaleIsAnAreaAverage)
+{
+	expectResampled(noise(7, 5, 4), 23, 19);
+	expectResampled(noise(3, 3, 5), 3, 300);
+}
+
+TEST(Resample, EdgeSizes)
+{
+	expectResampled(noise(1, 1, 6), 5, 4);
+	expectResampled(noise(50, 40, 7), 1, 1);
+	expectResampled(noise(1, 30, 8), 7, 1);
+	expectResampled(noise(30, 1, 9), 1, 13);
+
+	auto src = noise(4, 4, 10);
+	EXPECT_EQ(nullptr, gd::resample(src.view().image(), 0, 4, gd::ResampleOptions{}));
+	EXPECT_EQ(nullptr, gd::resample(src.view().image(), 4, -1, gd::ResampleOptions{}));
+}
+
+TEST(Resample, SharpenMatchesTheStencil)
+{
+	expectResampled(noise(97, 61, 11), 31, 17, 0.5f);
+	expectResampled(noise(300, 400, 12), 120, 260, 0.3f);
+	expectResampled(noise(7, 5, 13), 23, 19, 1.0f);
+
+	// a flat image has nothing to sharpen
+	gd::GdImage flat{ gdImageCreateTrueColor(40, 40) };
+	gd::fill(flat.mutableView(), gdTrueColorAlpha(90, 120, 30, 20));
+	gd::ResampleOptions options;
+	options.sharpen = 1.0f;
+	gd::GdImage out{ gd::resample(flat.view().image(), 13, 11, options) };
+	for (int y = 0; y < 11; ++y)
+		for (int x = 0; x < 13; ++x)
+			ASSERT_EQ(gdTrueColorAlpha(90, 120, 30, 20), out.view().row(y)[x]);
+}
+
+TEST(Resample, OpaqueHintSkipsAlpha)
+{
+	auto src = noise(97, 61, 14, true);
+	gd::ResampleOptions options;
+	options.opacity = gd::Opacity::Opaque;
+	gd::GdImage out{ gd::resample(src.view().image(), 31, 17, options) };
+	expectClose(reference(src.view().image(), 31, 17), out.view().image());
+	EXPECT_EQ(0, out.view().image()->saveAlphaFlag);
+}
+
+TEST(Resample, PaletteSourcesReadLikeTheirExpansion)
+{
+	gd::GdImage palette{ gdImageCreate(53, 37) };
+	for (int c = 0; c < 64; ++c)
+		gdImageColorAllocateAlpha(palette.get(), c * 4, 255 - c * 4, c * 2, c % 3 ? 0 : c);
+	gdImageColorTransparent(palette.get(), 7);
+	unsigned seed = 15;
+	for (int y = 0; y < 37; ++y)
+		for (int x = 0; x < 53; ++x)
+		{
+			seed = seed * 1103515245u + 12345u;
+			palette.get()->pixels[y][x] = (unsigned char)((seed >> 16) % 64);
+		}
+
+	gd::GdImage expanded{ gd::toTrueColor(palette.view().image()) };
+	for (int sharpen = 0; sharpen < 2; ++sharpen)
+	{
+		gd::ResampleOptions options;
+		options.sharpen = sharpen * 0.5f;
+		gd::GdImage fromPalette{ gd::resample(palette.view().image(), 20, 50, options) };
+		gd::GdImage fromTrueColor{ gd::resample(expanded.view().image(), 20, 50, options) };
+		EXPECT_TRUE(fromPalette.equals(fromTrueColor));
+		expectClose(reference(palette.view().image(), 20, 50, options.sharpen), fromPalette.view().image());
+	}
+}
+
+TEST(Resample, LinearLightAveragesBrighter)
+{
+	// black and white columns: half the light is sRGB 188, while
+	// averaging the sRGB values gives 128
+	gd::GdImage stripes{ gdImageCreateTrueColor(64, 8) };
+	for (int y = 0; y < 8; ++y)
+		for (int x = 0; x < 64; ++x)
+			stripes.get()->tpixels[y][x] = x & 1 ? gdTrueColor(255, 255, 255) : gdTrueColor(0, 0, 0);
+
+	gd::ResampleOptions options;
+	gd::GdImage plain{ gd::resample(stripes.view().image(), 32, 4, options) };
+	options.linear = true;
+	gd::GdImage linear{ gd::resample(stripes.view().image(), 32, 4, options) };
+	ASSERT_TRUE(static_cast<bool>(plain));
+	ASSERT_TRUE(static_cast<bool>(linear));
+
+	for (int y = 0; y < 4; ++y)
+		for (int x = 0; x < 32; ++x)
+		{
+			int a = plain.view().row(y)[x], b = linear.view().row(y)[x];
+			EXPECT_NEAR(128, gdTrueColorGetRed(a), 1);
+			EXPECT_NEAR(188, gdTrueColorGetRed(b), 1);
+			EXPECT_EQ(gdTrueColorGetRed(b), gdTrueColorGetBlue(b));
+			EXPECT_EQ(gdAlphaOpaque, gdTrueColorGetAlpha(b));
+		}
+
+	// black and white stay what they are
+	gd::GdImage solid{ gdImageCreateTrueColor(10, 10) };
+	gd::fill(solid.mutableView(), gdTrueColor(255, 255, 255));
+	gd::GdImage white{ gd::resample(solid.view().image(), 3, 3, options) };
+	EXPECT_EQ(gdTrueColor(255, 255, 255), white.view().row(1)[1]);
+	gd::fill(solid.mutableView(), gdTrueColor(0, 0, 0));
+	gd::GdImage black{ gd::resample(solid.view().image(), 3, 3, options) };
+	EXPECT_EQ(gdTrueColor(0, 0, 0), black.view().row(1)[1]);
+}
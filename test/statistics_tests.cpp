@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <gdex.hpp>
+
+namespace
+{
+	gd::GdImage noise(int w, int h, unsigned seed)
+	{
+		gd::GdImage img{ gdImageCreateTrueColor(w, h) };
+		auto view = img.mutableView();
+		for (int y = 0; y < h; ++y)
+			for (int x = 0; x < w; ++x)
+			{
+				seed = seed * 1103515245u + 12345u;
+				int px = (int)(seed >> 8) & 0x7FFFFFFF;
+				// long fully transparent runs, for the skipping path
+				view.row(y)[x] = (x / 8) % 3 == 0 ? px | 0x7F000000 : px;
+			}
+		return img;
+	}
+
+	// One pixel at a time, through gdImageGetTrueColorPixel
+	gd::ImageStatistics reference(const gd::ImageView& view)
+	{
+		gd::ImageStatistics stats;
+		uint64_t weight = 0, red = 0, green = 0, blue = 0;
+		auto img = const_cast<gdImagePtr>(view.image());
+		for (int y = 0; y < view.height(); ++y)
+			for (int x = 0; x < view.width(); ++x)
+			{
+				int px = view.trueColor() ? view.row(y)[x] : gdImageGetTrueColorPixel(img, view.crop().x + x, view.crop().y + y);
+				int a = gdTrueColorGetAlpha(px);
+				++stats.pixels;
+				++stats.alpha[a];
+				if (a == gdAlphaTransparent)
+					continue;
+				++stats.red[gdTrueColorGetRed(px)];
+				++stats.green[gdTrueColorGetGreen(px)];
+				++stats.blue[gdTrueColorGetBlue(px)];
+				uint64_t w = gdAlphaTransparent - a;
+				weight += w;
+				red += w * gdTrueColorGetRed(px);
+				green += w * gdTrueColorGetGreen(px);
+				blue += w * gdTrueColorGetBlue(px);
+			}
+		if (weight)
+			stats.mean = gdTrueColor((int)((red + weight / 2) / weight), (int)((green + weight / 2) / weight), (int)((blue + weight / 2) / weight));
+		return stats;
+	}
+
+	void expectSame(const gd::ImageStatistics& expected, const gd::ImageStatistics& actual)
+	{
+		ASSERT_EQ(expected.pixels, actual.pixels);
+		EXPECT_EQ(expected.mean, actual.mean);
+		for (int i = 0; i < 256; ++i)
+		{
+			ASSERT_EQ(expected.red[i], actual.red[i]) << i;
+			ASSERT_EQ(expected.green[i], actual.green[i]) << i;
+			ASSERT_EQ(expected.blue[i], actual.blue[i]) << i;
+		}
+		for (int i = 0; i <= gdAlphaMax; ++i)
+			ASSERT_EQ(expected.alpha[i], actual.alpha[i]) << i;
+	}
+
+	gd::StatisticsOptions serial()
+	{
+		gd::StatisticsOptions options;
+		options.parallel = false;
+		return options;
+	}
+}
+
+TEST(Statistics, MatchesScalarRecount)
+{
+	auto img = noise(301, 257, 1);
+	expectSame(reference(img.view()), gd::statistics(img.view(), gd::StatisticsOptions{}));
+	expectSame(reference(img.view()), gd::statistics(img.view(), serial()));
+
+	auto view = img.view({ 13, 7, 101, 99 });
+	expectSame(reference(view), gd::statistics(view, gd::StatisticsOptions{}));
+}
+
+TEST(Statistics, PaletteViewsCountThroughThePalette)
+{
+	gd::GdImage img{ gdImageCreate(67, 45) };
+	for (int c = 0; c < 40; ++c)
+		gdImageColorAllocateAlpha(img.get(), c * 6, 255 - c * 6, c, c * 3);
+	gdImageColorTransparent(img.get(), 4);
+	for (int y = 0; y < 45; ++y)
+		for (int x = 0; x < 67; ++x)
+			img.get()->pixels[y][x] = (unsigned char)((x * 7 + y * 3) % 40);
+
+	expectSame(reference(img.view()), gd::statistics(img.view(), gd::StatisticsOptions{}));
+	expectSame(reference(img.view()), gd::statistics(img.view(), serial()));
+}
+
+TEST(Statistics, ParallelAndSerialAgree)
+{
+	auto img = noise(1024, 700, 2);
+	auto parallel = gd::statistics(img.view(), gd::StatisticsOptions{});
+	auto sequential = gd::statistics(img.view(), serial());
+	expectSame(sequential, parallel);
+
+	ASSERT_EQ(sequential.dominant.size(), parallel.dominant.size());
+	EXPECT_EQ(5u, parallel.dominant.size());
+	for (size_t i = 0; i < parallel.dominant.size(); ++i)
+	{
+		EXPECT_EQ(sequential.dominant[i].color, parallel.dominant[i].color);
+		EXPECT_EQ(sequential.dominant[i].share, parallel.dominant[i].share);
+	}
+}
+
+TEST(Statistics, OpaqueHintCountsTheSame)
+{
+	gd::GdImage img{ gdImageCreateTrueColor(99, 50) };
+	unsigned seed = 3;
+	for (int y = 0; y < 50; ++y)
+		for (int x = 0; x < 99; ++x)
+		{
+			seed = seed * 1103515245u + 12345u;
+			img.get()->tpixels[y][x] = (int)(seed >> 8) & 0xFFFFFF;
+		}
+
+	gd::StatisticsOptions options;
+	options.opacity = gd::Opacity::Opaque;
+	auto stats = gd::statistics(img.view(), options);
+	expectSame(reference(img.view()), stats);
+	EXPECT_TRUE(stats.opaque());
+	EXPECT_FALSE(stats.translucent());
+}
@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <gdex.hpp>
+#include <functional>
+
+namespace
+{
+	int at(const gdImage* img, int x, int y)
+	{
+		return img->trueColor ? img->tpixels[y][x] : img->pixels[y][x];
+	}
+
+	// Every pixel different in truecolor, palette indices repeating
+	gd::GdImage numbered(bool trueColor, int w, int h)
+	{
+		gd::GdImage img{ trueColor ? gdImageCreateTrueColor(w, h) : gdImageCreate(w, h) };
+		auto raw = img.get();
+		if (!trueColor)
+		{
+			for (int c = 0; c < gdMaxColors; ++c)
+				gdImageColorAllocateAlpha(raw, c, 255 - c, c / 2, c % (gdAlphaMax + 1));
+			raw->transparent = 5;
+		}
+
+		for (int y = 0; y < h; ++y)
+			for (int x = 0; x < w; ++x)
+			{
+				if (trueColor)
+					raw->tpixels[y][x] = (y << 12 | x) & 0x7FFFFFFF;
+				else
+					raw->pixels[y][x] = (unsigned char)(x * 7 + y * 13);
+			}
+		return img;
+	}
+
+	// dst(x, y) == src(from(x, y)) over all of dst, palette and
+	// transparent index carried over
+	typedef std::function<std::pair<int, int>(int x, int y, int w, int h)> Source;
+
+	void expectMoved(const gdImage* src, const gdImage* dst, int w, int h, const Source& from)
+	{
+		ASSERT_EQ(src->trueColor, dst->trueColor);
+		ASSERT_EQ(src->transparent, dst->transparent);
+		if (!src->trueColor)
+		{
+			ASSERT_EQ(src->colorsTotal, dst->colorsTotal);
+			for (int c = 0; c < src->colorsTotal; ++c)
+				ASSERT_EQ(src->alpha[c], dst->alpha[c]);
+		}
+
+		for (int y = 0; y < dst->sy; ++y)
+			for (int x = 0; x < dst->sx; ++x)
+			{
+				auto p = from(x, y, w, h);
+				ASSERT_EQ(at(src, p.first, p.second), at(dst, x, y)) << w << "x" << h << " at " << x << "," << y;
+			}
+	}
+
+	// odd sizes leave partial SSE2 blocks and tiles; the large one is
+	// split into bands
+	const int sizes[][2] = { { 1, 1 }, { 1, 37 }, { 37, 1 }, { 3, 5 }, { 33, 31 }, { 67, 70 }, { 301, 257 } };
+}
+
+TEST(Transform, FlipsMirrorTheImage)
+{
+	for (int trueColor = 0; trueColor < 2; ++trueColor)
+		for (auto& size : sizes)
+		{
+			int w = size[0], h = size[1];
+			auto src = numbered(trueColor != 0, w, h);
+
+			auto flipped = numbered(trueColor != 0, w, h);
+			gd::flipVertical(flipped.get());
+			expectMoved(src.get(), flipped.get(), w, h, [](int x, int y, int, int h) { return std::make_pair(x, h - 1 - y); });
+
+			flipped = numbered(trueColor != 0, w, h);
+			gd::flipHorizontal(flipped.get());
+			expectMoved(src.get(), flipped.get(), w, h, [](int x, int y, int w, int) { return std::make_pair(w - 1 - x, y); });
+		}
+}
+
+TEST(Transform, RotationsAndTransposeMovePixels)
+{
+	for (int trueColor = 0; trueColor < 2; ++trueColor)
+		for (auto& size : sizes)
+		{
+			int w = size[0], h = size[1];
+			auto src = numbered(trueColor != 0, w, h);
+
+			gd::GdImage moved{ gd::transpose(src.get()) };
+			ASSERT_TRUE(static_cast<bool>(moved));
+			EXPECT_EQ((size_t)h, moved.width());
+			expectMoved(src.get(), moved.get(), w, h, [](int x, int y, int, int) { return std::make_pair(y, x); });
+
+			moved.reset(gd::rotate(src.get(), gd::Rotation::Rotate90));
+			ASSERT_TRUE(static_cast<bool>(moved));
+			EXPECT_EQ((size_t)h, moved.width());
+			expectMoved(src.get(), moved.get(), w, h, [](int x, int y, int, int h) { return std::make_pair(y, h - 1 - x); });
+
+			moved.reset(gd::rotate(src.get(), gd::Rotation::Rotate180));
+			ASSERT_TRUE(static_cast<bool>(moved));
+			EXPECT_EQ((size_t)w, moved.width());
+			expectMoved(src.get(), moved.get(), w, h, [](int x, int y, int w, int h) { return std::make_pair(w - 1 - x, h - 1 - y); });
+
+			moved.reset(gd::rotate(src.get(), gd::Rotation::Rotate270));
+			ASSERT_TRUE(static_cast<bool>(moved));
+			EXPECT_EQ((size_t)h, moved.width());
+			expectMoved(src.get(), moved.get(), w, h, [](int x, int y, int w, int) { return std::make_pair(w - 1 - y, x); });
+		}
+}
+
+TEST(Transform, FourQuarterTurnsAreNothing)
+{
+	auto img = numbered(true, 67, 70);
+	auto original = numbered(true, 67, 70);
+	for (int i = 0; i < 4; ++i)
+		ASSERT_TRUE(img.rotate(gd::Rotation::Rotate90));
+	EXPECT_TRUE(img.equals(original));
+	ASSERT_TRUE(img.transpose());
+	ASSERT_TRUE(img.transpose());
+	EXPECT_TRUE(img.equals(original));
+}